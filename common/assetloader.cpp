@@ -0,0 +1,124 @@
+#include "assetloader.h"
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+class AssetJob : public QRunnable {
+public:
+    enum Kind { Image, Cubemap };
+
+    AssetJob(Kind kind, const QString &filePath, AssetLoader *target) : kind(kind), filePath(filePath), target(target) {}
+
+    void run() {
+        QList<QImage> imgs;
+        QImage img(filePath);
+        if(!img.isNull()) {
+            if(kind == Cubemap) imgs = AssetLoader::splitCubemap(img);
+            else imgs.append(img.convertToFormat(QImage::Format_RGB888));
+        }
+        target->storeImages(filePath, imgs);
+        QMetaObject::invokeMethod(target, "imageFinished", Qt::QueuedConnection, Q_ARG(QString, filePath));
+    }
+
+private:
+    Kind kind;
+    QString filePath;
+    AssetLoader *target;
+};
+
+static QImage subImage(const QImage &img, const QRect &rect) {
+    size_t offset = rect.x() * img.depth() / 8 + rect.y() * img.bytesPerLine();
+    return QImage(img.bits() + offset, rect.width(), rect.height(), img.bytesPerLine(), img.format());
+}
+
+/**************************************************************************************/
+
+AssetLoader::AssetLoader(QObject *parent) : QObject(parent), pendingJobs(0), failed(false) {
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+AssetLoader::~AssetLoader() {
+    //jobs still running write into this object
+    pool.waitForDone();
+}
+
+void AssetLoader::loadModel(OBJModel *model, const QString &filePath, const QString &texPath) {
+    ++pendingJobs;
+    loaded.remove(filePath);
+    models.insert(model, filePath);
+    connect(model, SIGNAL(loadStatus(bool)), this, SLOT(modelFinished(bool)));
+    model->loadModel(filePath, texPath);
+}
+
+void AssetLoader::loadImage(const QString &filePath) {
+    ++pendingJobs;
+    loaded.remove(filePath);
+    pool.start(new AssetJob(AssetJob::Image, filePath, this));
+}
+
+void AssetLoader::loadCubemap(const QString &filePath) {
+    ++pendingJobs;
+    loaded.remove(filePath);
+    pool.start(new AssetJob(AssetJob::Cubemap, filePath, this));
+}
+
+QImage AssetLoader::image(const QString &filePath) const {
+    QMutexLocker locker(&mutex);
+    QMap<QString, QList<QImage> >::const_iterator i = images.find(filePath);
+    return i == images.end() || i.value().isEmpty() ? QImage() : i.value().first();
+}
+
+QList<QImage> AssetLoader::cubemap(const QString &filePath) const {
+    QMutexLocker locker(&mutex);
+    return images.value(filePath);
+}
+
+QList<QImage> AssetLoader::splitCubemap(const QImage &img) {
+    int rw = 0;
+    int rh = 0;
+    for(int i = 0; i < img.width(); ++i) {
+        if(rw == 0 && img.pixel(i, 0) != qRgb(255,255,255)) rw = i;
+        if(rh == 0 && img.pixel(0, i) != qRgb(255,255,255)) rh = i;
+        if(rw != 0 && rh != 0) break;
+    }
+
+    QList<QImage> res;
+    res.append(subImage(img, QRect(2*rw, rh, rw, rh)).convertToFormat(QImage::Format_RGB888));
+    res.append(subImage(img, QRect(0, rh, rw, rh)).convertToFormat(QImage::Format_RGB888));
+    res.append(subImage(img, QRect(rw, 0, rw, rh)).convertToFormat(QImage::Format_RGB888));
+    res.append(subImage(img, QRect(rw, 2*rh, rw, rh)).convertToFormat(QImage::Format_RGB888));
+    res.append(subImage(img, QRect(rw, rh, rw, rh)).convertToFormat(QImage::Format_RGB888));
+    res.append(subImage(img, QRect(3*rw, rh, rw, rh)).convertToFormat(QImage::Format_RGB888));
+    return res;
+}
+
+void AssetLoader::modelFinished(bool status) {
+    QObject *model = sender();
+    disconnect(model, SIGNAL(loadStatus(bool)), this, SLOT(modelFinished(bool)));
+    finish(models.take(model), status);
+}
+
+void AssetLoader::imageFinished(const QString &filePath) {
+    QMutexLocker locker(&mutex);
+    bool status = !images.value(filePath).isEmpty();
+    locker.unlock();
+    finish(filePath, status);
+}
+
+void AssetLoader::storeImages(const QString &filePath, const QList<QImage> &imgs) {
+    QMutexLocker locker(&mutex);
+    images.insert(filePath, imgs);
+}
+
+void AssetLoader::finish(const QString &filePath, bool status) {
+    loaded.insert(filePath, status);
+    failed = failed || !status;
+    --pendingJobs;
+    emit assetLoaded(filePath, status);
+    if(pendingJobs == 0) {
+        bool allStatus = !failed;
+        failed = false;
+        emit allLoaded(allStatus);
+    }
+}
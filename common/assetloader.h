@@ -0,0 +1,59 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QImage>
+#include <QList>
+#include <QMap>
+
+#include "objmodel.h"
+
+// Loads the startup assets of a viewer side by side, so that startup takes as long as the slowest
+// of them. Images and cubemaps are decoded on a pool sized to the core count; OBJ models keep their
+// own loader thread, which spreads parsing over the global pool. Assets are keyed by file path.
+
+class AssetLoader : public QObject {
+    Q_OBJECT
+
+public:
+    AssetLoader(QObject *parent = 0);
+    ~AssetLoader();
+
+    void loadModel(OBJModel *model, const QString &filePath, const QString &texPath = "");
+    void loadImage(const QString &filePath);
+    void loadCubemap(const QString &filePath);
+
+    bool isLoaded(const QString &filePath) const { return loaded.value(filePath, false); }
+    bool isPending() const { return pendingJobs > 0; }
+    QImage image(const QString &filePath) const;
+    QList<QImage> cubemap(const QString &filePath) const;
+
+    // cuts a cross-shaped cubemap into +X, -X, +Y, -Y, +Z, -Z faces
+    static QList<QImage> splitCubemap(const QImage &img);
+
+signals:
+    void assetLoaded(const QString &filePath, bool status);
+    void allLoaded(bool status);
+
+private slots:
+    void modelFinished(bool status);
+    void imageFinished(const QString &filePath);
+
+private:
+    void storeImages(const QString &filePath, const QList<QImage> &imgs);
+    void finish(const QString &filePath, bool status);
+
+    QThreadPool pool;
+    mutable QMutex mutex;
+    QMap<QString, QList<QImage> > images;
+    QMap<QString, bool> loaded;
+    QMap<QObject*, QString> models;
+    int pendingJobs;
+    bool failed;
+
+    friend class AssetJob;
+};
+
+#endif // ASSETLOADER_H
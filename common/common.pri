@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Modules shared by the tasks: the OBJ loader and the GL state cache.
+# The optional modules are listed by the tasks that use them as $$COMMON/<file>.
+#
+#-------------------------------------------------
+
+COMMON = $$PWD
+
+include(objloader.pri)
+
+SOURCES += $$PWD/glstatecache.cpp
+
+HEADERS += $$PWD/glstatecache.h
@@ -0,0 +1,129 @@
+#include "glstatecache.h"
+
+#define UNKNOWN_NAME 0xffffffffu
+
+GLStateCache &GLStateCache::instance() {
+    static GLStateCache cache;
+    return cache;
+}
+
+GLStateCache::GLStateCache() : lastCalls(0), lastSkipped(0) {
+    reset();
+}
+
+void GLStateCache::reset() {
+    program = array = activeUnit = UNKNOWN_NAME;
+    polygon = 0;
+    depthWrite = -1;
+    capCount = 0;
+    for(int u = 0; u < GL_STATE_TEXTURE_UNITS; ++u) textures[u][0] = textures[u][1] = UNKNOWN_NAME;
+    calls = skipped = 0;
+}
+
+void GLStateCache::beginFrame() {
+    lastCalls = calls;
+    lastSkipped = skipped;
+    calls = skipped = 0;
+}
+
+bool GLStateCache::skip(bool same) {
+    ++calls;
+    if(same) ++skipped;
+    return same;
+}
+
+//----------------------------------------------------------------------------------------
+
+void GLStateCache::useProgram(GLuint p) {
+    if(skip(program == p)) return;
+    glUseProgram(p);
+    program = p;
+}
+
+void GLStateCache::bindVertexArray(GLuint a) {
+    if(skip(array == a)) return;
+    glBindVertexArray(a);
+    array = a;
+}
+
+void GLStateCache::polygonMode(GLenum mode) {
+    if(skip(polygon == mode)) return;
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    polygon = mode;
+}
+
+//capabilities get a slot the first time they are set, those past the last slot aren't shadowed
+int GLStateCache::capSlot(GLenum cap) {
+    for(int i = 0; i < capCount; ++i) {
+        if(caps[i] == cap) return i;
+    }
+    if(capCount == GL_STATE_CAPS) return -1;
+    caps[capCount] = cap;
+    capStates[capCount] = -1;
+    return capCount++;
+}
+
+void GLStateCache::setEnabled(GLenum cap, bool enabled) {
+    int slot = capSlot(cap);
+    if(skip(slot >= 0 && capStates[slot] == (int)enabled)) return;
+    if(enabled) glEnable(cap);
+    else glDisable(cap);
+    if(slot >= 0) capStates[slot] = enabled;
+}
+
+void GLStateCache::depthMask(GLboolean flag) {
+    if(skip(depthWrite == (flag ? 1 : 0))) return;
+    glDepthMask(flag);
+    depthWrite = flag ? 1 : 0;
+}
+
+GLboolean GLStateCache::depthMask() {
+    if(depthWrite < 0) {
+        GLboolean flag;
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &flag);
+        depthWrite = flag ? 1 : 0;
+    }
+    return depthWrite ? GL_TRUE : GL_FALSE;
+}
+
+int GLStateCache::targetSlot(GLenum target) {
+    if(target == GL_TEXTURE_2D) return 0;
+    if(target == GL_TEXTURE_CUBE_MAP) return 1;
+    return -1;
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if(!skip(activeUnit == unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    int slot = unit < GL_STATE_TEXTURE_UNITS ? targetSlot(target) : -1;
+    if(skip(slot >= 0 && textures[unit][slot] == texture)) return;
+    glBindTexture(target, texture);
+    if(slot >= 0) textures[unit][slot] = texture;
+}
+
+//----------------------------------------------------------------------------------------
+
+//GL unbinds deleted objects, the shadow follows
+void GLStateCache::deleteProgram(GLuint p) {
+    glDeleteProgram(p);
+    if(program == p) program = UNKNOWN_NAME;
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei n, const GLuint *arrays) {
+    glDeleteVertexArrays(n, arrays);
+    for(GLsizei i = 0; i < n; ++i) {
+        if(array == arrays[i]) array = UNKNOWN_NAME;
+    }
+}
+
+void GLStateCache::deleteTextures(GLsizei n, const GLuint *names) {
+    glDeleteTextures(n, names);
+    for(GLsizei i = 0; i < n; ++i) {
+        for(int u = 0; u < GL_STATE_TEXTURE_UNITS; ++u) {
+            if(textures[u][0] == names[i]) textures[u][0] = UNKNOWN_NAME;
+            if(textures[u][1] == names[i]) textures[u][1] = UNKNOWN_NAME;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include <GL/glew.h>
+
+#define GL_STATE_CAPS 8
+#define GL_STATE_TEXTURE_UNITS 8
+
+// Shadow of the GL state the renderers switch most: program, vertex array, polygon mode,
+// capabilities, depth mask and the 2D and cube map textures of the first units.
+// A call that would set what is already set is skipped and counted, so that renderers can
+// state everything they need before each draw without paying for it.
+// There is one GL context per process, the cache belongs to it: reset() after the context is
+// created, and bind and delete the shadowed objects only through the cache.
+// State that is not known yet, or a texture target or unit outside the shadow, always goes to GL.
+
+class GLStateCache {
+public:
+    static GLStateCache &instance();
+
+    // forgets everything, the next call of each kind goes to GL
+    void reset();
+    // the counters of the frame that just ended become frameCalls and frameSkipped
+    void beginFrame();
+    int frameCalls() const { return lastCalls; }
+    int frameSkipped() const { return lastSkipped; }
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint array);
+    // for GL_FRONT_AND_BACK
+    void polygonMode(GLenum mode);
+    void setEnabled(GLenum cap, bool enabled);
+    void enable(GLenum cap) { setEnabled(cap, true); }
+    void disable(GLenum cap) { setEnabled(cap, false); }
+    void depthMask(GLboolean flag);
+    // the shadowed value, GL is only asked the first time
+    GLboolean depthMask();
+    // makes unit active and binds texture to target there
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    // delete the objects and forget the bindings of their names, which GL may hand out again
+    void deleteProgram(GLuint program);
+    void deleteVertexArrays(GLsizei n, const GLuint *arrays);
+    void deleteTextures(GLsizei n, const GLuint *textures);
+
+private:
+    GLStateCache();
+
+    // counts a requested call, returns true when it can be skipped
+    bool skip(bool same);
+    int capSlot(GLenum cap);
+    static int targetSlot(GLenum target);
+
+    GLuint program, array, activeUnit;
+    GLenum polygon;
+    int depthWrite;
+    GLenum caps[GL_STATE_CAPS];
+    int capStates[GL_STATE_CAPS];
+    int capCount;
+    GLuint textures[GL_STATE_TEXTURE_UNITS][2];
+
+    int calls, skipped, lastCalls, lastSkipped;
+};
+
+#endif // GLSTATECACHE_H
@@ -0,0 +1,348 @@
+#include "objbvh.h"
+
+#include <QThreadPool>
+
+#include <algorithm>
+
+#define MIN_RANGE_SIZE (1 << 14)
+#define TRAVERSAL_COST 1.0
+
+static inline GLfloat component(const OBJVec3 &v, int axis) {
+    return (&v.x)[axis];
+}
+
+static inline OBJVec3 difference(const OBJVec3 &a, const OBJVec3 &b) {
+    OBJVec3 d = a;
+    d -= b;
+    return d;
+}
+
+static inline OBJVec3 cross(const OBJVec3 &a, const OBJVec3 &b) {
+    OBJVec3 c;
+    c.x = a.y * b.z - a.z * b.y;
+    c.y = a.z * b.x - a.x * b.z;
+    c.z = a.x * b.y - a.y * b.x;
+    return c;
+}
+
+static inline GLfloat dot(const OBJVec3 &a, const OBJVec3 &b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline int binIndex(GLfloat c, GLfloat min, double scale) {
+    double b = (c - min) * scale;
+    return b <= 0.0 ? 0 : (b >= OBJ_BVH_BINS - 1 ? OBJ_BVH_BINS - 1 : (int)b);
+}
+
+//distance along the ray where it enters the box, if it does before maxT
+static inline bool slabs(const OBJBvhNode &n, const OBJVec3 &origin, const OBJVec3 &inv, GLfloat maxT, GLfloat &entry) {
+    GLfloat t0 = (n.min.x - origin.x) * inv.x, t1 = (n.max.x - origin.x) * inv.x;
+    GLfloat lo = qMin(t0, t1), hi = qMax(t0, t1);
+    t0 = (n.min.y - origin.y) * inv.y;
+    t1 = (n.max.y - origin.y) * inv.y;
+    lo = qMax(lo, qMin(t0, t1));
+    hi = qMin(hi, qMax(t0, t1));
+    t0 = (n.min.z - origin.z) * inv.z;
+    t1 = (n.max.z - origin.z) * inv.z;
+    lo = qMax(lo, qMin(t0, t1));
+    hi = qMin(hi, qMax(t0, t1));
+    entry = qMax(lo, 0.0f);
+    return entry <= qMin(hi, maxT);
+}
+
+//Moller-Trumbore
+static inline bool triangle(const OBJVec3 &a, const OBJVec3 &b, const OBJVec3 &c, const OBJVec3 &origin, const OBJVec3 &dir, GLfloat &t, GLfloat &u, GLfloat &v) {
+    OBJVec3 e1 = difference(b, a), e2 = difference(c, a);
+    OBJVec3 p = cross(dir, e2);
+    GLfloat det = dot(e1, p);
+    if(det == 0.0f) return false;
+    GLfloat invDet = 1.0f / det;
+    OBJVec3 s = difference(origin, a);
+    u = dot(s, p) * invDet;
+    if(u < 0.0f || u > 1.0f) return false;
+    OBJVec3 q = cross(s, e1);
+    v = dot(dir, q) * invDet;
+    if(v < 0.0f || u + v > 1.0f) return false;
+    t = dot(e2, q) * invDet;
+    return t >= 0.0f;
+}
+
+struct OBJBinBelow {
+    OBJBinBelow(const VertexVector &centers, int axis, GLfloat min, double scale, int border)
+        : centers(centers), axis(axis), min(min), scale(scale), border(border) {}
+
+    bool operator()(GLuint t) const {
+        return binIndex(component(centers[t], axis), min, scale) < border;
+    }
+
+    const VertexVector &centers;
+    int axis;
+    GLfloat min;
+    double scale;
+    int border;
+};
+
+//----------------------------------------------------------------------------------------
+
+class OBJBvhBoundsTask : public QRunnable {
+public:
+    OBJBvhBoundsTask(OBJBvh &bvh, size_t begin, size_t end, QSemaphore *finished)
+        : bvh(bvh), begin(begin), end(end), finished(finished) {}
+
+    void run() {
+        bvh.bounds(begin, end);
+        finished->release();
+    }
+
+private:
+    OBJBvh &bvh;
+    size_t begin, end;
+    QSemaphore *finished;
+};
+
+class OBJBvhTask : public QRunnable {
+public:
+    OBJBvhTask(OBJBvh &bvh, const OBJBvh::Range &range) : bvh(bvh), range(range) {}
+
+    void run() {
+        bvh.subtree(range);
+    }
+
+private:
+    OBJBvh &bvh;
+    OBJBvh::Range range;
+};
+
+/**************************************************************************************/
+
+OBJBvh::Box::Box() {
+    min.x = min.y = min.z = FLT_MAX;
+    max.x = max.y = max.z = -FLT_MAX;
+}
+
+double OBJBvh::Box::area() const {
+    double dx = (double)max.x - min.x, dy = (double)max.y - min.y, dz = (double)max.z - min.z;
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+
+//----------------------------------------------------------------------------------------
+
+void OBJBvh::build(OBJMesh &mesh, const VertexVector &verts) {
+    mesh.bvh.clear();
+    mesh.bvhTriangles.clear();
+    size_t tc = mesh.indices.size() / 3;
+    if(tc == 0) return;
+    OBJBvh bvh(mesh, verts);
+
+    bvh.boxes.resize(tc);
+    bvh.centers.resize(tc);
+    size_t rangeCount = qMax<size_t>(1, qMin<size_t>(QThread::idealThreadCount() * 4, tc / MIN_RANGE_SIZE));
+    QSemaphore finished(0);
+    QThreadPool *pool = QThreadPool::globalInstance();
+    for(size_t i = 0; i < rangeCount; ++i) {
+        pool->start(new OBJBvhBoundsTask(bvh, tc * i / rangeCount, tc * (i + 1) / rangeCount, &finished));
+    }
+    finished.acquire((int)rangeCount);
+
+    Range root;
+    root.node = 0;
+    root.first = 0;
+    root.count = tc;
+    for(std::vector<Box>::const_iterator b = bvh.boxes.begin(); b != bvh.boxes.end(); ++b) root.box.add(*b);
+
+    bvh.order.resize(tc);
+    for(size_t t = 0; t < tc; ++t) bvh.order[t] = (GLuint)t;
+    //with two triangles in every leaf there are at most tc / 2 leaves and tc - 1 nodes
+    bvh.nodes.resize(qMax<size_t>(1, tc - 1));
+
+    //the calling thread takes the first path down and waits for the tasks split off on the way
+    bvh.subtree(root);
+    bvh.placed.acquire((int)tc);
+
+    mesh.bvh.assign(bvh.nodes.begin(), bvh.nodes.begin() + bvh.nextNode.fetchAndAddAcquire(0));
+    mesh.bvhTriangles.swap(bvh.order);
+}
+
+bool OBJBvh::intersect(const OBJMesh &mesh, const VertexVector &verts, const OBJVec3 &origin, const OBJVec3 &dir, OBJRayHit &hit, GLfloat maxT) {
+    if(mesh.bvh.empty()) return false;
+    OBJVec3 inv;
+    inv.x = 1.0f / dir.x;
+    inv.y = 1.0f / dir.y;
+    inv.z = 1.0f / dir.z;
+
+    GLfloat nearest = maxT, entry;
+    bool found = false;
+    if(!slabs(mesh.bvh[0], origin, inv, nearest, entry)) return false;
+
+    //nodes to visit with the distance at which the ray enters them, nearer children on top
+    std::vector<std::pair<GLuint, GLfloat> > stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(0u, entry));
+    while(!stack.empty()) {
+        std::pair<GLuint, GLfloat> top = stack.back();
+        stack.pop_back();
+        if(top.second > nearest) continue;
+
+        const OBJBvhNode &node = mesh.bvh[top.first];
+        if(node.count > 0) {
+            for(GLuint i = node.first; i < node.first + node.count; ++i) {
+                GLuint tri = mesh.bvhTriangles[i];
+                const GLuint *corners = &mesh.indices[tri * 3];
+                GLfloat t, u, v;
+                if(triangle(verts[mesh.vertices[corners[0]].v - 1], verts[mesh.vertices[corners[1]].v - 1], verts[mesh.vertices[corners[2]].v - 1], origin, dir, t, u, v)
+                        && t <= nearest) {
+                    nearest = t;
+                    hit.triangle = tri;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        GLfloat e0, e1;
+        bool hit0 = slabs(mesh.bvh[node.first], origin, inv, nearest, e0);
+        bool hit1 = slabs(mesh.bvh[node.first + 1], origin, inv, nearest, e1);
+        if(hit0 && hit1) {
+            bool firstNearer = e0 <= e1;
+            stack.push_back(firstNearer ? std::make_pair(node.first + 1, e1) : std::make_pair(node.first, e0));
+            stack.push_back(firstNearer ? std::make_pair(node.first, e0) : std::make_pair(node.first + 1, e1));
+        } else if(hit0) {
+            stack.push_back(std::make_pair(node.first, e0));
+        } else if(hit1) {
+            stack.push_back(std::make_pair(node.first + 1, e1));
+        }
+    }
+    return found;
+}
+
+OBJBvh::OBJBvh(const OBJMesh &mesh, const VertexVector &verts) : mesh(mesh), verts(verts), nextNode(1), placed(0) {
+}
+
+void OBJBvh::bounds(size_t begin, size_t end) {
+    for(size_t t = begin; t < end; ++t) {
+        Box &box = boxes[t];
+        for(int k = 0; k < 3; ++k) box.add(verts[mesh.vertices[mesh.indices[t * 3 + k]].v - 1]);
+        OBJVec3 &c = centers[t];
+        c.x = (box.min.x + box.max.x) * 0.5f;
+        c.y = (box.min.y + box.max.y) * 0.5f;
+        c.z = (box.min.z + box.max.z) * 0.5f;
+    }
+}
+
+//one half of every split is carried on here, the other goes to a new task when it's large
+void OBJBvh::subtree(const Range &root) {
+    std::vector<Range> stack(1, root);
+    size_t done = 0;
+    while(!stack.empty()) {
+        Range range = stack.back();
+        stack.pop_back();
+
+        size_t middle;
+        Range left, right;
+        if(!split(range, middle, left.box, right.box)) {
+            setNode(range.node, range.box, range.first, range.count);
+            done += range.count;
+            continue;
+        }
+        GLuint child = (GLuint)nextNode.fetchAndAddRelaxed(2);
+        setNode(range.node, range.box, child, 0);
+
+        left.node = child;
+        left.first = range.first;
+        left.count = middle - range.first;
+        right.node = child + 1;
+        right.first = middle;
+        right.count = range.first + range.count - middle;
+        if(right.count > OBJ_BVH_TASK_SIZE) QThreadPool::globalInstance()->start(new OBJBvhTask(*this, right));
+        else stack.push_back(right);
+        stack.push_back(left);
+    }
+    placed.release((int)done);
+}
+
+bool OBJBvh::split(const Range &range, size_t &middle, Box &left, Box &right) {
+    if(range.count < 4) return false;
+    size_t first = range.first, last = range.first + range.count;
+    Box centerBox;
+    for(size_t i = first; i < last; ++i) centerBox.add(centers[order[i]]);
+
+    //one pass bins the triangles along all three axes
+    GLfloat mins[3];
+    double scales[3];
+    Box bins[3][OBJ_BVH_BINS];
+    size_t counts[3][OBJ_BVH_BINS] = {{0}};
+    for(int axis = 0; axis < 3; ++axis) {
+        mins[axis] = component(centerBox.min, axis);
+        double extent = (double)component(centerBox.max, axis) - mins[axis];
+        scales[axis] = extent > 0.0 ? OBJ_BVH_BINS / extent : 0.0;
+    }
+    for(size_t i = first; i < last; ++i) {
+        GLuint t = order[i];
+        const OBJVec3 &c = centers[t];
+        for(int axis = 0; axis < 3; ++axis) {
+            int b = binIndex(component(c, axis), mins[axis], scales[axis]);
+            bins[axis][b].add(boxes[t]);
+            ++counts[axis][b];
+        }
+    }
+
+    //cost of a split relative to testing every triangle of the range, both per unit of its area
+    double bestCost = DBL_MAX;
+    int bestAxis = -1, bestBorder = 0;
+    for(int axis = 0; axis < 3; ++axis) {
+        if(scales[axis] == 0.0) continue;
+
+        //everything right of every border, then a sweep from the left
+        Box rights[OBJ_BVH_BINS];
+        size_t rightCounts[OBJ_BVH_BINS];
+        Box box;
+        size_t count = 0;
+        for(int b = OBJ_BVH_BINS - 1; b > 0; --b) {
+            box.add(bins[axis][b]);
+            count += counts[axis][b];
+            rights[b] = box;
+            rightCounts[b] = count;
+        }
+        box = Box();
+        count = 0;
+        for(int b = 1; b < OBJ_BVH_BINS; ++b) {
+            box.add(bins[axis][b - 1]);
+            count += counts[axis][b - 1];
+            if(count < 2 || rightCounts[b] < 2) continue;
+            double cost = box.area() * count + rights[b].area() * rightCounts[b];
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBorder = b;
+                left = box;
+                right = rights[b];
+            }
+        }
+    }
+
+    if(bestAxis >= 0) {
+        double area = range.box.area();
+        if(range.count <= OBJ_BVH_MAX_LEAF && TRAVERSAL_COST * area + bestCost >= area * range.count) return false;
+        middle = std::partition(order.begin() + first, order.begin() + last, OBJBinBelow(centers, bestAxis, mins[bestAxis], scales[bestAxis], bestBorder)) - order.begin();
+        return true;
+    }
+
+    //all centers in one point, the halves are as good as any split
+    if(range.count <= OBJ_BVH_MAX_LEAF) return false;
+    middle = first + range.count / 2;
+    left = right = Box();
+    for(size_t i = first; i < middle; ++i) left.add(boxes[order[i]]);
+    for(size_t i = middle; i < last; ++i) right.add(boxes[order[i]]);
+    return true;
+}
+
+void OBJBvh::setNode(GLuint node, const Box &box, size_t first, size_t count) {
+    OBJBvhNode &n = nodes[node];
+    n.min = box.min;
+    n.max = box.max;
+    n.first = (GLuint)first;
+    n.count = (GLuint)count;
+}
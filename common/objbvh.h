@@ -0,0 +1,88 @@
+#ifndef OBJBVH_H
+#define OBJBVH_H
+
+#include "objmodel.h"
+
+#include <QSemaphore>
+
+#define OBJ_BVH_BINS 16
+#define OBJ_BVH_MAX_LEAF 8
+#define OBJ_BVH_TASK_SIZE 8192
+
+// Nearest hit of a ray at origin + t * dir, on triangle number triangle of OBJMesh::indices;
+// u and v weigh its second and third corner.
+struct OBJRayHit {
+    GLuint triangle;
+    GLfloat t, u, v;
+};
+
+// Bounding volume hierarchy over the triangles of a mesh. Every range is split where the
+// surface area heuristic, evaluated at the borders of OBJ_BVH_BINS bins of the triangle
+// centroids along each axis, is cheapest; it stays a leaf when it holds at most OBJ_BVH_MAX_LEAF
+// triangles and no split beats testing them all. Both halves of a split keep two triangles or
+// more, so there are fewer nodes than triangles.
+// The build runs on the global thread pool: a range of more than OBJ_BVH_TASK_SIZE triangles
+// hands one half to a new task, nodes are taken in pairs from a shared counter and every task
+// reorders only its own part of the triangle list.
+
+class OBJBvh {
+public:
+    static void build(OBJMesh &mesh, const VertexVector &verts);
+
+    // nearest hit with t in [0, maxT], triangles are hit from either side
+    static bool intersect(const OBJMesh &mesh, const VertexVector &verts, const OBJVec3 &origin, const OBJVec3 &dir, OBJRayHit &hit, GLfloat maxT = FLT_MAX);
+
+private:
+    struct Box {
+        Box();
+        double area() const;
+
+        void add(const OBJVec3 &p) {
+            min.x = qMin(min.x, p.x);
+            min.y = qMin(min.y, p.y);
+            min.z = qMin(min.z, p.z);
+            max.x = qMax(max.x, p.x);
+            max.y = qMax(max.y, p.y);
+            max.z = qMax(max.z, p.z);
+        }
+
+        // an empty box leaves this one as it is
+        void add(const Box &other) {
+            min.x = qMin(min.x, other.min.x);
+            min.y = qMin(min.y, other.min.y);
+            min.z = qMin(min.z, other.min.z);
+            max.x = qMax(max.x, other.max.x);
+            max.y = qMax(max.y, other.max.y);
+            max.z = qMax(max.z, other.max.z);
+        }
+
+        OBJVec3 min, max;
+    };
+
+    struct Range {
+        GLuint node;
+        size_t first, count;
+        Box box;
+    };
+
+    OBJBvh(const OBJMesh &mesh, const VertexVector &verts);
+
+    void bounds(size_t begin, size_t end);
+    void subtree(const Range &root);
+    bool split(const Range &range, size_t &middle, Box &left, Box &right);
+    void setNode(GLuint node, const Box &box, size_t first, size_t count);
+
+    const OBJMesh &mesh;
+    const VertexVector &verts;
+    std::vector<Box> boxes;             // per triangle
+    VertexVector centers;               // of the boxes, what the bins sort
+    std::vector<OBJBvhNode> nodes;
+    std::vector<GLuint> order;
+    QAtomicInt nextNode;
+    QSemaphore placed;                  // released once for every triangle in a leaf
+
+    friend class OBJBvhBoundsTask;
+    friend class OBJBvhTask;
+};
+
+#endif // OBJBVH_H
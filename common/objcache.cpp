@@ -0,0 +1,386 @@
+#include "objcache.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+
+#include <cstring>
+
+#define OBJ_CACHE_DIR "cg-objcache"
+
+struct OBJCacheHeader {
+    char magic[4];
+    quint32 version;
+    qint64 sourceSize;
+    qint64 sourceTime;
+    quint64 sourceHash;
+    quint64 vertCount;
+    quint64 texCount;
+    quint64 normCount;
+    quint64 cornerCount;
+    quint64 offsetCount;
+    quint64 meshVertCount;
+    quint64 meshIndexCount;
+    quint64 lodCount;
+    quint64 lodIndexCount;
+    quint64 clusterCount;
+    quint64 chunkCount;
+    quint64 chunkBytes;
+    quint32 simplified;
+    quint32 generatedNormals;
+    double acmrBefore;
+    double acmrAfter;
+    double creaseAngle;
+    OBJBounds bounds;
+};
+
+//an OBJChunkRecord on disk, followed by its relative references and its warnings
+struct OBJCacheChunk {
+    quint64 hash;
+    qint64 size;
+    quint64 lines;
+    quint64 vertBase, texBase, normBase, faceBase, cornerBase;
+    quint64 vertCount, texCount, normCount, faceCount, cornerCount;
+    quint64 refCount, warningCount;
+    quint64 vertExcess, vertExcessLine, texExcess, texExcessLine, normExcess, normExcessLine;
+    quint32 triangles, padding;
+    OBJBounds bounds;
+};
+
+static const char cacheMagic[4] = {'O', 'B', 'J', 'C'};
+
+static inline quint64 rotl(quint64 x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline quint64 fmix(quint64 k) {
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
+
+//the counts come from the file, each one is checked against the bytes left before it is multiplied
+template<typename T>
+static bool takeArray(quint64 count, quint64 &left) {
+    if(count > left / sizeof(T)) return false;
+    left -= count * sizeof(T);
+    return true;
+}
+
+template<typename T>
+static void readArray(const char *&p, std::vector<T> &out, quint64 count) {
+    out.resize(count);
+    if(count) memcpy(&out[0], p, count * sizeof(T));
+    p += count * sizeof(T);
+}
+
+template<typename T>
+static bool writeArray(QFile &file, const std::vector<T> &in) {
+    if(in.empty()) return true;
+    qint64 size = in.size() * sizeof(T);
+    return file.write((const char*)&in[0], size) == size;
+}
+
+template<typename T>
+static void appendValue(QByteArray &out, const T &value) {
+    out.append((const char*)&value, sizeof(T));
+}
+
+template<typename T>
+static bool takeValue(const char *&p, const char *end, T &value) {
+    if(end - p < (qint64)sizeof(T)) return false;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+static QByteArray packChunks(const std::vector<OBJChunkRecord> &records) {
+    QByteArray out;
+    for(std::vector<OBJChunkRecord>::const_iterator r = records.begin(); r != records.end(); ++r) {
+        OBJCacheChunk c;
+        memset((void*)&c, 0, sizeof(c));
+        c.hash = r->hash;
+        c.size = r->size;
+        c.lines = r->lines;
+        c.vertBase = r->vertBase;
+        c.texBase = r->texBase;
+        c.normBase = r->normBase;
+        c.faceBase = r->faceBase;
+        c.cornerBase = r->cornerBase;
+        c.vertCount = r->vertCount;
+        c.texCount = r->texCount;
+        c.normCount = r->normCount;
+        c.faceCount = r->faceCount;
+        c.cornerCount = r->cornerCount;
+        c.refCount = r->relativeRefs.size();
+        c.warningCount = r->warnings.size();
+        c.vertExcess = r->vertExcess.amount;
+        c.vertExcessLine = r->vertExcess.line;
+        c.texExcess = r->texExcess.amount;
+        c.texExcessLine = r->texExcess.line;
+        c.normExcess = r->normExcess.amount;
+        c.normExcessLine = r->normExcess.line;
+        c.triangles = r->triangles;
+        c.bounds = r->bounds;
+        appendValue(out, c);
+        for(std::vector<std::pair<size_t, size_t> >::const_iterator ref = r->relativeRefs.begin(); ref != r->relativeRefs.end(); ++ref) {
+            appendValue(out, (quint64)ref->first);
+            appendValue(out, (quint64)ref->second);
+        }
+        for(std::vector<std::pair<size_t, QString> >::const_iterator w = r->warnings.begin(); w != r->warnings.end(); ++w) {
+            QByteArray text = w->second.toUtf8();
+            appendValue(out, (quint64)w->first);
+            appendValue(out, (quint64)text.size());
+            out.append(text.constData(), text.size());
+        }
+    }
+    return out;
+}
+
+//the records must cover the cached arrays chunk after chunk, anything else is dropped
+static bool unpackChunks(const char *p, const char *end, const OBJCacheHeader &hdr, std::vector<OBJChunkRecord> &records) {
+    if(hdr.chunkCount > hdr.chunkBytes / sizeof(OBJCacheChunk)) return false;
+    records.resize(hdr.chunkCount);
+    quint64 vc = 0, tc = 0, nc = 0, fc = 0, cc = 0;
+    for(std::vector<OBJChunkRecord>::iterator r = records.begin(); r != records.end(); ++r) {
+        OBJCacheChunk c;
+        if(!takeValue(p, end, c)) return false;
+        if(c.vertBase != vc || c.texBase != tc || c.normBase != nc || c.faceBase != fc || c.cornerBase != cc) return false;
+        vc += c.vertCount;
+        tc += c.texCount;
+        nc += c.normCount;
+        fc += c.faceCount;
+        cc += c.cornerCount;
+        if(c.size <= 0 || (quint64)(end - p) < c.refCount * 2 * sizeof(quint64)) return false;
+        r->hash = c.hash;
+        r->size = c.size;
+        r->lines = c.lines;
+        r->vertBase = c.vertBase;
+        r->texBase = c.texBase;
+        r->normBase = c.normBase;
+        r->faceBase = c.faceBase;
+        r->cornerBase = c.cornerBase;
+        r->vertCount = c.vertCount;
+        r->texCount = c.texCount;
+        r->normCount = c.normCount;
+        r->faceCount = c.faceCount;
+        r->cornerCount = c.cornerCount;
+        r->triangles = c.triangles != 0;
+        r->bounds = c.bounds;
+        r->vertExcess.amount = c.vertExcess;
+        r->vertExcess.line = c.vertExcessLine;
+        r->texExcess.amount = c.texExcess;
+        r->texExcess.line = c.texExcessLine;
+        r->normExcess.amount = c.normExcess;
+        r->normExcess.line = c.normExcessLine;
+        r->relativeRefs.resize(c.refCount);
+        for(quint64 i = 0; i < c.refCount; ++i) {
+            quint64 corner, base;
+            takeValue(p, end, corner);
+            takeValue(p, end, base);
+            if(corner >= 3 * c.cornerCount) return false;
+            r->relativeRefs[i] = std::make_pair((size_t)corner, (size_t)base);
+        }
+        for(quint64 i = 0; i < c.warningCount; ++i) {
+            quint64 line, length;
+            if(!takeValue(p, end, line) || !takeValue(p, end, length) || (quint64)(end - p) < length) return false;
+            r->warnings.push_back(std::make_pair((size_t)line, QString::fromUtf8(p, (int)length)));
+            p += length;
+        }
+    }
+    bool faceTable = hdr.offsetCount != 0;
+    return p == end && vc == hdr.vertCount && tc == hdr.texCount && nc == hdr.normCount && cc == hdr.cornerCount
+            && (!faceTable || fc + 1 == hdr.offsetCount);
+}
+
+static bool validCorners(const std::vector<FaceIndex> &corners, const OBJCacheHeader &hdr) {
+    for(std::vector<FaceIndex>::const_iterator c = corners.begin(); c != corners.end(); ++c) {
+        if(c->v == 0 || c->v > hdr.vertCount || c->t > hdr.texCount || c->n > hdr.normCount) return false;
+    }
+    return true;
+}
+
+/**************************************************************************************/
+
+OBJCache::OBJCache(const QString &sourcePath, const char *sourceData, qint64 sourceSize)
+    : sourcePath(sourcePath), cachePath(sidecarPath(sourcePath, "cache")), sourceData(sourceData), sourceSize(sourceSize), sourceTime(0), hash(0), hashed(false), normalsEnabled(false), creaseAngle(0.0) {
+    //resources have no usable timestamp, so they are always checked by hash
+    if(!sourcePath.startsWith(":")) sourceTime = QFileInfo(sourcePath).lastModified().toMSecsSinceEpoch();
+}
+
+QString OBJCache::sidecarPath(const QString &sourcePath, const QString &suffix) {
+    //resources and read-only locations can't be written next to
+    QFileInfo fi(sourcePath);
+    if(sourcePath.startsWith(":") || !QFileInfo(fi.absolutePath()).isWritable()) {
+        QByteArray path = sourcePath.toUtf8();
+        QDir dir(QDir::tempPath());
+        dir.mkpath(OBJ_CACHE_DIR);
+        return dir.filePath(QString(OBJ_CACHE_DIR "/%1.%2.%3").arg(fi.fileName()).arg(contentHash(path.constData(), path.size()), 0, 16).arg(suffix));
+    }
+    return sourcePath + "." + suffix;
+}
+
+quint64 OBJCache::contentHash(const char *data, qint64 size) {
+    //word-at-a-time murmur-style mix, a few GB/s on the mapped source
+    const quint64 c1 = Q_UINT64_C(0x87c37b91114253d5);
+    const quint64 c2 = Q_UINT64_C(0x4cf5ad432745937f);
+    quint64 h = Q_UINT64_C(0x9e3779b97f4a7c15) ^ (quint64)size;
+    const char *p = data;
+    const char *end = data + (size & ~(qint64)7);
+    for(; p != end; p += 8) {
+        quint64 k;
+        memcpy(&k, p, 8);
+        k *= c1;
+        k = rotl(k, 31);
+        k *= c2;
+        h ^= k;
+        h = rotl(h, 27) * 5 + 0x52dce729;
+    }
+    quint64 k = 0;
+    for(int i = 0; i < (size & 7); ++i) k |= (quint64)(unsigned char)p[i] << (i * 8);
+    h ^= rotl(k * c1, 31) * c2;
+    return fmix(h);
+}
+
+void OBJCache::setNormalGeneration(bool enabled, double creaseAngle) {
+    normalsEnabled = enabled;
+    this->creaseAngle = creaseAngle;
+}
+
+quint64 OBJCache::sourceHash() {
+    if(!hashed) {
+        hash = contentHash(sourceData, sourceSize);
+        hashed = true;
+    }
+    return hash;
+}
+
+bool OBJCache::load(OBJFaceArray &faces, OBJMesh &mesh, VertexVector &verts, VertexVector &texs, VertexVector &norms, OBJBounds &bounds, bool &generatedNormals, std::vector<OBJChunkRecord> &records) {
+    QFile fileIn(cachePath);
+    if(!fileIn.open(QFile::ReadOnly)) return false;
+    qint64 fileSize = fileIn.size();
+    if(fileSize < (qint64)sizeof(OBJCacheHeader)) return false;
+    const char *data = (const char*)fileIn.map(0, fileSize);
+    if(!data) return false;
+
+    OBJCacheHeader hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    if(memcmp(hdr.magic, cacheMagic, sizeof(cacheMagic)) != 0 || hdr.version != OBJ_CACHE_VERSION) return false;
+    if(hdr.sourceSize != sourceSize) return false;
+    if(hdr.generatedNormals && (!normalsEnabled || hdr.creaseAngle != creaseAngle)) return false;
+    quint64 left = fileSize - sizeof(hdr);
+    bool fits = takeArray<OBJVec3>(hdr.vertCount, left) && takeArray<OBJVec3>(hdr.texCount, left) && takeArray<OBJVec3>(hdr.normCount, left)
+            && takeArray<FaceIndex>(hdr.cornerCount, left) && takeArray<GLuint>(hdr.offsetCount, left)
+            && takeArray<FaceIndex>(hdr.meshVertCount, left) && takeArray<GLuint>(hdr.meshIndexCount, left)
+            && takeArray<OBJLod>(hdr.lodCount, left) && takeArray<GLuint>(hdr.lodIndexCount, left)
+            && takeArray<OBJCluster>(hdr.clusterCount, left) && takeArray<char>(hdr.chunkBytes, left);
+    if(!fits || left != 0) return false;
+    //an untouched file is trusted by its timestamp, otherwise the content decides
+    if((sourceTime == 0 || hdr.sourceTime != sourceTime) && hdr.sourceHash != sourceHash()) return false;
+
+    const char *p = data + sizeof(hdr);
+    readArray(p, verts, hdr.vertCount);
+    readArray(p, texs, hdr.texCount);
+    readArray(p, norms, hdr.normCount);
+    readArray(p, faces.corners, hdr.cornerCount);
+    readArray(p, faces.offsets, hdr.offsetCount);
+    readArray(p, mesh.vertices, hdr.meshVertCount);
+    readArray(p, mesh.indices, hdr.meshIndexCount);
+    readArray(p, mesh.lods, hdr.lodCount);
+    readArray(p, mesh.lodIndices, hdr.lodIndexCount);
+    readArray(p, mesh.clusters, hdr.clusterCount);
+
+    //indices are checked once more, a damaged cache must not crash the renderer
+    bool valid = hdr.offsetCount == 0 ? hdr.cornerCount % 3 == 0 : faces.offsets.back() == hdr.cornerCount;
+    valid = valid && hdr.meshIndexCount % 3 == 0 && hdr.bounds.count == hdr.vertCount;
+    for(size_t i = 1; valid && i < faces.offsets.size(); ++i) {
+        valid = faces.offsets[i - 1] <= faces.offsets[i];
+    }
+    valid = valid && validCorners(faces.corners, hdr) && validCorners(mesh.vertices, hdr);
+    for(std::vector<GLuint>::const_iterator i = mesh.indices.begin(); valid && i != mesh.indices.end(); ++i) {
+        valid = *i < hdr.meshVertCount;
+    }
+    for(std::vector<OBJLod>::const_iterator l = mesh.lods.begin(); valid && l != mesh.lods.end(); ++l) {
+        valid = l->count % 3 == 0 && (quint64)l->first + l->count <= hdr.lodIndexCount;
+    }
+    for(std::vector<GLuint>::const_iterator i = mesh.lodIndices.begin(); valid && i != mesh.lodIndices.end(); ++i) {
+        valid = *i < hdr.meshVertCount;
+    }
+    for(std::vector<OBJCluster>::const_iterator c = mesh.clusters.begin(); valid && c != mesh.clusters.end(); ++c) {
+        valid = c->first % 3 == 0 && c->count % 3 == 0 && (quint64)c->first + c->count <= hdr.meshIndexCount;
+    }
+    if(!valid) {
+        faces.clear();
+        mesh.clear();
+        verts.clear();
+        texs.clear();
+        norms.clear();
+    } else {
+        mesh.acmrBefore = hdr.acmrBefore;
+        mesh.acmrAfter = hdr.acmrAfter;
+        mesh.simplified = hdr.simplified != 0;
+        generatedNormals = hdr.generatedNormals != 0;
+        bounds = hdr.bounds;
+        if(!unpackChunks(p, p + hdr.chunkBytes, hdr, records)) records.clear();
+    }
+    return valid;
+}
+
+bool OBJCache::save(const OBJFaceArray &faces, const OBJMesh &mesh, const VertexVector &verts, const VertexVector &texs, const VertexVector &norms, const OBJBounds &bounds, bool generatedNormals, const std::vector<OBJChunkRecord> &records) {
+    QByteArray chunks = packChunks(records);
+
+    //the padding between the fields goes to disk as well, it must not carry stack contents
+    OBJCacheHeader hdr;
+    memset((void*)&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, cacheMagic, sizeof(cacheMagic));
+    hdr.version = OBJ_CACHE_VERSION;
+    hdr.sourceSize = sourceSize;
+    hdr.sourceTime = sourceTime;
+    hdr.sourceHash = sourceHash();
+    hdr.vertCount = verts.size();
+    hdr.texCount = texs.size();
+    hdr.normCount = norms.size();
+    hdr.cornerCount = faces.corners.size();
+    hdr.offsetCount = faces.offsets.size();
+    hdr.meshVertCount = mesh.vertices.size();
+    hdr.meshIndexCount = mesh.indices.size();
+    hdr.lodCount = mesh.lods.size();
+    hdr.lodIndexCount = mesh.lodIndices.size();
+    hdr.clusterCount = mesh.clusters.size();
+    hdr.chunkCount = records.size();
+    hdr.chunkBytes = chunks.size();
+    hdr.simplified = mesh.simplified;
+    hdr.generatedNormals = generatedNormals;
+    hdr.acmrBefore = mesh.acmrBefore;
+    hdr.acmrAfter = mesh.acmrAfter;
+    hdr.creaseAngle = generatedNormals ? creaseAngle : 0.0;
+    hdr.bounds = bounds;
+
+    //write aside and swap in, so that a concurrent reader never sees a partial cache
+    QString tmpPath = cachePath + ".tmp";
+    QFile fileOut(tmpPath);
+    if(!fileOut.open(QFile::WriteOnly | QFile::Truncate)) return false;
+    bool ok = fileOut.write((const char*)&hdr, sizeof(hdr)) == (qint64)sizeof(hdr);
+    ok = ok && writeArray(fileOut, verts);
+    ok = ok && writeArray(fileOut, texs);
+    ok = ok && writeArray(fileOut, norms);
+    ok = ok && writeArray(fileOut, faces.corners);
+    ok = ok && writeArray(fileOut, faces.offsets);
+    ok = ok && writeArray(fileOut, mesh.vertices);
+    ok = ok && writeArray(fileOut, mesh.indices);
+    ok = ok && writeArray(fileOut, mesh.lods);
+    ok = ok && writeArray(fileOut, mesh.lodIndices);
+    ok = ok && writeArray(fileOut, mesh.clusters);
+    ok = ok && fileOut.write(chunks.constData(), chunks.size()) == (qint64)chunks.size();
+    fileOut.close();
+    if(!ok) {
+        QFile::remove(tmpPath);
+        return false;
+    }
+    QFile::remove(cachePath);
+    return QFile::rename(tmpPath, cachePath);
+}
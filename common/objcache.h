@@ -0,0 +1,51 @@
+#ifndef OBJCACHE_H
+#define OBJCACHE_H
+
+#include "objmodel.h"
+
+#include <QString>
+
+#define OBJ_CACHE_VERSION 9
+
+// Binary snapshot of a parsed OBJ file, stored next to the source as "<file>.cache"
+// (or in the temp directory for resources and read-only locations).
+// The cache is valid while the source keeps its size and either its modification
+// time or its content hash, and while the normals it holds were generated the way the
+// loader would generate them now. The chunk records of the parse that wrote the cache go
+// along, so that the first reload after a cached start parses only the changed chunks.
+// Loading maps the cache file and copies the arrays out of the mapping into the model's
+// vectors, so the mapping is released as soon as the load returns.
+
+class OBJCache {
+public:
+    OBJCache(const QString &sourcePath, const char *sourceData, qint64 sourceSize);
+
+    // how the loader generates missing normals: a cache holding normals generated with another
+    // crease angle, or generated while none are wanted, is stale
+    void setNormalGeneration(bool enabled, double creaseAngle);
+
+    // generatedNormals tells whether the faces point at generated normals; records that don't
+    // fit the arrays are dropped without failing the load
+    bool load(OBJFaceArray &faces, OBJMesh &mesh, VertexVector &verts, VertexVector &texs, VertexVector &norms, OBJBounds &bounds, bool &generatedNormals, std::vector<OBJChunkRecord> &records);
+    bool save(const OBJFaceArray &faces, const OBJMesh &mesh, const VertexVector &verts, const VertexVector &texs, const VertexVector &norms, const OBJBounds &bounds, bool generatedNormals, const std::vector<OBJChunkRecord> &records);
+
+    QString fileName() const { return cachePath; }
+
+    static quint64 contentHash(const char *data, qint64 size);
+
+    // "<file>.<suffix>", or a file in the temp directory where that can't be written
+    static QString sidecarPath(const QString &sourcePath, const QString &suffix);
+
+private:
+    quint64 sourceHash();
+
+    QString sourcePath, cachePath;
+    const char *sourceData;
+    qint64 sourceSize, sourceTime;
+    quint64 hash;
+    bool hashed;
+    bool normalsEnabled;
+    double creaseAngle;
+};
+
+#endif // OBJCACHE_H
@@ -0,0 +1,122 @@
+#include "objclusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+void OBJClusterBuilder::build(OBJMesh &mesh, const VertexVector &verts) {
+    mesh.clusters.clear();
+    const std::vector<GLuint> &indices = mesh.indices;
+    mesh.clusters.reserve(indices.size() / (OBJ_CLUSTER_MAX_TRIANGLES * 3 / 2) + 1);
+
+    //vertices of the open cluster, found by a stamp per vertex instead of clearing a set
+    std::vector<size_t> stamps(mesh.vertices.size(), 0);
+    size_t stamp = 1, first = 0, vertexCount = 0;
+    double sx = 0.0, sy = 0.0, sz = 0.0;
+    for(size_t i = 0; i < indices.size(); i += 3) {
+        size_t added = 0;
+        for(int k = 0; k < 3; ++k) {
+            if(stamps[indices[i + k]] != stamp) ++added;
+        }
+        //past the minimum size, a triangle turned too far from the cluster starts the next one
+        double nx, ny, nz;
+        normal(mesh, verts, i, nx, ny, nz);
+        double sl = sqrt(sx * sx + sy * sy + sz * sz);
+        bool turned = i - first >= OBJ_CLUSTER_MIN_TRIANGLES * 3 && sl > 0.0 && (nx * sx + ny * sy + nz * sz) < OBJ_CLUSTER_MIN_COS * sl;
+        if(i > first && (turned || vertexCount + added > OBJ_CLUSTER_MAX_VERTICES || i - first == OBJ_CLUSTER_MAX_TRIANGLES * 3)) {
+            mesh.clusters.push_back(bounds(mesh, verts, first, i - first));
+            first = i;
+            vertexCount = 0;
+            sx = sy = sz = 0.0;
+            ++stamp;
+        }
+        sx += nx;
+        sy += ny;
+        sz += nz;
+        for(int k = 0; k < 3; ++k) {
+            if(stamps[indices[i + k]] != stamp) {
+                stamps[indices[i + k]] = stamp;
+                ++vertexCount;
+            }
+        }
+    }
+    if(first < indices.size()) mesh.clusters.push_back(bounds(mesh, verts, first, indices.size() - first));
+}
+
+bool OBJClusterBuilder::backfacing(const OBJCluster &cluster, const OBJVec3 &eye) {
+    double dx = (double)cluster.center.x - eye.x;
+    double dy = (double)cluster.center.y - eye.y;
+    double dz = (double)cluster.center.z - eye.z;
+    double along = dx * cluster.coneAxis.x + dy * cluster.coneAxis.y + dz * cluster.coneAxis.z;
+    return along >= cluster.coneCutoff * sqrt(dx * dx + dy * dy + dz * dz) + cluster.radius;
+}
+
+bool OBJClusterBuilder::normal(const OBJMesh &mesh, const VertexVector &verts, size_t first, double &x, double &y, double &z) {
+    const OBJVec3 &a = verts[mesh.vertices[mesh.indices[first]].v - 1];
+    const OBJVec3 &b = verts[mesh.vertices[mesh.indices[first + 1]].v - 1];
+    const OBJVec3 &c = verts[mesh.vertices[mesh.indices[first + 2]].v - 1];
+    double ux = (double)b.x - a.x, uy = (double)b.y - a.y, uz = (double)b.z - a.z;
+    double vx = (double)c.x - a.x, vy = (double)c.y - a.y, vz = (double)c.z - a.z;
+    x = uy * vz - uz * vy;
+    y = uz * vx - ux * vz;
+    z = ux * vy - uy * vx;
+    double len = sqrt(x * x + y * y + z * z);
+    if(len == 0.0) return false;
+    x /= len;
+    y /= len;
+    z /= len;
+    return true;
+}
+
+OBJCluster OBJClusterBuilder::bounds(const OBJMesh &mesh, const VertexVector &verts, size_t first, size_t count) {
+    OBJCluster cluster;
+    cluster.first = (GLuint)first;
+    cluster.count = (GLuint)count;
+
+    //sphere around the box of the vertices, cone axis along the mean of the unit triangle normals
+    OBJBounds box;
+    std::vector<OBJVec3> normals;
+    normals.reserve(count / 3);
+    double ax = 0.0, ay = 0.0, az = 0.0;
+    for(size_t i = first; i < first + count; i += 3) {
+        const OBJVec3 &a = verts[mesh.vertices[mesh.indices[i]].v - 1];
+        const OBJVec3 &b = verts[mesh.vertices[mesh.indices[i + 1]].v - 1];
+        const OBJVec3 &c = verts[mesh.vertices[mesh.indices[i + 2]].v - 1];
+        box.add(a);
+        box.add(b);
+        box.add(c);
+
+        double nx, ny, nz;
+        if(!normal(mesh, verts, i, nx, ny, nz)) continue;
+        OBJVec3 n;
+        n.x = (GLfloat)nx;
+        n.y = (GLfloat)ny;
+        n.z = (GLfloat)nz;
+        normals.push_back(n);
+        ax += n.x;
+        ay += n.y;
+        az += n.z;
+    }
+
+    cluster.center = box.center();
+    double r2 = 0.0;
+    for(size_t i = first; i < first + count; ++i) {
+        const OBJVec3 &v = verts[mesh.vertices[mesh.indices[i]].v - 1];
+        double dx = (double)v.x - cluster.center.x, dy = (double)v.y - cluster.center.y, dz = (double)v.z - cluster.center.z;
+        r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+    }
+    cluster.radius = (GLfloat)sqrt(r2);
+
+    double len = sqrt(ax * ax + ay * ay + az * az);
+    cluster.coneAxis = OBJVec3();
+    cluster.coneCutoff = 1.0f;
+    if(len == 0.0) return cluster;
+    cluster.coneAxis.x = (GLfloat)(ax / len);
+    cluster.coneAxis.y = (GLfloat)(ay / len);
+    cluster.coneAxis.z = (GLfloat)(az / len);
+    double minDot = 1.0;
+    for(std::vector<OBJVec3>::const_iterator n = normals.begin(); n != normals.end(); ++n) {
+        minDot = std::min(minDot, (double)n->x * cluster.coneAxis.x + (double)n->y * cluster.coneAxis.y + (double)n->z * cluster.coneAxis.z);
+    }
+    if(minDot > 0.0) cluster.coneCutoff = (GLfloat)sqrt(1.0 - minDot * minDot);
+    return cluster;
+}
@@ -0,0 +1,33 @@
+#ifndef OBJCLUSTERS_H
+#define OBJCLUSTERS_H
+
+#include "objmodel.h"
+
+#define OBJ_CLUSTER_MAX_VERTICES 64
+#define OBJ_CLUSTER_MAX_TRIANGLES 128
+#define OBJ_CLUSTER_MIN_TRIANGLES 32
+#define OBJ_CLUSTER_MIN_COS 0.5
+
+// Splits the triangle list of a mesh into clusters of consecutive triangles, each closed when
+// one more triangle would take it past OBJ_CLUSTER_MAX_VERTICES distinct vertices or
+// OBJ_CLUSTER_MAX_TRIANGLES triangles, or once it holds OBJ_CLUSTER_MIN_TRIANGLES when the next
+// triangle turns more than acos(OBJ_CLUSTER_MIN_COS) from its mean normal. After OBJOptimizer neighbouring triangles follow each
+// other, so the clusters come out compact without reordering the list; the loader runs the
+// optimizer whenever it builds clusters.
+// The normal cone follows meshoptimizer's meshlet bounds: seen from eye, all triangles of
+// a cluster face away when dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius.
+// A cluster whose normals spread over more than a half space gets coneCutoff 1 and never passes.
+
+class OBJClusterBuilder {
+public:
+    static void build(OBJMesh &mesh, const VertexVector &verts);
+
+    // counter-clockwise triangles are the front faces
+    static bool backfacing(const OBJCluster &cluster, const OBJVec3 &eye);
+
+private:
+    static bool normal(const OBJMesh &mesh, const VertexVector &verts, size_t first, double &x, double &y, double &z);
+    static OBJCluster bounds(const OBJMesh &mesh, const VertexVector &verts, size_t first, size_t count);
+};
+
+#endif // OBJCLUSTERS_H
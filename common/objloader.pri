@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# OBJ loader shared by the tasks and tools/objbench, it makes no GL calls
+#
+#-------------------------------------------------
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/objmodel.cpp \
+    $$PWD/objcache.cpp \
+    $$PWD/objoptimizer.cpp \
+    $$PWD/objclusters.cpp \
+    $$PWD/objbvh.cpp \
+    $$PWD/objtriangulator.cpp \
+    $$PWD/objnormals.cpp \
+    $$PWD/objsimplifier.cpp
+
+HEADERS += \
+    $$PWD/objmodel.h \
+    $$PWD/objcache.h \
+    $$PWD/objoptimizer.h \
+    $$PWD/objclusters.h \
+    $$PWD/objbvh.h \
+    $$PWD/objtriangulator.h \
+    $$PWD/objnormals.h \
+    $$PWD/objsimplifier.h \
+    $$PWD/objtokenizer.h
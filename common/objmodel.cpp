@@ -0,0 +1,1024 @@
+#include "objmodel.h"
+#include "objcache.h"
+#include "objoptimizer.h"
+#include "objsimplifier.h"
+#include "objnormals.h"
+#include "objclusters.h"
+#include "objbvh.h"
+#include "objtriangulator.h"
+#include "objtokenizer.h"
+
+#include <QFile>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+
+#define MIN_CHUNK_SIZE (1 << 20)
+#define MAX_INDEX 0xffffffffu
+#define EMPTY_SLOT 0xffffffffu
+#define PROGRESS_INTERVAL 50
+#define RELOAD_DELAY 300
+#define STREAM_BATCH_SIZE (1 << 16)
+
+#define FDM_VTN 1
+#define FDM_VT  2
+#define FDM_VN  3
+#define FDM_V   4
+
+//----------------------------------------------------------------------------------------
+
+static double lap(QElapsedTimer &timer) {
+    double ms = timer.nsecsElapsed() / 1e6;
+    timer.restart();
+    return ms;
+}
+
+//----------------------------------------------------------------------------------------
+
+// Part of the file parsed by one worker. Absolute face indices may refer to previous chunks,
+// so they are validated after the merge; relative ones are rebased on the chunk offsets.
+struct OBJChunk {
+    OBJChunk() : begin(0), end(0), done(0), lines(0), hash(0), hashed(false), errorLine(0), firstLine(0), vertBase(0), texBase(0), normBase(0), faceBase(0), cornerBase(0) {}
+
+    const char *begin, *end;
+    QAtomicInt done;
+    size_t lines;
+    quint64 hash;
+    bool hashed;                                            // hash the bytes once they're parsed
+
+    VertexVector verts, texs, norms;
+    OBJBounds bounds;
+    OBJFaceArray faces;
+    std::vector<std::pair<size_t, size_t> > relativeRefs;     // corner * 3 + component, line
+    std::vector<std::pair<size_t, QString> > warnings;
+    OBJIndexExcess vertExcess, texExcess, normExcess;
+
+    QString error;
+    size_t errorLine;
+
+    size_t firstLine, vertBase, texBase, normBase, faceBase, cornerBase;
+};
+
+class OBJChunkTask : public QRunnable {
+public:
+    enum Stage { Parse, Merge };
+
+    OBJChunkTask(Stage stage, OBJChunk &chunk, const volatile bool *stop, QAtomicInt *parsedKB, QSemaphore *finished, OBJModelLoadingThread *target = 0);
+    void run();
+
+private:
+    void parse();
+    void merge();
+    void setError(const char *error);
+    bool matchFaceDescr(const char *&p, const char *end, size_t &method, FaceIndex &out, size_t corner);
+    bool parseFaceIndex(const char *&p, const char *end, GLuint &out, size_t parsed, OBJIndexExcess &excess, size_t ref);
+
+    Stage stage;
+    OBJChunk &chunk;
+    const volatile bool *stop;
+    QAtomicInt *parsedKB;
+    QSemaphore *finished;
+    OBJModelLoadingThread *target;
+};
+
+/**************************************************************************************/
+
+void OBJFaceArray::addFace(const FaceIndex *c, size_t count) {
+    if(count != 3 && offsets.empty()) {
+        //first non-triangle face, describe the triangles stored so far
+        size_t fc = corners.size() / 3;
+        offsets.reserve(fc + 2);
+        for(size_t i = 0; i < fc; ++i) offsets.push_back((GLuint)(i * 3));
+        offsets.push_back((GLuint)corners.size());
+    }
+    corners.insert(corners.end(), c, c + count);
+    if(!offsets.empty()) offsets.push_back((GLuint)corners.size());
+}
+
+void OBJFaceArray::clear() {
+    corners.clear();
+    offsets.clear();
+}
+
+void OBJFaceArray::swap(OBJFaceArray &other) {
+    corners.swap(other.corners);
+    offsets.swap(other.offsets);
+}
+
+void OBJMesh::clear() {
+    vertices.clear();
+    indices.clear();
+    acmrBefore = acmrAfter = 0.0;
+    lods.clear();
+    lodIndices.clear();
+    simplified = false;
+    clusters.clear();
+    bvh.clear();
+    bvhTriangles.clear();
+}
+
+void OBJMesh::swap(OBJMesh &other) {
+    vertices.swap(other.vertices);
+    indices.swap(other.indices);
+    std::swap(acmrBefore, other.acmrBefore);
+    std::swap(acmrAfter, other.acmrAfter);
+    lods.swap(other.lods);
+    lodIndices.swap(other.lodIndices);
+    std::swap(simplified, other.simplified);
+    clusters.swap(other.clusters);
+    bvh.swap(other.bvh);
+    bvhTriangles.swap(other.bvhTriangles);
+}
+
+int OBJMesh::selectLod(GLfloat maxError) const {
+    int level = -1;
+    while(level + 1 < (int)lods.size() && lods[level + 1].error <= maxError) ++level;
+    return level;
+}
+
+void OBJBounds::clear() {
+    min.x = min.y = min.z = FLT_MAX;
+    max.x = max.y = max.z = -FLT_MAX;
+    sumX = sumY = sumZ = 0.0;
+    count = 0;
+}
+
+void OBJBounds::add(const OBJBounds &other) {
+    min.x = qMin(min.x, other.min.x);
+    min.y = qMin(min.y, other.min.y);
+    min.z = qMin(min.z, other.min.z);
+    max.x = qMax(max.x, other.max.x);
+    max.y = qMax(max.y, other.max.y);
+    max.z = qMax(max.z, other.max.z);
+    sumX += other.sumX;
+    sumY += other.sumY;
+    sumZ += other.sumZ;
+    count += other.count;
+}
+
+void OBJBounds::translate(const OBJVec3 &offset) {
+    if(empty()) return;
+    min += offset;
+    max += offset;
+    sumX += (double)offset.x * count;
+    sumY += (double)offset.y * count;
+    sumZ += (double)offset.z * count;
+}
+
+OBJVec3 OBJBounds::centroid() const {
+    OBJVec3 c;
+    if(empty()) return c;
+    c.x = (GLfloat)(sumX / count);
+    c.y = (GLfloat)(sumY / count);
+    c.z = (GLfloat)(sumZ / count);
+    return c;
+}
+
+OBJVec3 OBJBounds::center() const {
+    OBJVec3 c;
+    if(empty()) return c;
+    c.x = (min.x + max.x) / 2;
+    c.y = (min.y + max.y) / 2;
+    c.z = (min.z + max.z) / 2;
+    return c;
+}
+
+GLfloat OBJBounds::radius() const {
+    if(empty()) return 0;
+    OBJVec3 d = max;
+    d -= min;
+    return sqrt(d.x * d.x + d.y * d.y + d.z * d.z) / 2;
+}
+
+void OBJLoadStats::clear() {
+    bytes = 0;
+    lines = 0;
+    reusedBytes = 0;
+    fromCache = false;
+    acmrBefore = acmrAfter = 0.0;
+    lodLevels = clusterCount = bvhNodes = 0;
+    generatedNormals = 0;
+    polygons = 0;
+    readTime = tokenizeTime = validateTime = triangulateTime = meshTime = normalTime = optimizeTime = lodTime = clusterTime = bvhTime = cacheTime = textureTime = totalTime = 0.0;
+}
+
+QString OBJLoadStats::toString() const {
+    QString res = QString("%1 MB, %2 lines in %3 ms (%4 MB/s, %5 Mlines/s%6): read %7, tokenize %8, validate %9, mesh %10, optimize %11, cache %12, texture %13")
+            .arg(bytes / 1048576.0, 0, 'f', 1).arg(lines).arg(totalTime, 0, 'f', 1)
+            .arg(bytesPerSecond() / 1048576.0, 0, 'f', 1).arg(linesPerSecond() / 1e6, 0, 'f', 2).arg(fromCache ? ", cached" : "")
+            .arg(readTime, 0, 'f', 1).arg(tokenizeTime, 0, 'f', 1).arg(validateTime, 0, 'f', 1)
+            .arg(meshTime, 0, 'f', 1).arg(optimizeTime, 0, 'f', 1).arg(cacheTime, 0, 'f', 1).arg(textureTime, 0, 'f', 1);
+    if(reusedBytes > 0) res += QString(", %1 MB of the last parse reused").arg(reusedBytes / 1048576.0, 0, 'f', 1);
+    if(acmrAfter > 0.0) res += QString(", ACMR %1 -> %2").arg(acmrBefore, 0, 'f', 3).arg(acmrAfter, 0, 'f', 3);
+    if(polygons > 0) res += QString(", %1 polygons triangulated in %2 ms").arg(polygons).arg(triangulateTime, 0, 'f', 1);
+    if(generatedNormals > 0) res += QString(", %1 normals generated in %2 ms").arg(generatedNormals).arg(normalTime, 0, 'f', 1);
+    if(lodLevels > 0) res += QString(", %1 LODs in %2 ms").arg(lodLevels).arg(lodTime, 0, 'f', 1);
+    if(clusterCount > 0) res += QString(", %1 clusters in %2 ms").arg(clusterCount).arg(clusterTime, 0, 'f', 1);
+    if(bvhNodes > 0) res += QString(", BVH of %1 nodes in %2 ms").arg(bvhNodes).arg(bvhTime, 0, 'f', 1);
+    return res;
+}
+
+bool OBJStreamQueue::push(OBJStreamBatch *batch) {
+    int t = tail.fetchAndAddRelaxed(0);
+    int next = (t + 1) % Capacity;
+    if(next == head.fetchAndAddAcquire(0)) return false;
+    ring[t] = batch;
+    tail.fetchAndStoreRelease(next);
+    return true;
+}
+
+OBJStreamBatch *OBJStreamQueue::pop() {
+    int h = head.fetchAndAddRelaxed(0);
+    if(h == tail.fetchAndAddAcquire(0)) return 0;
+    OBJStreamBatch *batch = ring[h];
+    head.fetchAndStoreRelease((h + 1) % Capacity);
+    return batch;
+}
+
+void OBJStreamQueue::clear() {
+    for(OBJStreamBatch *batch = pop(); batch; batch = pop()) delete batch;
+}
+
+/**************************************************************************************/
+
+OBJModel::OBJModel(QObject *parent) : QObject(parent), watchEnabled(false), streamingEnabled(false), reloading(false) {
+    loader = new OBJModelLoadingThread(faces, verts, texs, norms, this);
+    connect(loader, SIGNAL(loadProgress(int)), this, SLOT(progressSignal(int)));
+    connect(loader, SIGNAL(streamUpdated()), this, SLOT(streamSignal()));
+    connect(loader, SIGNAL(finished()), this, SLOT(loadingFinished()));
+
+    //exporters write a file in several steps, the reload waits until it has been quiet for a moment
+    watcher = new QFileSystemWatcher(this);
+    reloadTimer = new QTimer(this);
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(RELOAD_DELAY);
+    connect(watcher, SIGNAL(fileChanged(QString)), this, SLOT(fileChanged()));
+    connect(reloadTimer, SIGNAL(timeout()), this, SLOT(reloadModel()));
+}
+
+void OBJModel::loadModel(const QString &filePath, const QString &texPath) {
+    loader->setFileName(filePath, texPath);
+    loader->streamQueue = streamingEnabled ? &streamQueue : 0;
+    reloading = false;
+    watchFile();
+    loader->start();
+}
+
+void OBJModel::setWatchEnabled(bool enabled) {
+    watchEnabled = enabled;
+    loader->reuseEnabled = enabled;
+    if(!enabled) loader->forgetChunks();
+    watchFile();
+}
+
+//a file replaced on save drops out of the watcher, so it's added again on every load
+void OBJModel::watchFile() {
+    if(!watcher->files().isEmpty()) watcher->removePaths(watcher->files());
+    QString path = loader->fileName();
+    if(watchEnabled && !path.isEmpty() && !path.startsWith(":") && QFile::exists(path)) watcher->addPath(path);
+}
+
+void OBJModel::fileChanged() {
+    reloadTimer->start();
+}
+
+void OBJModel::reloadModel() {
+    if(loader->isRunning() || !QFile::exists(loader->fileName())) {
+        reloadTimer->start();
+        return;
+    }
+    //no viewer drains the queue during a reload
+    loader->streamQueue = 0;
+    reloading = true;
+    watchFile();
+    loader->start();
+}
+
+void OBJModel::stopLoading() {
+    loader->stopThread = true;
+}
+
+void OBJModel::progressSignal(int val) {
+    emit loadProgress(val);
+}
+
+void OBJModel::streamSignal() {
+    emit streamUpdated();
+}
+
+//the arrays change hands here on the GUI thread, the renderers never see them half filled
+void OBJModel::loadingFinished() {
+    loader->takeResult(faces, mesh, verts, texs, norms, bounds, texture);
+    massCenter = bounds.centroid();
+    emit loadStatus(loader->modelStatus);
+}
+
+void OBJModel::moveToMassCenter() {
+    //one flat sweep over the coordinates, which the compiler can vectorize
+    const GLfloat ox = massCenter.x, oy = massCenter.y, oz = massCenter.z;
+    GLfloat *p = verts.empty() ? 0 : &verts[0].x;
+    GLfloat *end = p + verts.size() * 3;
+    for(; p != end; p += 3) {
+        p[0] -= ox;
+        p[1] -= oy;
+        p[2] -= oz;
+    }
+
+    OBJVec3 shift;
+    shift -= massCenter;
+    bounds.translate(shift);
+    loader->forgetChunks();
+    for(std::vector<OBJBvhNode>::iterator n = mesh.bvh.begin(); n != mesh.bvh.end(); ++n) {
+        n->min += shift;
+        n->max += shift;
+    }
+    massCenter = OBJVec3();
+}
+
+//swapped with empty containers, clear() would keep the memory
+void OBJModel::releaseGeometry() {
+    OBJFaceArray noFaces;
+    faces.swap(noFaces);
+    std::vector<FaceIndex>().swap(mesh.vertices);
+    std::vector<GLuint>().swap(mesh.indices);
+    std::vector<GLuint>().swap(mesh.lodIndices);
+    std::vector<OBJBvhNode>().swap(mesh.bvh);
+    std::vector<GLuint>().swap(mesh.bvhTriangles);
+    VertexVector().swap(verts);
+    VertexVector().swap(texs);
+    VertexVector().swap(norms);
+    texture = QImage();
+    loader->forgetChunks();
+}
+
+/**************************************************************************************/
+
+OBJModelLoadingThread::OBJModelLoadingThread(const OBJFaceArray &f, const VertexVector &v, const VertexVector &t, const VertexVector &n, QObject *parent)
+    : QThread(parent), modelStatus(false), cacheEnabled(true), optimizeEnabled(false), lodEnabled(false), normalsEnabled(false), creaseAngle(OBJ_NORMAL_CREASE_ANGLE), clustersEnabled(false), bvhEnabled(false), reuseEnabled(false), stopThread(false), modelError(""), streamQueue(0), filePath(""), texPath(""), lastFaces(f), lastVerts(v), lastTexs(t), lastNorms(n) {
+}
+
+void OBJModelLoadingThread::setFileName(const QString &fp, const QString &tp) {
+    filePath = fp;
+    texPath = tp;
+}
+
+void OBJModelLoadingThread::forgetChunks() {
+    std::vector<OBJChunkRecord>().swap(records);
+}
+
+//a failed load keeps the model as it was, the chunks of its parse describe nothing that is kept
+void OBJModelLoadingThread::takeResult(OBJFaceArray &f, OBJMesh &m, VertexVector &v, VertexVector &t, VertexVector &n, OBJBounds &b, QImage &img) {
+    if(modelStatus) {
+        f.swap(faces);
+        m.swap(mesh);
+        v.swap(verts);
+        t.swap(texs);
+        n.swap(norms);
+        std::swap(b, bounds);
+        img = tex;
+    } else {
+        forgetChunks();
+    }
+    OBJFaceArray().swap(faces);
+    OBJMesh().swap(mesh);
+    VertexVector().swap(verts);
+    VertexVector().swap(texs);
+    VertexVector().swap(norms);
+    bounds.clear();
+    tex = QImage();
+}
+
+void OBJModelLoadingThread::run() {
+    stopThread = false;
+    modelError = "";
+    stats.clear();
+    QElapsedTimer timer;
+    timer.start();
+    modelStatus = load();
+    stats.totalTime = lap(timer);
+}
+
+bool OBJModelLoadingThread::load() {
+    QElapsedTimer timer;
+    timer.start();
+    QFile fileIn(filePath);
+    if(!fileIn.open(QFile::ReadOnly)) {
+        modelError = "unable to open model file";
+        return false;
+    }
+
+    //what the last parse left stays with the model, the chunks worth reusing are copied out of it
+    faces.clear();
+    mesh.clear();
+    verts.clear();
+    texs.clear();
+    norms.clear();
+    bounds.clear();
+
+    emit loadProgress(0);
+
+    //map the file and tokenize raw bytes in place; compressed resources can't be mapped, so read them
+    qint64 fileSize = fileIn.size();
+    QByteArray fileData;
+    const char *data = fileSize > 0 ? (const char*)fileIn.map(0, fileSize) : 0;
+    if(!data) {
+        fileData = fileIn.readAll();
+        data = fileData.constData();
+        fileSize = fileData.size();
+    }
+    stats.bytes = fileSize;
+    stats.readTime = lap(timer);
+
+    //a valid binary cache replaces parsing, a fresh parse refreshes the cache
+    OBJCache cache(filePath, data, fileSize);
+    cache.setNormalGeneration(normalsEnabled, creaseAngle);
+    bool generatedNormals = false;
+    std::vector<OBJChunkRecord> cachedRecords;
+    bool parsed = stats.fromCache = cacheEnabled && cache.load(faces, mesh, verts, texs, norms, bounds, generatedNormals, cachedRecords);
+    bool modified = false;
+    stats.cacheTime = lap(timer);
+    bool rebuild = !parsed;
+    if(!parsed) {
+        parsed = modified = parse(data, fileSize);
+        if(!parsed) forgetChunks();
+        timer.restart();
+    } else if(reuseEnabled) {
+        //the chunk table of the parse that wrote the cache lets the next reload skip unchanged chunks
+        records.swap(cachedRecords);
+    } else {
+        forgetChunks();
+    }
+    //normals are generated on the faces, so a cache written without them needs a fresh mesh as well
+    if(parsed && normalsEnabled && OBJNormalGenerator::missing(faces)) {
+        forgetChunks();
+        stats.generatedNormals = OBJNormalGenerator::generate(faces, verts, norms, creaseAngle);
+        stats.normalTime = lap(timer);
+        rebuild = modified = generatedNormals = true;
+    }
+    if(parsed && rebuild) {
+        std::vector<GLuint> triangles;
+        if(!faces.triangles()) {
+            stats.polygons = OBJTriangulator::triangulate(faces, verts, triangles);
+            stats.triangulateTime = lap(timer);
+        }
+        buildMesh(triangles);
+        stats.meshTime = lap(timer);
+    }
+    //the reordered mesh is cached, so the optimizer runs once per source file;
+    //clusters are cut from its order, in the order of the file they would come out loose
+    if(parsed && (optimizeEnabled || clustersEnabled) && !mesh.optimized()) {
+        //a cache written without the optimizer may carry levels and clusters of the old order
+        mesh.lods.clear();
+        mesh.lodIndices.clear();
+        mesh.simplified = false;
+        mesh.clusters.clear();
+        OBJOptimizer::optimize(mesh, verts);
+        stats.optimizeTime = lap(timer);
+        modified = true;
+    }
+    //levels refer to the final vertex order, so they are built after the optimizer and cached along
+    if(parsed && lodEnabled && !mesh.simplified) {
+        OBJSimplifier::buildLods(mesh, verts);
+        stats.lodTime = lap(timer);
+        modified = true;
+    }
+    //clusters are runs of the final triangle order
+    if(parsed && clustersEnabled && mesh.clusters.empty() && !mesh.indices.empty()) {
+        OBJClusterBuilder::build(mesh, verts);
+        stats.clusterTime = lap(timer);
+        modified = true;
+    }
+    //the hierarchy is quick to build and left out of the cache
+    if(parsed && bvhEnabled && !mesh.indices.empty()) {
+        OBJBvh::build(mesh, verts);
+        stats.bvhTime = lap(timer);
+    }
+    stats.acmrBefore = mesh.acmrBefore;
+    stats.acmrAfter = mesh.acmrAfter;
+    stats.lodLevels = (int)mesh.lods.size();
+    stats.clusterCount = (int)mesh.clusters.size();
+    stats.bvhNodes = (int)mesh.bvh.size();
+    if(modified && cacheEnabled) {
+        timer.restart();
+        cache.save(faces, mesh, verts, texs, norms, bounds, generatedNormals, records);
+        stats.cacheTime += lap(timer);
+    }
+    fileIn.close();
+    if(!parsed) return false;
+
+    if(!texPath.isEmpty()) {
+        tex = QImage(texPath).convertToFormat(QImage::Format_RGB888);
+        stats.textureTime = lap(timer);
+        if(tex.isNull()) {
+            modelError += QString("Unable to load texture");
+            return false;
+        }
+    }
+    emit loadProgress(100);
+    return true;
+}
+
+bool OBJModelLoadingThread::parse(const char *data, qint64 size) {
+    QElapsedTimer timer;
+    timer.start();
+    //the chunks of the last parse still found at the start and the end of the file are taken as they are
+    size_t headCount = 0, tailCount = 0;
+    qint64 reused = 0;
+    if(reuseEnabled && !records.empty()) reused = stats.reusedBytes = reuseChunks(data, size, headCount, tailCount);
+    const char *from = data, *end = data + size;
+    for(size_t i = 0; i < headCount; ++i) from += records[i].size;
+    for(size_t i = 0; i < tailCount; ++i) end -= records[records.size() - 1 - i].size;
+    qint64 middle = end - from;
+
+    //split the rest at line boundaries, so that every worker gets a few chunks to balance the load
+    size_t chunkCount = middle > 0 || headCount + tailCount == 0 ? qMax<qint64>(1, qMin<qint64>(QThread::idealThreadCount() * 4, middle / MIN_CHUNK_SIZE)) : 0;
+    std::vector<OBJChunk> chunks(headCount + chunkCount + tailCount);
+    const char *p = data;
+    for(size_t i = 0; i < headCount; ++i) {
+        reuseChunk(records[i], p, chunks[i]);
+        p += records[i].size;
+    }
+    p = end;
+    for(size_t i = records.size() - tailCount; i < records.size(); ++i) {
+        reuseChunk(records[i], p, chunks[headCount + chunkCount + i - (records.size() - tailCount)]);
+        p += records[i].size;
+    }
+    p = from;
+    for(size_t i = 0; i < chunkCount; ++i) {
+        OBJChunk &c = chunks[headCount + i];
+        c.begin = p;
+        p = i + 1 == chunkCount ? end : skipLine(from + middle * (qint64)(i + 1) / (qint64)chunkCount - 1, end);
+        if(p < c.begin) p = c.begin;
+        c.end = p;
+        c.hashed = reuseEnabled;
+    }
+
+    QAtomicInt parsedKB((int)(reused >> 10));
+    QSemaphore finished(0);
+    QThreadPool *pool = QThreadPool::globalInstance();
+    for(size_t i = 0; i < chunkCount; ++i) {
+        pool->start(new OBJChunkTask(OBJChunkTask::Parse, chunks[headCount + i], &stopThread, &parsedKB, &finished));
+    }
+
+    int lastProgress = 0;
+    size_t streamed = 0;
+    std::deque<OBJStreamBatch*> pending;
+    while(!finished.tryAcquire((int)chunkCount, PROGRESS_INTERVAL)) {
+        int lp = qMin<qint64>(99, 100 * ((qint64)parsedKB.fetchAndAddRelaxed(0) << 10) / qMax<qint64>(size, 1));
+        if(lp != lastProgress) {
+            lastProgress = lp;
+            emit loadProgress(lp);
+        }
+        if(streamQueue) streamChunks(chunks, streamed, pending);
+    }
+    if(streamQueue) streamChunks(chunks, streamed, pending);
+    for(std::deque<OBJStreamBatch*>::iterator b = pending.begin(); b != pending.end(); ++b) delete *b;
+    stats.tokenizeTime = lap(timer);
+    if(stopThread) return false;
+
+    for(std::vector<OBJChunk>::const_iterator c = chunks.begin(); c != chunks.end(); ++c) stats.lines += c->lines;
+    bool merged = mergeChunks(chunks);
+    stats.validateTime = lap(timer);
+    return merged;
+}
+
+//records matched by their hashes from the start of the file and then from its end, returns the bytes they cover
+qint64 OBJModelLoadingThread::reuseChunks(const char *data, qint64 size, size_t &headCount, size_t &tailCount) {
+    const char *from = data, *to = data + size;
+    headCount = tailCount = 0;
+    for(; headCount < records.size(); ++headCount) {
+        const OBJChunkRecord &r = records[headCount];
+        //a chunk without its line break may continue on the next line now
+        if(r.size > to - from || (from + r.size != to && from[r.size - 1] != '\n')) break;
+        if(OBJCache::contentHash(from, r.size) != r.hash) break;
+        from += r.size;
+    }
+    for(; headCount + tailCount < records.size(); ++tailCount) {
+        const OBJChunkRecord &r = records[records.size() - 1 - tailCount];
+        if(r.size > to - from || (to - r.size != data && to[-r.size - 1] != '\n')) break;
+        if(OBJCache::contentHash(to - r.size, r.size) != r.hash) break;
+        to -= r.size;
+    }
+    return (from - data) + (data + size - to);
+}
+
+//the elements go back to chunk-local form, so that the merge can place them anywhere
+void OBJModelLoadingThread::reuseChunk(const OBJChunkRecord &r, const char *begin, OBJChunk &c) {
+    c.begin = begin;
+    c.end = begin + r.size;
+    c.lines = r.lines;
+    c.hash = r.hash;
+    c.verts.assign(lastVerts.begin() + r.vertBase, lastVerts.begin() + r.vertBase + r.vertCount);
+    c.texs.assign(lastTexs.begin() + r.texBase, lastTexs.begin() + r.texBase + r.texCount);
+    c.norms.assign(lastNorms.begin() + r.normBase, lastNorms.begin() + r.normBase + r.normCount);
+    c.faces.corners.assign(lastFaces.corners.begin() + r.cornerBase, lastFaces.corners.begin() + r.cornerBase + r.cornerCount);
+    if(!r.triangles) {
+        c.faces.offsets.resize(r.faceCount + 1);
+        for(size_t f = 0; f <= r.faceCount; ++f) c.faces.offsets[f] = (GLuint)(lastFaces.offsets[r.faceBase + f] - r.cornerBase);
+    }
+    const size_t bases[3] = { r.vertBase, r.texBase, r.normBase };
+    for(std::vector<std::pair<size_t, size_t> >::const_iterator ref = r.relativeRefs.begin(); ref != r.relativeRefs.end(); ++ref) {
+        FaceIndex &i = c.faces.corners[ref->first / 3];
+        GLuint &idx = ref->first % 3 == 0 ? i.v : (ref->first % 3 == 1 ? i.t : i.n);
+        idx = (GLuint)(idx - bases[ref->first % 3]);
+    }
+    c.relativeRefs = r.relativeRefs;
+    c.warnings = r.warnings;
+    c.bounds = r.bounds;
+    c.vertExcess = r.vertExcess;
+    c.texExcess = r.texExcess;
+    c.normExcess = r.normExcess;
+    c.done.fetchAndStoreRelease(1);
+}
+
+bool OBJModelLoadingThread::mergeChunks(std::vector<OBJChunk> &chunks) {
+    //prefix sums give every chunk its place in the merged arrays
+    size_t vc = 0, tc = 0, nc = 0, fc = 0, cc = 0, lc = 1;
+    bool triangles = true;
+    std::vector<OBJChunkRecord> fresh;
+    for(std::vector<OBJChunk>::iterator c = chunks.begin(); c != chunks.end(); ++c) {
+        if(!c->error.isEmpty()) {
+            modelError += c->error.arg(lc + c->errorLine);
+            return false;
+        }
+        if(c->vertExcess.amount > vc || c->texExcess.amount > tc || c->normExcess.amount > nc) {
+            size_t line = c->vertExcess.amount > vc ? c->vertExcess.line : (c->texExcess.amount > tc ? c->texExcess.line : c->normExcess.line);
+            modelError = QString("index out of bound at line %1\n").arg(lc + line);
+            return false;
+        }
+        c->firstLine = lc;
+        c->vertBase = vc;
+        c->texBase = tc;
+        c->normBase = nc;
+        c->faceBase = fc;
+        c->cornerBase = cc;
+        if(reuseEnabled) {
+            fresh.push_back(OBJChunkRecord());
+            OBJChunkRecord &r = fresh.back();
+            r.hash = c->hash;
+            r.size = c->end - c->begin;
+            r.lines = c->lines;
+            r.vertBase = vc;
+            r.texBase = tc;
+            r.normBase = nc;
+            r.faceBase = fc;
+            r.cornerBase = cc;
+            r.vertCount = c->verts.size();
+            r.texCount = c->texs.size();
+            r.normCount = c->norms.size();
+            r.faceCount = c->faces.size();
+            r.cornerCount = c->faces.corners.size();
+            r.triangles = c->faces.triangles();
+            r.bounds = c->bounds;
+            r.relativeRefs = c->relativeRefs;
+            r.warnings = c->warnings;
+            r.vertExcess = c->vertExcess;
+            r.texExcess = c->texExcess;
+            r.normExcess = c->normExcess;
+        }
+        vc += c->verts.size();
+        tc += c->texs.size();
+        nc += c->norms.size();
+        fc += c->faces.size();
+        cc += c->faces.corners.size();
+        lc += c->lines;
+        triangles = triangles && c->faces.triangles();
+        bounds.add(c->bounds);
+    }
+    if(cc > MAX_INDEX) {
+        modelError = "model is too large";
+        return false;
+    }
+
+    if(chunks.size() == 1 && chunks[0].relativeRefs.empty()) {
+        verts.swap(chunks[0].verts);
+        texs.swap(chunks[0].texs);
+        norms.swap(chunks[0].norms);
+        faces.swap(chunks[0].faces);
+    } else {
+        verts.resize(vc);
+        texs.resize(tc);
+        norms.resize(nc);
+        faces.corners.resize(cc);
+        if(!triangles) {
+            faces.offsets.resize(fc + 1);
+            faces.offsets[fc] = (GLuint)cc;
+        }
+
+        QSemaphore finished(0);
+        QThreadPool *pool = QThreadPool::globalInstance();
+        for(std::vector<OBJChunk>::iterator c = chunks.begin(); c != chunks.end(); ++c) {
+            pool->start(new OBJChunkTask(OBJChunkTask::Merge, *c, &stopThread, 0, &finished, this));
+        }
+        finished.acquire((int)chunks.size());
+
+        for(std::vector<OBJChunk>::iterator c = chunks.begin(); c != chunks.end(); ++c) {
+            if(!c->error.isEmpty()) {
+                modelError = c->error.arg(c->firstLine + c->errorLine);
+                return false;
+            }
+        }
+    }
+
+    for(std::vector<OBJChunk>::iterator c = chunks.begin(); c != chunks.end(); ++c) {
+        for(std::vector<std::pair<size_t, QString> >::iterator w = c->warnings.begin(); w != c->warnings.end(); ++w) {
+            modelError += QString("Warning: unsupported command '%1' at line %2\n").arg(w->second).arg(c->firstLine + w->first);
+        }
+    }
+    records.swap(fresh);
+    return true;
+}
+
+void OBJModelLoadingThread::streamChunks(std::vector<OBJChunk> &chunks, size_t &streamed, std::deque<OBJStreamBatch*> &pending) {
+    //chunks are published in file order, every finished prefix can resolve its own vertex references;
+    //the renderer drains the queue once per frame, a new chunk is only cut into batches when it kept up
+    bool pushed = false;
+    std::vector<const OBJVec3*> fv;
+    for(;;) {
+        while(!pending.empty() && streamQueue->push(pending.front())) {
+            pending.pop_front();
+            pushed = true;
+        }
+        if(!pending.empty() || streamed == chunks.size() || !chunks[streamed].done.fetchAndAddAcquire(0) || stopThread) break;
+
+        OBJChunk &c = chunks[streamed];
+        if(!c.error.isEmpty()) {
+            streamed = chunks.size();
+            break;
+        }
+        c.vertBase = streamed == 0 ? 0 : chunks[streamed - 1].vertBase + chunks[streamed - 1].verts.size();
+        size_t vc = c.vertBase + c.verts.size();
+
+        std::vector<std::pair<size_t, size_t> >::const_iterator r = c.relativeRefs.begin();
+        OBJStreamBatch *batch = 0;
+        for(size_t f = 0; f < c.faces.size(); ++f) {
+            const FaceIndex *corners = c.faces.face(f);
+            size_t n = c.faces.faceSize(f);
+            size_t first = c.faces.offset(f);
+            fv.resize(n);
+            bool resolved = true;
+            for(size_t k = 0; k < n; ++k) {
+                size_t ref = (first + k) * 3;
+                while(r != c.relativeRefs.end() && r->first < ref) ++r;
+                size_t idx = corners[k].v;
+                if(r != c.relativeRefs.end() && r->first == ref) idx = (GLuint)(idx + c.vertBase);
+                //forward references are left to the final mesh
+                resolved = idx != 0 && idx <= vc;
+                if(!resolved) break;
+
+                size_t lo = 0, hi = streamed;
+                while(lo < hi) {
+                    size_t mid = (lo + hi) / 2;
+                    if(chunks[mid].vertBase + chunks[mid].verts.size() < idx) lo = mid + 1;
+                    else hi = mid;
+                }
+                fv[k] = &chunks[lo].verts[idx - 1 - chunks[lo].vertBase];
+            }
+            if(!resolved) continue;
+
+            for(size_t k = 1; k + 1 < n; ++k) {
+                if(!batch) {
+                    batch = new OBJStreamBatch();
+                    batch->verts.reserve(STREAM_BATCH_SIZE * 3);
+                }
+                batch->verts.push_back(*fv[0]);
+                batch->verts.push_back(*fv[k]);
+                batch->verts.push_back(*fv[k + 1]);
+                if(batch->verts.size() >= STREAM_BATCH_SIZE * 3) {
+                    pending.push_back(batch);
+                    batch = 0;
+                }
+            }
+        }
+        if(batch) pending.push_back(batch);
+        ++streamed;
+    }
+    if(pushed) emit streamUpdated();
+}
+
+static inline GLuint hashCorner(const FaceIndex &c) {
+    GLuint h = c.v * 0x9e3779b1u;
+    h ^= (c.t + 0x7f4a7c15u) * 0x85ebca77u;
+    h ^= (c.n + 0x165667b1u) * 0xc2b2ae3du;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 13;
+    return h;
+}
+
+void OBJModelLoadingThread::buildMesh(const std::vector<GLuint> &triangles) {
+    //open addressing over corner ids, at most half full since every corner may be distinct
+    mesh.clear();
+    size_t cc = faces.corners.size();
+    if(cc == 0) return;
+    size_t tableSize = 1;
+    while(tableSize < cc * 2) tableSize <<= 1;
+    std::vector<GLuint> table(tableSize, EMPTY_SLOT);
+
+    //faces that are all triangles are their own triangle list
+    bool direct = faces.triangles();
+    size_t ic = direct ? cc : triangles.size();
+    mesh.indices.reserve(ic);
+    for(size_t i = 0; i < ic; ++i) {
+        const FaceIndex &c = faces.corners[direct ? i : triangles[i]];
+        size_t slot = hashCorner(c) & (tableSize - 1);
+        while(table[slot] != EMPTY_SLOT && !(mesh.vertices[table[slot]] == c)) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if(table[slot] == EMPTY_SLOT) {
+            table[slot] = (GLuint)mesh.vertices.size();
+            mesh.vertices.push_back(c);
+        }
+        mesh.indices.push_back(table[slot]);
+    }
+}
+
+/**************************************************************************************/
+
+OBJChunkTask::OBJChunkTask(Stage stage, OBJChunk &chunk, const volatile bool *stop, QAtomicInt *parsedKB, QSemaphore *finished, OBJModelLoadingThread *target)
+    : stage(stage), chunk(chunk), stop(stop), parsedKB(parsedKB), finished(finished), target(target) {
+}
+
+void OBJChunkTask::run() {
+    if(stage == Parse) {
+        parse();
+        if(chunk.hashed && chunk.error.isEmpty()) chunk.hash = OBJCache::contentHash(chunk.begin, chunk.end - chunk.begin);
+        chunk.done.fetchAndStoreRelease(1);
+    } else {
+        merge();
+    }
+    finished->release();
+}
+
+void OBJChunkTask::parse() {
+    const char *p = chunk.begin;
+    const char *end = chunk.end;
+    const char *reported = p;
+    OBJVec3 v;
+    std::vector<FaceIndex> face;
+    for(chunk.lines = 0; p != end; ++chunk.lines) {
+        if(*stop) return;
+
+        p = skipBlanks(p, end);
+        const char *cmd = p;
+        while(p != end && !isBlank(*p) && *p != '\n') ++p;
+        size_t cmdLength = p - cmd;
+
+        if(cmdLength == 1 && cmd[0] == 'v') {
+            if(!parseFloat(p, end, v.x) || !parseFloat(p, end, v.y) || !parseFloat(p, end, v.z)) {
+                setError("unable to parse vertex at line %1\n");
+                return;
+            }
+            chunk.verts.push_back(v);
+            chunk.bounds.add(v);
+        } else if(cmdLength == 2 && cmd[0] == 'v' && cmd[1] == 't') {
+            if(!parseFloat(p, end, v.x)) {
+                setError("unable to parse texture coords at line %1\n");
+                return;
+            }
+            if(!parseFloat(p, end, v.y)) v.y = 0;
+            v.z = 0;
+            chunk.texs.push_back(v);
+        } else if(cmdLength == 2 && cmd[0] == 'v' && cmd[1] == 'n') {
+            if(!parseFloat(p, end, v.x) || !parseFloat(p, end, v.y) || !parseFloat(p, end, v.z)) {
+                setError("unable to parse normal at line %1\n");
+                return;
+            }
+            chunk.norms.push_back(v);
+        } else if(cmdLength == 1 && cmd[0] == 'f') {
+            //polygons are kept whole, they're triangulated once all positions are merged
+            face.clear();
+            size_t matchMethod = 0;
+            for(p = skipBlanks(p, end); p != end && *p != '\n'; p = skipBlanks(p, end)) {
+                FaceIndex i;
+                if(!matchFaceDescr(p, end, matchMethod, i, face.size())) {
+                    setError("unable to parse face at line %1\n");
+                    return;
+                }
+                face.push_back(i);
+            }
+            if(face.size() < 3) {
+                setError("face with less than 3 vertices at line %1\n");
+                return;
+            }
+            chunk.faces.addFace(&face[0], face.size());
+        } else if(cmdLength > 0 && cmd[0] != '#') {
+            chunk.warnings.push_back(std::make_pair(chunk.lines, QString::fromLatin1(cmd, (int)cmdLength)));
+        }
+        p = skipLine(p, end);
+
+        if(p - reported >= 1024) {
+            parsedKB->fetchAndAddRelaxed((p - reported) >> 10);
+            reported += (p - reported) & ~(ptrdiff_t)1023;
+        }
+    }
+}
+
+bool OBJChunkTask::matchFaceDescr(const char *&p, const char *end, size_t &method, FaceIndex &out, size_t corner) {
+    if(method == 0) {
+        //deduce the format from the first vertex of the face
+        const char *s = p;
+        int slashes = 0;
+        bool doubleSlash = false;
+        for(; s != end && !isBlank(*s) && *s != '\n'; ++s) {
+            if(*s != '/') continue;
+            if(s + 1 != end && s[1] == '/') doubleSlash = true;
+            ++slashes;
+        }
+        if(doubleSlash) {
+            method = FDM_VN;
+        } else {
+            switch(slashes) {
+            case 0: method = FDM_V; break;
+            case 1: method = FDM_VT; break;
+            case 2: method = FDM_VTN; break;
+            default: return false;
+            }
+        }
+    }
+
+    switch(method) {
+    case FDM_V:
+        if(!parseFaceIndex(p, end, out.v, chunk.verts.size(), chunk.vertExcess, corner * 3 + 0)) return false;
+        break;
+    case FDM_VTN:
+        if(!parseFaceIndex(p, end, out.v, chunk.verts.size(), chunk.vertExcess, corner * 3 + 0) || !skipChar(p, end, '/')) return false;
+        if(!parseFaceIndex(p, end, out.t, chunk.texs.size(), chunk.texExcess, corner * 3 + 1) || !skipChar(p, end, '/')) return false;
+        if(!parseFaceIndex(p, end, out.n, chunk.norms.size(), chunk.normExcess, corner * 3 + 2)) return false;
+        break;
+    case FDM_VN:
+        if(!parseFaceIndex(p, end, out.v, chunk.verts.size(), chunk.vertExcess, corner * 3 + 0)) return false;
+        if(!skipChar(p, end, '/') || !skipChar(p, end, '/')) return false;
+        if(!parseFaceIndex(p, end, out.n, chunk.norms.size(), chunk.normExcess, corner * 3 + 2)) return false;
+        break;
+    case FDM_VT:
+        if(!parseFaceIndex(p, end, out.v, chunk.verts.size(), chunk.vertExcess, corner * 3 + 0) || !skipChar(p, end, '/')) return false;
+        if(!parseFaceIndex(p, end, out.t, chunk.texs.size(), chunk.texExcess, corner * 3 + 1)) return false;
+        break;
+    default:
+        return false;
+    }
+    //a vertex must end with whitespace, otherwise the face mixes formats
+    return p == end || isBlank(*p) || *p == '\n';
+}
+
+bool OBJChunkTask::parseFaceIndex(const char *&p, const char *end, GLuint &out, size_t parsed, OBJIndexExcess &excess, size_t ref) {
+    bool relative = skipChar(p, end, '-');
+    size_t val = 0;
+    if(!parseIndex(p, end, val) || val == 0 || val > MAX_INDEX) return false;
+
+    if(relative) {
+        //counted back from the last element of this chunk, the merge adds the chunk base
+        out = (GLuint)(parsed - val + 1);
+        chunk.relativeRefs.push_back(std::make_pair(chunk.faces.corners.size() * 3 + ref, chunk.lines));
+    } else {
+        //absolute indices may point into previous chunks, which is only checked after the merge
+        out = (GLuint)val;
+        if(val > parsed && val - parsed > excess.amount) {
+            excess.amount = val - parsed;
+            excess.line = chunk.lines;
+        }
+    }
+    return true;
+}
+
+void OBJChunkTask::setError(const char *error) {
+    chunk.error = error;
+    chunk.errorLine = chunk.lines;
+}
+
+void OBJChunkTask::merge() {
+    std::copy(chunk.verts.begin(), chunk.verts.end(), target->verts.begin() + chunk.vertBase);
+    std::copy(chunk.texs.begin(), chunk.texs.end(), target->texs.begin() + chunk.texBase);
+    std::copy(chunk.norms.begin(), chunk.norms.end(), target->norms.begin() + chunk.normBase);
+    std::copy(chunk.faces.corners.begin(), chunk.faces.corners.end(), target->faces.corners.begin() + chunk.cornerBase);
+    if(!target->faces.offsets.empty()) {
+        for(size_t i = 0; i < chunk.faces.size(); ++i) {
+            target->faces.offsets[chunk.faceBase + i] = (GLuint)(chunk.cornerBase + chunk.faces.offset(i));
+        }
+    }
+
+    const size_t bases[3] = { chunk.vertBase, chunk.texBase, chunk.normBase };
+    const size_t counts[3] = { chunk.vertBase + chunk.verts.size(), chunk.texBase + chunk.texs.size(), chunk.normBase + chunk.norms.size() };
+    for(std::vector<std::pair<size_t, size_t> >::iterator r = chunk.relativeRefs.begin(); r != chunk.relativeRefs.end(); ++r) {
+        size_t ref = r->first;
+        FaceIndex &i = target->faces.corners[chunk.cornerBase + ref / 3];
+        GLuint &idx = ref % 3 == 0 ? i.v : (ref % 3 == 1 ? i.t : i.n);
+        //wraps around like the index itself, so references before the first element stay out of bound
+        idx = (GLuint)(idx + bases[ref % 3]);
+        if(idx == 0 || idx > counts[ref % 3]) {
+            chunk.error = "index out of bound at line %1\n";
+            chunk.errorLine = r->second;
+            break;
+        }
+    }
+
+    VertexVector().swap(chunk.verts);
+    VertexVector().swap(chunk.texs);
+    VertexVector().swap(chunk.norms);
+    OBJFaceArray().swap(chunk.faces);
+}
@@ -0,0 +1,377 @@
+#ifndef OBJMODEL_H
+#define OBJMODEL_H
+
+#include <GL/glew.h>
+
+#include <QObject>
+#include <QThread>
+#include <QImage>
+#include <QVector3D>
+#include <QAtomicInt>
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cfloat>
+
+struct OBJVec3 {
+    OBJVec3() : x(0.0), y(0.0), z(0.0) {}
+
+    OBJVec3& operator+=(const OBJVec3 &other) {
+        this->x += other.x;
+        this->y += other.y;
+        this->z += other.z;
+        return *this;
+    }
+
+    OBJVec3& operator-=(const OBJVec3 &other) {
+        this->x -= other.x;
+        this->y -= other.y;
+        this->z -= other.z;
+        return *this;
+    }
+
+    OBJVec3& operator/=(const GLfloat &val) {
+        this->x /= val;
+        this->y /= val;
+        this->z /= val;
+        return *this;
+    }
+
+    GLfloat x;
+    GLfloat y;
+    GLfloat z;
+};
+
+struct OBJVec2 {
+    OBJVec2(GLfloat u = 0.0, GLfloat v = 0.0) : u(u), v(v) {}
+    GLfloat u;
+    GLfloat v;
+};
+
+struct FaceIndex {
+    FaceIndex(GLuint v = 0, GLuint t = 0, GLuint n = 0) : v(v), t(t), n(n) {}
+
+    bool operator==(const FaceIndex &other) const {
+        return v == other.v && t == other.t && n == other.n;
+    }
+
+    GLuint v;
+    GLuint t;
+    GLuint n;
+};
+
+// All face corners in one contiguous array. Triangles are stored back to back and need no
+// offsets table; faces with other corner counts switch it on, it then holds the first corner
+// of every face followed by the total corner count.
+class OBJFaceArray {
+public:
+    size_t size() const { return offsets.empty() ? corners.size() / 3 : offsets.size() - 1; }
+    bool empty() const { return corners.empty(); }
+    bool triangles() const { return offsets.empty(); }
+
+    size_t offset(size_t f) const { return offsets.empty() ? f * 3 : offsets[f]; }
+    size_t faceSize(size_t f) const { return offsets.empty() ? 3 : offsets[f + 1] - offsets[f]; }
+    const FaceIndex *face(size_t f) const { return &corners[offset(f)]; }
+    FaceIndex *face(size_t f) { return &corners[offset(f)]; }
+
+    void addFace(const FaceIndex *c, size_t count);
+    void clear();
+    void swap(OBJFaceArray &other);
+
+    std::vector<FaceIndex> corners;
+    std::vector<GLuint> offsets;
+};
+
+// Simplified level of a mesh: a range of OBJMesh::lodIndices and the largest distance,
+// in model units, by which its surface may stray from the full mesh.
+struct OBJLod {
+    GLuint first, count;
+    GLfloat error;
+};
+
+// Run of at most OBJ_CLUSTER_MAX_TRIANGLES triangles of OBJMesh::indices, starting at index first,
+// with a sphere around its vertices and a cone around its triangle normals (see OBJClusterBuilder).
+struct OBJCluster {
+    OBJVec3 center;
+    GLfloat radius;
+    OBJVec3 coneAxis;
+    GLfloat coneCutoff;
+    GLuint first, count;
+};
+
+// Node of OBJMesh::bvh, a box around its triangles. A leaf holds count triangles of
+// OBJMesh::bvhTriangles from first, an inner node has count 0 and its children at first and first + 1.
+struct OBJBvhNode {
+    OBJVec3 min;
+    GLuint first;
+    OBJVec3 max;
+    GLuint count;
+};
+
+// Faces welded for indexed drawing: every distinct (v, t, n) corner is stored once
+// and the triangle list refers to it by position.
+struct OBJMesh {
+    OBJMesh() : acmrBefore(0.0), acmrAfter(0.0), simplified(false) {}
+
+    void clear();
+    void swap(OBJMesh &other);
+    bool optimized() const { return acmrAfter > 0.0; }
+
+    // the coarsest level whose error stays within maxError, -1 for the full mesh
+    int selectLod(GLfloat maxError) const;
+
+    std::vector<FaceIndex> vertices;
+    std::vector<GLuint> indices;
+    double acmrBefore, acmrAfter;       // vertex cache miss ratios around OBJOptimizer, 0 if not run
+
+    // levels from OBJSimplifier, finest first, sharing the vertices of the full mesh
+    std::vector<OBJLod> lods;
+    std::vector<GLuint> lodIndices;
+    bool simplified;                    // set once the simplifier ran, even if it found no level worth keeping
+
+    // partition of the full triangle list, empty until OBJClusterBuilder ran
+    std::vector<OBJCluster> clusters;
+
+    // hierarchy over the full triangle list for ray queries, empty until OBJBvh ran; not cached
+    std::vector<OBJBvhNode> bvh;
+    std::vector<GLuint> bvhTriangles;   // triangle numbers in leaf order
+};
+
+typedef std::vector<OBJVec3> VertexVector;
+
+// Box, enclosing sphere and centroid of the vertex positions, gathered while they are parsed.
+// The sphere is centered on the box and reaches its corners.
+struct OBJBounds {
+    OBJBounds() { clear(); }
+
+    void clear();
+    void add(const OBJBounds &other);
+    void translate(const OBJVec3 &offset);
+
+    void add(const OBJVec3 &v) {
+        if(v.x < min.x) min.x = v.x;
+        if(v.y < min.y) min.y = v.y;
+        if(v.z < min.z) min.z = v.z;
+        if(v.x > max.x) max.x = v.x;
+        if(v.y > max.y) max.y = v.y;
+        if(v.z > max.z) max.z = v.z;
+        sumX += v.x;
+        sumY += v.y;
+        sumZ += v.z;
+        ++count;
+    }
+
+    bool empty() const { return count == 0; }
+    OBJVec3 centroid() const;
+    OBJVec3 center() const;
+    GLfloat radius() const;
+
+    OBJVec3 min, max;
+    double sumX, sumY, sumZ;
+    quint64 count;
+};
+
+// Positions of a run of triangles, three vertices each, published while the file is parsed.
+struct OBJStreamBatch {
+    VertexVector verts;
+};
+
+// Lock-free ring between one producer (the loader) and one consumer (the renderer).
+// Batches are owned by the queue until popped.
+class OBJStreamQueue {
+public:
+    OBJStreamQueue() : head(0), tail(0) {}
+    ~OBJStreamQueue() { clear(); }
+
+    bool push(OBJStreamBatch *batch);
+    OBJStreamBatch *pop();
+    void clear();
+
+private:
+    enum { Capacity = 256 };
+
+    OBJStreamBatch *ring[Capacity];
+    QAtomicInt head, tail;
+
+    OBJStreamQueue(const OBJStreamQueue&);
+    OBJStreamQueue& operator=(const OBJStreamQueue&);
+};
+
+// Where the last load spent its time, all times in milliseconds.
+struct OBJLoadStats {
+    OBJLoadStats() { clear(); }
+    void clear();
+
+    double bytesPerSecond() const { return totalTime > 0 ? bytes * 1000.0 / totalTime : 0.0; }
+    double linesPerSecond() const { return totalTime > 0 ? lines * 1000.0 / totalTime : 0.0; }
+    QString toString() const;
+
+    qint64 bytes, lines, reusedBytes;
+    bool fromCache;
+    double acmrBefore, acmrAfter;
+    int lodLevels, clusterCount, bvhNodes;
+    qint64 generatedNormals, polygons;
+    double readTime, tokenizeTime, validateTime, triangulateTime, meshTime, normalTime, optimizeTime, lodTime, clusterTime, bvhTime, cacheTime, textureTime, totalTime;
+};
+
+//----------------------------------------------------------------------------------------
+
+// Largest absolute index a chunk refers to beyond its own elements, checked once the chunks before it are known.
+struct OBJIndexExcess {
+    OBJIndexExcess() : amount(0), line(0) {}
+    size_t amount;
+    size_t line;
+};
+
+// One chunk of the last parse: the hash of its bytes and where its elements went in the merged
+// arrays. A reload takes the chunks at the start and the end of the file whose bytes are unchanged
+// from those arrays instead of parsing them again.
+struct OBJChunkRecord {
+    quint64 hash;
+    qint64 size;
+    size_t lines;
+    size_t vertBase, texBase, normBase, faceBase, cornerBase;
+    size_t vertCount, texCount, normCount, faceCount, cornerCount;
+    bool triangles;
+    OBJBounds bounds;
+    std::vector<std::pair<size_t, size_t> > relativeRefs;
+    std::vector<std::pair<size_t, QString> > warnings;
+    OBJIndexExcess vertExcess, texExcess, normExcess;
+};
+
+struct OBJChunk;
+
+// Parses into arrays of its own, which the model takes over once the thread has finished.
+// The arrays of the last load are only read, for the chunks a reload takes over.
+class OBJModelLoadingThread : public QThread {
+    Q_OBJECT
+
+public:
+    OBJModelLoadingThread(const OBJFaceArray &f, const VertexVector &v, const VertexVector &t, const VertexVector &n, QObject *parent = 0);
+    void setFileName(const QString &fp, const QString &tp = "");
+    QString fileName() const { return filePath; }
+
+    // the arrays of the last load no longer hold what its parse left there; only called between loads
+    void forgetChunks();
+
+    // hands over what the finished load produced and frees what it gets back
+    void takeResult(OBJFaceArray &f, OBJMesh &m, VertexVector &v, VertexVector &t, VertexVector &n, OBJBounds &b, QImage &img);
+
+    bool modelStatus;
+    bool cacheEnabled;
+    bool optimizeEnabled;
+    bool lodEnabled;
+    bool normalsEnabled;
+    double creaseAngle;
+    bool clustersEnabled;
+    bool bvhEnabled;
+    bool reuseEnabled;
+    volatile bool stopThread;
+    QString modelError;
+    OBJLoadStats stats;
+    OBJStreamQueue *streamQueue;
+
+signals:
+    void loadProgress(int val);
+    void streamUpdated();
+
+private:
+    void run();
+    bool load();
+
+private:
+    QString filePath, texPath;
+    OBJFaceArray faces;
+    OBJMesh mesh;
+    VertexVector verts, texs, norms;
+    OBJBounds bounds;
+    QImage tex;
+
+    std::vector<OBJChunkRecord> records;
+    const OBJFaceArray &lastFaces;
+    const VertexVector &lastVerts, &lastTexs, &lastNorms;
+
+    bool parse(const char *data, qint64 size);
+    qint64 reuseChunks(const char *data, qint64 size, size_t &headCount, size_t &tailCount);
+    void reuseChunk(const OBJChunkRecord &r, const char *begin, OBJChunk &c);
+    bool mergeChunks(std::vector<OBJChunk> &chunks);
+    void streamChunks(std::vector<OBJChunk> &chunks, size_t &streamed, std::deque<OBJStreamBatch*> &pending);
+    void buildMesh(const std::vector<GLuint> &triangles);
+
+    friend class OBJChunkTask;
+};
+
+//----------------------------------------------------------------------------------------
+
+class OBJModel : public QObject {
+    Q_OBJECT
+
+public:
+    OBJModel(QObject *parent = 0);
+
+    bool status() const { return loader->modelStatus; }
+    // the last load was started by the file watcher, not by loadModel
+    bool reloaded() const { return reloading; }
+    void loadModel(const QString &filePath, const QString &texPath = "");
+    QString modelError() const { return loader->modelError; }
+    const OBJLoadStats &loadStats() const { return loader->stats; }
+    void setCacheEnabled(bool enabled) { loader->cacheEnabled = enabled; }
+    void setOptimizeEnabled(bool enabled) { loader->optimizeEnabled = enabled; }
+    void setLodEnabled(bool enabled) { loader->lodEnabled = enabled; }
+    // corners without a normal get a smooth one, faces further apart than creaseAngle degrees keep an edge
+    void setNormalsEnabled(bool enabled) { loader->normalsEnabled = enabled; }
+    void setCreaseAngle(double degrees) { loader->creaseAngle = degrees; }
+    // runs the optimizer as well, the clusters are only compact in the order it leaves
+    void setClustersEnabled(bool enabled) { loader->clustersEnabled = enabled; }
+    void setBvhEnabled(bool enabled) { loader->bvhEnabled = enabled; }
+    // loadModel publishes batches to stream(), a reload keeps the last load in view until it's done
+    void setStreamingEnabled(bool enabled) { streamingEnabled = enabled; }
+    // loads the file again whenever it changes, parsing only the parts that did
+    void setWatchEnabled(bool enabled);
+    OBJStreamQueue *stream() { return &streamQueue; }
+
+    void moveToMassCenter();
+
+    // frees faces, positions, texture coordinates, normals, the welded vertices, the index lists,
+    // the BVH and the texture image once a renderer has uploaded them; bounds, levels and clusters stay
+    void releaseGeometry();
+
+    // filled on loadStatus, a load in progress leaves them as the last one did
+    OBJFaceArray faces;
+    OBJMesh mesh;
+    std::vector<OBJVec3> verts, texs, norms;
+    QImage texture;
+    OBJBounds bounds;
+    OBJVec3 massCenter;
+
+signals:
+    void loadProgress(int val);
+    void loadStatus(bool status);
+    void streamUpdated();
+
+public slots:
+    void stopLoading();
+
+private slots:
+    void progressSignal(int val);
+    void streamSignal();
+    void loadingFinished();
+    void fileChanged();
+    void reloadModel();
+
+private:
+    void watchFile();
+
+    OBJModelLoadingThread *loader;
+    OBJStreamQueue streamQueue;
+    QFileSystemWatcher *watcher;
+    QTimer *reloadTimer;
+    bool watchEnabled;
+    bool streamingEnabled;
+    bool reloading;
+};
+
+#endif // OBJMODEL_H
@@ -0,0 +1,220 @@
+#include "objnormals.h"
+
+#include <QThreadPool>
+#include <QSemaphore>
+
+#include <algorithm>
+#include <cmath>
+
+#define MIN_RANGE_SIZE (1 << 14)
+
+static inline void cross(const OBJVec3 &a, const OBJVec3 &b, double &x, double &y, double &z) {
+    x = (double)a.y * b.z - (double)a.z * b.y;
+    y = (double)a.z * b.x - (double)a.x * b.z;
+    z = (double)a.x * b.y - (double)a.y * b.x;
+}
+
+static inline OBJVec3 difference(const OBJVec3 &a, const OBJVec3 &b) {
+    OBJVec3 d = a;
+    d -= b;
+    return d;
+}
+
+static inline OBJVec3 normalized(double x, double y, double z) {
+    OBJVec3 n;
+    double len = sqrt(x * x + y * y + z * z);
+    if(len > 0.0) {
+        n.x = (GLfloat)(x / len);
+        n.y = (GLfloat)(y / len);
+        n.z = (GLfloat)(z / len);
+    }
+    return n;
+}
+
+static inline bool sameNormal(const OBJVec3 &a, const OBJVec3 &b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+//----------------------------------------------------------------------------------------
+
+class OBJNormalTask : public QRunnable {
+public:
+    OBJNormalTask(OBJNormalGenerator::Stage stage, OBJNormalGenerator &gen, size_t begin, size_t end, QSemaphore *finished)
+        : stage(stage), gen(gen), begin(begin), end(end), finished(finished) {}
+
+    void run() {
+        gen.runRange(stage, begin, end);
+        finished->release();
+    }
+
+private:
+    OBJNormalGenerator::Stage stage;
+    OBJNormalGenerator &gen;
+    size_t begin, end;
+    QSemaphore *finished;
+};
+
+/**************************************************************************************/
+
+bool OBJNormalGenerator::missing(const OBJFaceArray &faces) {
+    for(std::vector<FaceIndex>::const_iterator c = faces.corners.begin(); c != faces.corners.end(); ++c) {
+        if(c->n == 0) return true;
+    }
+    return false;
+}
+
+size_t OBJNormalGenerator::generate(OBJFaceArray &faces, const VertexVector &verts, VertexVector &norms, double creaseAngle) {
+    if(faces.empty() || verts.empty()) return 0;
+    OBJNormalGenerator gen(faces, verts, norms, creaseAngle);
+    size_t fc = faces.size();
+    size_t vc = verts.size();
+
+    //face normals, counting the corners at every position on the way
+    gen.faceNorms.resize(fc);
+    gen.cursors.resize(vc);
+    gen.runStage(FaceNormals, fc);
+
+    gen.offsets.resize(vc + 1);
+    gen.offsets[0] = 0;
+    for(size_t p = 0; p < vc; ++p) {
+        gen.offsets[p + 1] = gen.offsets[p] + gen.cursors[p].fetchAndAddRelaxed(0);
+        gen.cursors[p].fetchAndStoreRelease(gen.offsets[p]);
+    }
+    gen.incident.resize(gen.offsets[vc]);
+    gen.runStage(Incidence, fc);
+    std::vector<QAtomicInt>().swap(gen.cursors);
+
+    //normals are counted per position first, so that every range knows where to write them
+    gen.distinct.resize(vc);
+    gen.runStage(Count, vc);
+    size_t total = 0;
+    for(size_t p = 0; p < vc; ++p) {
+        size_t count = gen.distinct[p];
+        gen.distinct[p] = (GLuint)total;
+        total += count;
+    }
+    norms.resize(gen.normBase + total);
+    gen.runStage(Write, vc);
+    return total;
+}
+
+OBJNormalGenerator::OBJNormalGenerator(OBJFaceArray &faces, const VertexVector &verts, VertexVector &norms, double creaseAngle)
+    : faces(faces), verts(verts), norms(norms), normBase(norms.size()), cosCrease((GLfloat)cos(creaseAngle * M_PI / 180.0)) {
+}
+
+void OBJNormalGenerator::runStage(Stage stage, size_t count) {
+    size_t rangeCount = qMax<size_t>(1, qMin<size_t>(QThread::idealThreadCount() * 4, count / MIN_RANGE_SIZE));
+    QSemaphore finished(0);
+    QThreadPool *pool = QThreadPool::globalInstance();
+    for(size_t i = 0; i < rangeCount; ++i) {
+        pool->start(new OBJNormalTask(stage, *this, count * i / rangeCount, count * (i + 1) / rangeCount, &finished));
+    }
+    finished.acquire((int)rangeCount);
+}
+
+void OBJNormalGenerator::runRange(Stage stage, size_t begin, size_t end) {
+    switch(stage) {
+    case FaceNormals: faceNormals(begin, end); break;
+    case Incidence: incidence(begin, end); break;
+    case Count: smooth(begin, end, false); break;
+    case Write: smooth(begin, end, true); break;
+    }
+}
+
+//Newell's method, twice the area along the normal, which also holds for polygons that aren't flat
+void OBJNormalGenerator::faceNormals(size_t begin, size_t end) {
+    for(size_t f = begin; f < end; ++f) {
+        const FaceIndex *corners = faces.face(f);
+        size_t n = faces.faceSize(f);
+        double x = 0.0, y = 0.0, z = 0.0;
+        for(size_t k = 0; k < n; ++k) {
+            const OBJVec3 &a = verts[corners[k].v - 1];
+            const OBJVec3 &b = verts[corners[(k + 1) % n].v - 1];
+            x += ((double)a.y - b.y) * ((double)a.z + b.z);
+            y += ((double)a.z - b.z) * ((double)a.x + b.x);
+            z += ((double)a.x - b.x) * ((double)a.y + b.y);
+            cursors[corners[k].v - 1].fetchAndAddRelaxed(1);
+        }
+        OBJVec3 &fn = faceNorms[f];
+        fn.x = (GLfloat)(x / 2);
+        fn.y = (GLfloat)(y / 2);
+        fn.z = (GLfloat)(z / 2);
+    }
+}
+
+void OBJNormalGenerator::incidence(size_t begin, size_t end) {
+    for(size_t f = begin; f < end; ++f) {
+        size_t first = faces.offset(f);
+        size_t n = faces.faceSize(f);
+        for(size_t k = 0; k < n; ++k) {
+            GLuint slot = (GLuint)cursors[faces.corners[first + k].v - 1].fetchAndAddRelaxed(1);
+            incident[slot] = std::make_pair((GLuint)f, (GLuint)(first + k));
+        }
+    }
+}
+
+//every range owns its positions and the corners at them, so the counts, normals and corner
+//indices it writes are its own
+void OBJNormalGenerator::smooth(size_t begin, size_t end, bool write) {
+    VertexVector units, found;
+    std::vector<GLfloat> angles;
+    for(size_t p = begin; p < end; ++p) {
+        size_t first = offsets[p], last = offsets[p + 1];
+        bool needed = false;
+        for(size_t i = first; i < last && !needed; ++i) needed = faces.corners[incident[i].second].n == 0;
+        if(!needed) {
+            if(!write) distinct[p] = 0;
+            continue;
+        }
+
+        //the incidence order depends on the threads, sorting it keeps the sums reproducible
+        if(!write) std::sort(incident.begin() + first, incident.begin() + last);
+        units.clear();
+        angles.clear();
+        for(size_t i = first; i < last; ++i) {
+            const OBJVec3 &fn = faceNorms[incident[i].first];
+            units.push_back(normalized(fn.x, fn.y, fn.z));
+
+            size_t f = incident[i].first;
+            const FaceIndex *corners = faces.face(f);
+            size_t n = faces.faceSize(f);
+            size_t k = incident[i].second - faces.offset(f);
+            const OBJVec3 &v = verts[corners[k].v - 1];
+            OBJVec3 e1 = difference(verts[corners[(k + n - 1) % n].v - 1], v);
+            OBJVec3 e2 = difference(verts[corners[(k + 1) % n].v - 1], v);
+            double x, y, z;
+            cross(e1, e2, x, y, z);
+            double dot = (double)e1.x * e2.x + (double)e1.y * e2.y + (double)e1.z * e2.z;
+            angles.push_back((GLfloat)atan2(sqrt(x * x + y * y + z * z), dot));
+        }
+
+        found.clear();
+        for(size_t i = first; i < last; ++i) {
+            FaceIndex &corner = faces.corners[incident[i].second];
+            if(corner.n != 0) continue;
+
+            //a degenerate face has no direction to crease against and takes all of its neighbours
+            const OBJVec3 &u = units[i - first];
+            bool flat = u.x == 0.0f && u.y == 0.0f && u.z == 0.0f;
+            double x = 0.0, y = 0.0, z = 0.0;
+            for(size_t j = first; j < last; ++j) {
+                const OBJVec3 &w = units[j - first];
+                if(!flat && u.x * w.x + u.y * w.y + u.z * w.z < cosCrease) continue;
+                const OBJVec3 &fn = faceNorms[incident[j].first];
+                x += (double)fn.x * angles[j - first];
+                y += (double)fn.y * angles[j - first];
+                z += (double)fn.z * angles[j - first];
+            }
+            OBJVec3 normal = normalized(x, y, z);
+
+            size_t index = 0;
+            while(index < found.size() && !sameNormal(found[index], normal)) ++index;
+            if(index == found.size()) found.push_back(normal);
+            if(write) {
+                norms[normBase + distinct[p] + index] = normal;
+                corner.n = (GLuint)(normBase + distinct[p] + index + 1);
+            }
+        }
+        if(!write) distinct[p] = (GLuint)found.size();
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef OBJNORMALS_H
+#define OBJNORMALS_H
+
+#include "objmodel.h"
+
+#define OBJ_NORMAL_CREASE_ANGLE 60.0
+
+// Smooth normals for face corners that have none. Every face adds its normal to its corners
+// weighted by its area and by the angle of the corner; a corner only takes the faces around
+// its position that lie within the crease angle of its own face, so hard edges stay hard.
+// Corners of a position that end up with the same normal share it.
+// The work runs on the global thread pool: face normals and the faces around every position
+// are built over ranges of faces, the normals over ranges of positions, so that every worker
+// writes only what it owns and needs neither locks nor per-thread copies of the result.
+
+class OBJNormalGenerator {
+public:
+    static bool missing(const OBJFaceArray &faces);
+
+    // appends the generated normals to norms and points the corners at them,
+    // returns the number of normals added
+    static size_t generate(OBJFaceArray &faces, const VertexVector &verts, VertexVector &norms, double creaseAngle = OBJ_NORMAL_CREASE_ANGLE);
+
+private:
+    enum Stage { FaceNormals, Incidence, Count, Write };
+
+    OBJNormalGenerator(OBJFaceArray &faces, const VertexVector &verts, VertexVector &norms, double creaseAngle);
+
+    void runStage(Stage stage, size_t count);
+    void runRange(Stage stage, size_t begin, size_t end);
+    void faceNormals(size_t begin, size_t end);
+    void incidence(size_t begin, size_t end);
+    void smooth(size_t begin, size_t end, bool write);
+
+    OBJFaceArray &faces;
+    const VertexVector &verts;
+    VertexVector &norms;
+    size_t normBase;
+    GLfloat cosCrease;
+
+    VertexVector faceNorms;                             // area weighted, per face
+    std::vector<GLuint> offsets;                        // faces around every position
+    std::vector<QAtomicInt> cursors;
+    std::vector<std::pair<GLuint, GLuint> > incident;   // face and corner
+    std::vector<GLuint> distinct;                       // normals per position, then their first index
+
+    friend class OBJNormalTask;
+};
+
+#endif // OBJNORMALS_H
@@ -0,0 +1,236 @@
+#include "objoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define NO_VERTEX 0xffffffffu
+
+// FIFO cache simulated with timestamps: a vertex is cached while fewer than cacheSize misses
+// happened since it was loaded. Advancing the clock by cacheSize + 1 flushes the cache.
+static size_t countMisses(const std::vector<GLuint> &indices, size_t first, size_t last, std::vector<size_t> &stamps, size_t &time, size_t cacheSize) {
+    size_t misses = 0;
+    for(size_t i = first * 3; i < last * 3; ++i) {
+        GLuint v = indices[i];
+        if(time - stamps[v] > cacheSize) {
+            stamps[v] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+static inline OBJVec3 meshPosition(const OBJMesh &mesh, const VertexVector &verts, GLuint i) {
+    return verts[mesh.vertices[i].v - 1];
+}
+
+struct OBJSortCluster {
+    size_t first, last;
+    double key;
+
+    bool operator<(const OBJSortCluster &other) const {
+        return key > other.key;
+    }
+};
+
+/**************************************************************************************/
+
+void OBJOptimizer::optimize(OBJMesh &mesh, const VertexVector &verts) {
+    if(mesh.indices.empty()) return;
+    size_t vertexCount = mesh.vertices.size();
+    mesh.acmrBefore = acmr(mesh.indices, vertexCount);
+
+    std::vector<size_t> clusters;
+    tipsify(mesh.indices, vertexCount, clusters);
+    softBoundaries(mesh.indices, vertexCount, clusters);
+    sortClusters(mesh, verts, clusters);
+    reorderVertices(mesh);
+
+    mesh.acmrAfter = acmr(mesh.indices, mesh.vertices.size());
+}
+
+double OBJOptimizer::acmr(const std::vector<GLuint> &indices, size_t vertexCount, size_t cacheSize) {
+    size_t triCount = indices.size() / 3;
+    if(triCount == 0) return 0.0;
+    std::vector<size_t> stamps(vertexCount, 0);
+    size_t time = cacheSize + 1;
+    return (double)countMisses(indices, 0, triCount, stamps, time, cacheSize) / triCount;
+}
+
+void OBJOptimizer::tipsify(std::vector<GLuint> &indices, size_t vertexCount, std::vector<size_t> &clusters) {
+    const size_t cacheSize = OBJ_VERTEX_CACHE_SIZE;
+    size_t triCount = indices.size() / 3;
+
+    //triangles around every vertex, bucketed into one array
+    std::vector<GLuint> offsets(vertexCount + 1, 0);
+    for(size_t i = 0; i < indices.size(); ++i) ++offsets[indices[i] + 1];
+    for(size_t v = 0; v < vertexCount; ++v) offsets[v + 1] += offsets[v];
+    std::vector<GLuint> adjacency(indices.size());
+    std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i < indices.size(); ++i) adjacency[fill[indices[i]]++] = (GLuint)(i / 3);
+
+    std::vector<GLuint> live(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v) live[v] = offsets[v + 1] - offsets[v];
+    std::vector<size_t> stamps(vertexCount, 0);
+    std::vector<bool> emitted(triCount, false);
+    std::vector<GLuint> deadEnd, candidates, out;
+    deadEnd.reserve(indices.size());
+    out.reserve(indices.size());
+
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    GLuint fan = 0;
+    clusters.clear();
+    clusters.push_back(0);
+    while(fan != NO_VERTEX) {
+        //emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for(GLuint a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+            GLuint t = adjacency[a];
+            if(emitted[t]) continue;
+            for(int c = 0; c < 3; ++c) {
+                GLuint v = indices[t * 3 + c];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if(time - stamps[v] > cacheSize) stamps[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        //continue from the oldest candidate that will still be cached after its own fan
+        GLuint next = NO_VERTEX;
+        long best = -1;
+        for(std::vector<GLuint>::const_iterator c = candidates.begin(); c != candidates.end(); ++c) {
+            if(live[*c] == 0) continue;
+            long priority = 0;
+            if(time - stamps[*c] + 2 * live[*c] <= cacheSize) priority = (long)(time - stamps[*c]);
+            if(priority > best) {
+                best = priority;
+                next = *c;
+            }
+        }
+
+        if(next == NO_VERTEX) {
+            //dead end: back to a recent vertex with triangles left, otherwise the next one in order
+            while(next == NO_VERTEX && !deadEnd.empty()) {
+                GLuint v = deadEnd.back();
+                deadEnd.pop_back();
+                if(live[v] > 0) next = v;
+            }
+            for(; next == NO_VERTEX && cursor < vertexCount; ++cursor) {
+                if(live[cursor] > 0) next = (GLuint)cursor;
+            }
+            if(next != NO_VERTEX && out.size() / 3 != clusters.back()) clusters.push_back(out.size() / 3);
+        }
+        fan = next;
+    }
+    clusters.push_back(triCount);
+    indices.swap(out);
+}
+
+void OBJOptimizer::softBoundaries(const std::vector<GLuint> &indices, size_t vertexCount, std::vector<size_t> &clusters) {
+    //split a cluster wherever its running miss ratio gets within the threshold of the whole cluster's,
+    //the flushed cache then costs little compared to the freedom in ordering
+    const size_t cacheSize = OBJ_VERTEX_CACHE_SIZE;
+    std::vector<size_t> stamps(vertexCount, 0);
+    size_t time = cacheSize + 1;
+    std::vector<size_t> result;
+    result.reserve(clusters.size());
+    for(size_t c = 0; c + 1 < clusters.size(); ++c) {
+        size_t first = clusters[c], last = clusters[c + 1];
+        time += cacheSize + 1;
+        double threshold = OBJ_OVERDRAW_THRESHOLD * countMisses(indices, first, last, stamps, time, cacheSize) / (last - first);
+
+        time += cacheSize + 1;
+        size_t start = first, misses = 0;
+        for(size_t t = first; t < last; ++t) {
+            misses += countMisses(indices, t, t + 1, stamps, time, cacheSize);
+            if(t + 1 < last && (double)misses / (t + 1 - start) <= threshold) {
+                result.push_back(start);
+                start = t + 1;
+                misses = 0;
+                time += cacheSize + 1;
+            }
+        }
+        result.push_back(start);
+    }
+    result.push_back(indices.size() / 3);
+    clusters.swap(result);
+}
+
+void OBJOptimizer::sortClusters(OBJMesh &mesh, const VertexVector &verts, const std::vector<size_t> &clusters) {
+    //clusters facing away from the model center are drawn first, they are the likely occluders
+    std::vector<OBJSortCluster> order(clusters.size() - 1);
+    std::vector<OBJVec3> centers(order.size()), normals(order.size());
+    double meshArea = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+    for(size_t c = 0; c < order.size(); ++c) {
+        order[c].first = clusters[c];
+        order[c].last = clusters[c + 1];
+        double area = 0.0, cx = 0.0, cy = 0.0, cz = 0.0, nx = 0.0, ny = 0.0, nz = 0.0;
+        for(size_t t = order[c].first; t < order[c].last; ++t) {
+            OBJVec3 a = meshPosition(mesh, verts, mesh.indices[t * 3]);
+            OBJVec3 b = meshPosition(mesh, verts, mesh.indices[t * 3 + 1]);
+            OBJVec3 d = meshPosition(mesh, verts, mesh.indices[t * 3 + 2]);
+            b -= a;
+            d -= a;
+            double tx = (double)b.y * d.z - (double)b.z * d.y;
+            double ty = (double)b.z * d.x - (double)b.x * d.z;
+            double tz = (double)b.x * d.y - (double)b.y * d.x;
+            double ta = sqrt(tx * tx + ty * ty + tz * tz);
+            nx += tx;
+            ny += ty;
+            nz += tz;
+            //triangle centroid relative to a is (b + d) / 3
+            cx += ta * (a.x + (b.x + d.x) / 3.0);
+            cy += ta * (a.y + (b.y + d.y) / 3.0);
+            cz += ta * (a.z + (b.z + d.z) / 3.0);
+            area += ta;
+        }
+        if(area > 0.0) {
+            centers[c].x = (GLfloat)(cx / area);
+            centers[c].y = (GLfloat)(cy / area);
+            centers[c].z = (GLfloat)(cz / area);
+        }
+        double nl = sqrt(nx * nx + ny * ny + nz * nz);
+        if(nl > 0.0) {
+            normals[c].x = (GLfloat)(nx / nl);
+            normals[c].y = (GLfloat)(ny / nl);
+            normals[c].z = (GLfloat)(nz / nl);
+        }
+        mx += cx;
+        my += cy;
+        mz += cz;
+        meshArea += area;
+    }
+    if(meshArea > 0.0) {
+        mx /= meshArea;
+        my /= meshArea;
+        mz /= meshArea;
+    }
+    for(size_t c = 0; c < order.size(); ++c) {
+        order[c].key = (centers[c].x - mx) * normals[c].x + (centers[c].y - my) * normals[c].y + (centers[c].z - mz) * normals[c].z;
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<GLuint> sorted;
+    sorted.reserve(mesh.indices.size());
+    for(std::vector<OBJSortCluster>::const_iterator c = order.begin(); c != order.end(); ++c) {
+        sorted.insert(sorted.end(), mesh.indices.begin() + c->first * 3, mesh.indices.begin() + c->last * 3);
+    }
+    mesh.indices.swap(sorted);
+}
+
+void OBJOptimizer::reorderVertices(OBJMesh &mesh) {
+    std::vector<GLuint> remap(mesh.vertices.size(), NO_VERTEX);
+    std::vector<FaceIndex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for(std::vector<GLuint>::iterator i = mesh.indices.begin(); i != mesh.indices.end(); ++i) {
+        if(remap[*i] == NO_VERTEX) {
+            remap[*i] = (GLuint)vertices.size();
+            vertices.push_back(mesh.vertices[*i]);
+        }
+        *i = remap[*i];
+    }
+    mesh.vertices.swap(vertices);
+}
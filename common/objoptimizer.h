@@ -0,0 +1,28 @@
+#ifndef OBJOPTIMIZER_H
+#define OBJOPTIMIZER_H
+
+#include "objmodel.h"
+
+#define OBJ_VERTEX_CACHE_SIZE 16
+#define OBJ_OVERDRAW_THRESHOLD 1.05
+
+// Reorders a welded mesh for the GPU without changing what it draws:
+// Tipsify triangle order for the post-transform vertex cache (Sander et al. 2007),
+// its clusters sorted outside-in to reduce overdraw, and vertices renumbered in the
+// order they are first used, so that vertex fetch walks memory forward.
+
+class OBJOptimizer {
+public:
+    static void optimize(OBJMesh &mesh, const VertexVector &verts);
+
+    // average cache miss ratio: transformed vertices per triangle with a FIFO cache
+    static double acmr(const std::vector<GLuint> &indices, size_t vertexCount, size_t cacheSize = OBJ_VERTEX_CACHE_SIZE);
+
+private:
+    static void tipsify(std::vector<GLuint> &indices, size_t vertexCount, std::vector<size_t> &clusters);
+    static void softBoundaries(const std::vector<GLuint> &indices, size_t vertexCount, std::vector<size_t> &clusters);
+    static void sortClusters(OBJMesh &mesh, const VertexVector &verts, const std::vector<size_t> &clusters);
+    static void reorderVertices(OBJMesh &mesh);
+};
+
+#endif // OBJOPTIMIZER_H
@@ -0,0 +1,233 @@
+#include "objpacker.h"
+#include "objcache.h"
+
+#include <cmath>
+#include <cstring>
+
+#define PACKED_POSITION_MAX 65535.0f
+
+static inline GLushort quantize(GLfloat v, GLfloat min, GLfloat extent) {
+    if(extent <= 0.0f) return 0;
+    GLfloat q = (v - min) / extent * PACKED_POSITION_MAX + 0.5f;
+    if(q < 0.0f) return 0;
+    if(q > PACKED_POSITION_MAX) return (GLushort)PACKED_POSITION_MAX;
+    return (GLushort)q;
+}
+
+static inline GLuint snorm10(GLfloat v) {
+    if(v < -1.0f) v = -1.0f;
+    if(v > 1.0f) v = 1.0f;
+    return (GLuint)((GLint)floor(v * 511.0f + 0.5f) & 0x3ff);
+}
+
+template<class T> static inline void appendValue(std::vector<GLubyte> &data, const T &val) {
+    const GLubyte *bytes = reinterpret_cast<const GLubyte*>(&val);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+/**************************************************************************************/
+
+void OBJBufferRuns::reset() {
+    size = 0;
+    hashes.clear();
+}
+
+void OBJBufferRuns::allocate(GLenum target, GLsizeiptr bytes) {
+    if(bytes == size && !hashes.empty()) return;
+    glBufferData(target, bytes, 0, GL_STATIC_DRAW);
+    size = bytes;
+    hashes.clear();
+}
+
+void OBJBufferRuns::write(GLenum target, size_t run, GLintptr offset, GLsizeiptr bytes, const void *data) {
+    quint64 hash = OBJCache::contentHash((const char*)data, bytes);
+    if(run < hashes.size() && hashes[run] == hash) return;
+    if(run >= hashes.size()) hashes.resize(run + 1, 0);
+    hashes[run] = hash;
+    glBufferSubData(target, offset, bytes, data);
+}
+
+//----------------------------------------------------------------------------------------
+
+void OBJAttribute::setPointer(GLuint index) const {
+    glEnableVertexAttribArray(index);
+    glVertexAttribPointer(index, size, type, normalized, stride, (void*)(size_t)offset);
+}
+
+//----------------------------------------------------------------------------------------
+
+void OBJVertexPacker::upload(const OBJModel &model, const Attribute *which, OBJAttribute *attrs, int count, bool packed, GLuint buffer, OBJBufferRuns &runs) {
+    size_t vc = model.mesh.vertices.size();
+    std::vector<GLubyte> interleaved;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for(size_t first = 0; first == 0 || first < vc; first += OBJ_UPLOAD_VERTICES) {
+        size_t run = qMin<size_t>(OBJ_UPLOAD_VERTICES, vc - first);
+        //every vertex takes the same number of bytes, so the first run tells the layout and the buffer size;
+        //each attribute starts on a 4-byte boundary as the vertex fetch prefers
+        GLsizei stride = 0;
+        for(int a = 0; a < count; ++a) {
+            OBJAttribute &attr = attrs[a];
+            switch(which[a]) {
+            case Positions: positions(model, packed, attr, first, run); break;
+            case Normals: normals(model, packed, attr, first, run); break;
+            case TexCoords: texCoords(model, packed, attr, first, run); break;
+            }
+            attr.offset = stride;
+            stride += run > 0 ? (GLsizei)((attr.data.size() / run + 3) & ~3) : 0;
+        }
+        for(int a = 0; a < count; ++a) attrs[a].stride = stride;
+        if(first == 0) runs.allocate(GL_ARRAY_BUFFER, vc * stride);
+        if(run == 0) continue;
+
+        //a single attribute without padding is written as it is
+        const GLubyte *data = &attrs[0].data[0];
+        if(count > 1 || attrs[0].data.size() != run * stride) {
+            interleaved.assign(run * stride, 0);
+            for(int a = 0; a < count; ++a) {
+                const OBJAttribute &attr = attrs[a];
+                size_t size = attr.data.size() / run;
+                for(size_t v = 0; v < run; ++v) memcpy(&interleaved[v * stride + attr.offset], &attr.data[v * size], size);
+            }
+            data = &interleaved[0];
+        }
+        runs.write(GL_ARRAY_BUFFER, first / OBJ_UPLOAD_VERTICES, first * stride, run * stride, data);
+    }
+    for(int a = 0; a < count; ++a) std::vector<GLubyte>().swap(attrs[a].data);
+}
+
+void OBJVertexPacker::uploadIndices(const OBJMesh &mesh, GLuint buffer, OBJBufferRuns &runs) {
+    const std::vector<GLuint> *lists[2] = { &mesh.indices, &mesh.lodIndices };
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    runs.allocate(GL_ELEMENT_ARRAY_BUFFER, (mesh.indices.size() + mesh.lodIndices.size()) * sizeof(GLuint));
+    size_t run = 0, offset = 0;
+    for(int l = 0; l < 2; ++l) {
+        const std::vector<GLuint> &list = *lists[l];
+        for(size_t first = 0; first < list.size(); first += OBJ_UPLOAD_VERTICES, ++run) {
+            size_t count = qMin<size_t>(OBJ_UPLOAD_VERTICES, list.size() - first);
+            runs.write(GL_ELEMENT_ARRAY_BUFFER, run, (offset + first) * sizeof(GLuint), count * sizeof(GLuint), &list[first]);
+        }
+        offset += list.size();
+    }
+}
+
+void OBJVertexPacker::positionTransform(const OBJModel &model, bool packed, QVector3D &offset, QVector3D &scale) {
+    if(!packed || model.bounds.empty()) {
+        offset = QVector3D(0, 0, 0);
+        scale = QVector3D(1, 1, 1);
+        return;
+    }
+    const OBJVec3 &min = model.bounds.min;
+    const OBJVec3 &max = model.bounds.max;
+    offset = QVector3D(min.x, min.y, min.z);
+    scale = QVector3D(max.x - min.x, max.y - min.y, max.z - min.z);
+}
+
+void OBJVertexPacker::positions(const OBJModel &model, bool packed, OBJAttribute &attr, size_t first, size_t count) {
+    std::vector<FaceIndex>::const_iterator vi = model.mesh.vertices.begin() + first;
+    std::vector<FaceIndex>::const_iterator end = vi + count;
+    attr.data.clear();
+    attr.size = 3;
+    if(!packed || model.bounds.empty()) {
+        attr.type = GL_FLOAT;
+        attr.normalized = GL_FALSE;
+        attr.stride = 0;
+        attr.data.reserve(count * sizeof(OBJVec3));
+        for(; vi != end; ++vi) {
+            appendValue(attr.data, model.verts[vi->v - 1]);
+        }
+        return;
+    }
+
+    //x, y, z and a padding short, so that every vertex stays 4-byte aligned
+    const OBJVec3 &min = model.bounds.min;
+    const OBJVec3 &max = model.bounds.max;
+    GLfloat ex = max.x - min.x, ey = max.y - min.y, ez = max.z - min.z;
+    attr.type = GL_UNSIGNED_SHORT;
+    attr.normalized = GL_TRUE;
+    attr.stride = 4 * sizeof(GLushort);
+    attr.data.reserve(count * attr.stride);
+    for(; vi != end; ++vi) {
+        const OBJVec3 &v = model.verts[vi->v - 1];
+        GLushort q[4] = { quantize(v.x, min.x, ex), quantize(v.y, min.y, ey), quantize(v.z, min.z, ez), 0 };
+        appendValue(attr.data, q);
+    }
+}
+
+void OBJVertexPacker::normals(const OBJModel &model, bool packed, OBJAttribute &attr, size_t first, size_t count) {
+    std::vector<FaceIndex>::const_iterator vi = model.mesh.vertices.begin() + first;
+    std::vector<FaceIndex>::const_iterator end = vi + count;
+    attr.data.clear();
+    attr.stride = 0;
+    if(packed) {
+        attr.size = 4;
+        attr.type = GL_INT_2_10_10_10_REV;
+        attr.normalized = GL_TRUE;
+        attr.data.reserve(count * sizeof(GLuint));
+        for(; vi != end; ++vi) {
+            appendValue(attr.data, vi->n != 0 ? packNormal(model.norms[vi->n - 1]) : (GLuint)0);
+        }
+    } else {
+        attr.size = 3;
+        attr.type = GL_FLOAT;
+        attr.normalized = GL_FALSE;
+        attr.data.reserve(count * sizeof(OBJVec3));
+        for(; vi != end; ++vi) {
+            appendValue(attr.data, vi->n != 0 ? model.norms[vi->n - 1] : OBJVec3());
+        }
+    }
+}
+
+void OBJVertexPacker::texCoords(const OBJModel &model, bool packed, OBJAttribute &attr, size_t first, size_t count) {
+    std::vector<FaceIndex>::const_iterator vi = model.mesh.vertices.begin() + first;
+    std::vector<FaceIndex>::const_iterator end = vi + count;
+    attr.data.clear();
+    attr.size = 2;
+    attr.type = packed ? GL_HALF_FLOAT : GL_FLOAT;
+    attr.normalized = GL_FALSE;
+    attr.stride = 0;
+    attr.data.reserve(count * (packed ? 2 * sizeof(GLushort) : 2 * sizeof(GLfloat)));
+    for(; vi != end; ++vi) {
+        GLfloat uv[2] = { 0.0f, 0.0f };
+        if(vi->t != 0) {
+            uv[0] = model.texs[vi->t - 1].x;
+            uv[1] = model.texs[vi->t - 1].y;
+        }
+        if(packed) {
+            GLushort h[2] = { toHalf(uv[0]), toHalf(uv[1]) };
+            appendValue(attr.data, h);
+        } else {
+            appendValue(attr.data, uv);
+        }
+    }
+}
+
+GLuint OBJVertexPacker::packNormal(const OBJVec3 &n) {
+    double len = sqrt((double)n.x * n.x + (double)n.y * n.y + (double)n.z * n.z);
+    if(len == 0.0) return 0;
+    return snorm10((GLfloat)(n.x / len)) | (snorm10((GLfloat)(n.y / len)) << 10) | (snorm10((GLfloat)(n.z / len)) << 20);
+}
+
+GLushort OBJVertexPacker::toHalf(GLfloat f) {
+    GLuint bits;
+    memcpy(&bits, &f, sizeof(bits));
+    GLuint sign = (bits >> 16) & 0x8000;
+    GLuint mantissa = bits & 0x7fffff;
+    int exponent = (int)((bits >> 23) & 0xff);
+
+    if(exponent == 0xff) return (GLushort)(sign | 0x7c00 | (mantissa ? 0x200 : 0)); //inf and nan
+    exponent += 15 - 127;
+    if(exponent >= 0x1f) return (GLushort)(sign | 0x7c00); //overflow
+    if(exponent <= 0) {
+        //denormal or zero
+        if(exponent < -10) return (GLushort)sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        GLuint half = mantissa >> shift;
+        if((mantissa >> (shift - 1)) & 1) ++half;
+        return (GLushort)(sign | half);
+    }
+    //rounding may carry into the exponent, which is still the right result
+    GLuint half = sign | (exponent << 10) | (mantissa >> 13);
+    if(mantissa & 0x1000) ++half;
+    return (GLushort)half;
+}
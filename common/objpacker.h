@@ -0,0 +1,70 @@
+#ifndef OBJPACKER_H
+#define OBJPACKER_H
+
+#include "objmodel.h"
+
+#include <QVector3D>
+
+#define OBJ_UPLOAD_VERTICES (1 << 16)
+
+// Vertex attributes of a welded mesh, as uploaded to a buffer and described to glVertexAttribPointer.
+// Packed attributes take 8 + 4 + 4 bytes per vertex instead of 12 + 12 + 8:
+// positions are unsigned 16-bit fractions of the mesh box, restored in the vertex shader
+// by posOffset + position * posScale; normals (GL_INT_2_10_10_10_REV) and texture
+// coordinates (half floats) are decoded by the vertex fetch itself.
+// The attributes of a mesh are interleaved in one buffer, vertex after vertex, so that a vertex
+// array object set up once at upload time describes the whole mesh.
+// Attributes are packed and uploaded in runs of OBJ_UPLOAD_VERTICES vertices, so that the
+// CPU never holds more than one run of a buffer besides the model.
+// The hash of every run is kept, so that uploading a reloaded model into the same buffer
+// writes only the runs that changed.
+
+struct OBJBufferRuns {
+    OBJBufferRuns() : size(0) {}
+
+    void reset();
+    // allocates size bytes for the buffer bound to target, unless it has that size already
+    void allocate(GLenum target, GLsizeiptr size);
+    // writes run number run at offset, unless the same bytes were written there last time
+    void write(GLenum target, size_t run, GLintptr offset, GLsizeiptr bytes, const void *data);
+
+    GLsizeiptr size;
+    std::vector<quint64> hashes;
+};
+
+struct OBJAttribute {
+    OBJAttribute() : size(3), type(GL_FLOAT), normalized(GL_FALSE), stride(0), offset(0) {}
+
+    // enables the attribute at index and points it at the buffer bound to GL_ARRAY_BUFFER
+    void setPointer(GLuint index) const;
+
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride, offset;
+    std::vector<GLubyte> data;
+};
+
+class OBJVertexPacker {
+public:
+    enum Attribute { Positions, Normals, TexCoords };
+
+    // fills buffer with attributes which[0..count) of every welded vertex interleaved, attrs[i] is left
+    // with the format and the place of which[i] in the buffer
+    static void upload(const OBJModel &model, const Attribute *which, OBJAttribute *attrs, int count, bool packed, GLuint buffer, OBJBufferRuns &runs);
+    // the full triangle list followed by the simplified levels
+    static void uploadIndices(const OBJMesh &mesh, GLuint buffer, OBJBufferRuns &runs);
+
+    // offset and scale are (0, 0, 0) and (1, 1, 1) for unpacked positions
+    static void positionTransform(const OBJModel &model, bool packed, QVector3D &offset, QVector3D &scale);
+
+    // replaces attr.data with the attribute of count welded vertices from first
+    static void positions(const OBJModel &model, bool packed, OBJAttribute &attr, size_t first, size_t count);
+    static void normals(const OBJModel &model, bool packed, OBJAttribute &attr, size_t first, size_t count);
+    static void texCoords(const OBJModel &model, bool packed, OBJAttribute &attr, size_t first, size_t count);
+
+    static GLuint packNormal(const OBJVec3 &n);
+    static GLushort toHalf(GLfloat f);
+};
+
+#endif // OBJPACKER_H
@@ -0,0 +1,314 @@
+#include "objsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define NO_WEDGE 0xffffffffu
+
+enum { Interior, Border, Locked };
+
+struct OBJSimplifier::Edge {
+    GLuint a, b;            // positions, a < b
+    GLuint va, vb;          // their vertices in the triangle the edge was found in
+    GLuint tri;
+
+    bool operator<(const Edge &other) const {
+        return a < other.a || (a == other.a && b < other.b);
+    }
+};
+
+struct OBJSimplifier::Collapse {
+    GLuint from, to;        // positions
+    GLuint target;          // vertex that replaces the one at from
+    double cost;
+
+    bool operator<(const Collapse &other) const {
+        return from < other.from || (from == other.from && cost < other.cost);
+    }
+
+    static bool sameSource(const Collapse &a, const Collapse &b) {
+        return a.from == b.from;
+    }
+
+    static bool cheaper(const Collapse &a, const Collapse &b) {
+        return a.cost < b.cost;
+    }
+};
+
+static inline double triangleNormal(const OBJVec3 &a, const OBJVec3 &b, const OBJVec3 &c, double n[3]) {
+    double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+    double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+    n[0] = uy * vz - uz * vy;
+    n[1] = uz * vx - ux * vz;
+    n[2] = ux * vy - uy * vx;
+    return sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+}
+
+/**************************************************************************************/
+
+void OBJQuadric::addPlane(double nx, double ny, double nz, double d, double weight) {
+    a00 += weight * nx * nx;
+    a01 += weight * nx * ny;
+    a02 += weight * nx * nz;
+    a11 += weight * ny * ny;
+    a12 += weight * ny * nz;
+    a22 += weight * nz * nz;
+    b0 += weight * nx * d;
+    b1 += weight * ny * d;
+    b2 += weight * nz * d;
+    c += weight * d * d;
+    w += weight;
+}
+
+void OBJQuadric::add(const OBJQuadric &other) {
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a11 += other.a11;
+    a12 += other.a12;
+    a22 += other.a22;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+    w += other.w;
+}
+
+double OBJQuadric::error(const OBJVec3 &v) const {
+    double x = v.x, y = v.y, z = v.z;
+    double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+            + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return e > 0.0 ? e : 0.0;
+}
+
+//----------------------------------------------------------------------------------------
+
+OBJSimplifier::OBJSimplifier(const OBJMesh &mesh, const VertexVector &verts)
+    : mesh(mesh), verts(verts), stamp(0), triCount(0), maxError(0.0) {
+    size_t vertexCount = mesh.vertices.size();
+    size_t posCount = verts.size();
+    remap.resize(vertexCount);
+    for(size_t i = 0; i < vertexCount; ++i) remap[i] = (GLuint)i;
+
+    //a position with several vertices lies on a seam of normals or texture coordinates
+    wedge.assign(posCount, NO_WEDGE);
+    std::vector<bool> seen(posCount, false);
+    for(size_t i = 0; i < vertexCount; ++i) {
+        GLuint p = position((GLuint)i);
+        wedge[p] = seen[p] ? NO_WEDGE : (GLuint)i;
+        seen[p] = true;
+    }
+
+    tris.reserve(mesh.indices.size());
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        GLuint a = position(mesh.indices[i]), b = position(mesh.indices[i + 1]), c = position(mesh.indices[i + 2]);
+        if(a == b || b == c || a == c) continue;
+        tris.insert(tris.end(), mesh.indices.begin() + i, mesh.indices.begin() + i + 3);
+    }
+    triCount = tris.size() / 3;
+
+    //area weighted planes of the triangles around every position
+    quadrics.resize(posCount);
+    for(size_t t = 0; t < triCount; ++t) {
+        GLuint p[3] = { position(tris[t * 3]), position(tris[t * 3 + 1]), position(tris[t * 3 + 2]) };
+        double n[3];
+        double len = triangleNormal(verts[p[0]], verts[p[1]], verts[p[2]], n);
+        if(len == 0.0) continue;
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+        double d = -(n[0] * verts[p[0]].x + n[1] * verts[p[0]].y + n[2] * verts[p[0]].z);
+        for(int k = 0; k < 3; ++k) quadrics[p[k]].addPlane(n[0], n[1], n[2], d, len / 2.0);
+    }
+
+    //open borders are held by planes through them, perpendicular to their triangle
+    std::vector<Edge> edges;
+    collectEdges(edges);
+    for(size_t i = 0, j = 0; i < edges.size(); i = j) {
+        for(j = i + 1; j < edges.size() && edges[j].a == edges[i].a && edges[j].b == edges[i].b; ++j) {}
+        if(j - i != 1) continue;
+        const Edge &e = edges[i];
+        const OBJVec3 &a = verts[e.a], &b = verts[e.b];
+        double n[3];
+        if(triangleNormal(verts[position(tris[e.tri * 3])], verts[position(tris[e.tri * 3 + 1])], verts[position(tris[e.tri * 3 + 2])], n) == 0.0) continue;
+        double ex = b.x - a.x, ey = b.y - a.y, ez = b.z - a.z;
+        double mx = ey * n[2] - ez * n[1], my = ez * n[0] - ex * n[2], mz = ex * n[1] - ey * n[0];
+        double ml = sqrt(mx * mx + my * my + mz * mz);
+        if(ml == 0.0) continue;
+        mx /= ml;
+        my /= ml;
+        mz /= ml;
+        double d = -(mx * a.x + my * a.y + mz * a.z);
+        double weight = (ex * ex + ey * ey + ez * ez) * OBJ_LOD_BORDER_WEIGHT;
+        quadrics[e.a].addPlane(mx, my, mz, d, weight);
+        quadrics[e.b].addPlane(mx, my, mz, d, weight);
+    }
+    marks.assign(posCount, 0);
+}
+
+size_t OBJSimplifier::simplify(size_t targetCount) {
+    while(triCount > targetCount && pass(targetCount)) {}
+    return triCount;
+}
+
+void OBJSimplifier::buildLods(OBJMesh &mesh, const VertexVector &verts) {
+    mesh.lods.clear();
+    mesh.lodIndices.clear();
+    mesh.simplified = true;
+    size_t count = mesh.indices.size() / 3;
+    if(count < 2 * OBJ_LOD_MIN_TRIANGLES) return;
+
+    OBJSimplifier simplifier(mesh, verts);
+    while(mesh.lods.size() < OBJ_LOD_MAX_LEVELS && count >= 2 * OBJ_LOD_MIN_TRIANGLES) {
+        size_t left = simplifier.simplify(count / 2);
+        //a level that barely shrinks costs memory without saving time
+        if(left * 4 > count * 3) break;
+        OBJLod lod;
+        lod.first = (GLuint)mesh.lodIndices.size();
+        lod.count = (GLuint)(left * 3);
+        lod.error = simplifier.error();
+        mesh.lodIndices.insert(mesh.lodIndices.end(), simplifier.indices().begin(), simplifier.indices().end());
+        mesh.lods.push_back(lod);
+        count = left;
+    }
+}
+
+void OBJSimplifier::collectEdges(std::vector<Edge> &edges) const {
+    edges.clear();
+    edges.reserve(triCount * 3);
+    for(size_t t = 0; t < triCount; ++t) {
+        for(int k = 0; k < 3; ++k) {
+            GLuint va = tris[t * 3 + k], vb = tris[t * 3 + (k + 1) % 3];
+            GLuint a = position(va), b = position(vb);
+            Edge e;
+            e.a = qMin(a, b);
+            e.b = qMax(a, b);
+            e.va = a < b ? va : vb;
+            e.vb = a < b ? vb : va;
+            e.tri = (GLuint)t;
+            edges.push_back(e);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+}
+
+bool OBJSimplifier::pass(size_t targetCount) {
+    size_t posCount = verts.size();
+    std::vector<Edge> edges;
+    collectEdges(edges);
+
+    //positions with one-sided edges are on a border, those with edges of more than two triangles are kept
+    kind.assign(posCount, Interior);
+    for(size_t p = 0; p < posCount; ++p) {
+        if(wedge[p] == NO_WEDGE) kind[p] = Locked;
+    }
+    for(size_t i = 0, j = 0; i < edges.size(); i = j) {
+        for(j = i + 1; j < edges.size() && edges[j].a == edges[i].a && edges[j].b == edges[i].b; ++j) {}
+        if(j - i > 2) {
+            kind[edges[i].a] = kind[edges[i].b] = Locked;
+        } else if(j - i == 1) {
+            if(kind[edges[i].a] == Interior) kind[edges[i].a] = Border;
+            if(kind[edges[i].b] == Interior) kind[edges[i].b] = Border;
+        }
+    }
+
+    //the cheapest way to remove every position, borders only move along themselves
+    std::vector<Collapse> collapses;
+    collapses.reserve(edges.size());
+    for(size_t i = 0, j = 0; i < edges.size(); i = j) {
+        for(j = i + 1; j < edges.size() && edges[j].a == edges[i].a && edges[j].b == edges[i].b; ++j) {}
+        if(j - i > 2) continue;
+        const Edge &e = edges[i];
+        for(int dir = 0; dir < 2; ++dir) {
+            Collapse c;
+            c.from = dir ? e.b : e.a;
+            c.to = dir ? e.a : e.b;
+            c.target = dir ? e.va : e.vb;
+            if(kind[c.from] == Locked || (kind[c.from] == Border && j - i != 1)) continue;
+            c.cost = quadrics[c.from].error(verts[c.to]);
+            collapses.push_back(c);
+        }
+    }
+    std::sort(collapses.begin(), collapses.end());
+    collapses.erase(std::unique(collapses.begin(), collapses.end(), Collapse::sameSource), collapses.end());
+    if(collapses.empty()) return false;
+    //only the cheaper half goes in one pass, the rest is priced again after it
+    std::sort(collapses.begin(), collapses.end(), Collapse::cheaper);
+    collapses.resize((collapses.size() + 1) / 2);
+
+    offsets.assign(posCount + 1, 0);
+    for(size_t i = 0; i < tris.size(); ++i) ++offsets[position(tris[i]) + 1];
+    for(size_t p = 0; p < posCount; ++p) offsets[p + 1] += offsets[p];
+    adjacency.resize(tris.size());
+    std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i < tris.size(); ++i) adjacency[fill[position(tris[i])]++] = (GLuint)(i / 3);
+
+    locked.assign(posCount, 0);
+    size_t collapsed = 0;
+    for(std::vector<Collapse>::const_iterator c = collapses.begin(); c != collapses.end() && triCount > targetCount; ++c) {
+        if(locked[c->from] || locked[c->to]) continue;
+        size_t removed = 0;
+        if(!collapse(*c, removed)) continue;
+        triCount -= removed;
+        ++collapsed;
+    }
+
+    //drop the triangles that lost an edge
+    std::vector<GLuint> result;
+    result.reserve(tris.size());
+    for(size_t t = 0; t * 3 < tris.size(); ++t) {
+        GLuint v[3] = { remap[tris[t * 3]], remap[tris[t * 3 + 1]], remap[tris[t * 3 + 2]] };
+        GLuint a = position(v[0]), b = position(v[1]), c = position(v[2]);
+        if(a == b || b == c || a == c) continue;
+        result.insert(result.end(), v, v + 3);
+    }
+    tris.swap(result);
+    triCount = tris.size() / 3;
+    return collapsed > 0;
+}
+
+bool OBJSimplifier::collapse(const Collapse &c, size_t &removed) {
+    //collapses of this pass are already in remap, a moved vertex is locked and never moves twice
+    const OBJVec3 &dest = verts[c.to];
+    GLuint ring = ++stamp;
+    GLuint common = ++stamp;
+    removed = 0;
+    for(GLuint a = offsets[c.from]; a < offsets[c.from + 1]; ++a) {
+        GLuint t = adjacency[a];
+        GLuint p[3] = { position(remap[tris[t * 3]]), position(remap[tris[t * 3 + 1]]), position(remap[tris[t * 3 + 2]]) };
+        if(p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) continue;
+        for(int k = 0; k < 3; ++k) {
+            if(p[k] != c.from) marks[p[k]] = ring;
+        }
+        if(p[0] == c.to || p[1] == c.to || p[2] == c.to) {
+            ++removed;
+            continue;
+        }
+        //the remaining triangles must not turn over
+        double n0[3], n1[3];
+        triangleNormal(verts[p[0]], verts[p[1]], verts[p[2]], n0);
+        triangleNormal(p[0] == c.from ? dest : verts[p[0]], p[1] == c.from ? dest : verts[p[1]], p[2] == c.from ? dest : verts[p[2]], n1);
+        if(n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0) return false;
+    }
+    if(removed == 0) return false;
+
+    //the edge may only share the vertices of its own triangles with its ends, otherwise the surface pinches
+    size_t shared = 0;
+    for(GLuint a = offsets[c.to]; a < offsets[c.to + 1]; ++a) {
+        GLuint t = adjacency[a];
+        for(int k = 0; k < 3; ++k) {
+            GLuint p = position(remap[tris[t * 3 + k]]);
+            if(p != c.to && p != c.from && marks[p] == ring) {
+                marks[p] = common;
+                ++shared;
+            }
+        }
+    }
+    if(shared > removed) return false;
+
+    if(quadrics[c.from].w > 0.0) maxError = qMax(maxError, sqrt(c.cost / quadrics[c.from].w));
+    remap[wedge[c.from]] = c.target;
+    quadrics[c.to].add(quadrics[c.from]);
+    locked[c.from] = locked[c.to] = 1;
+    return true;
+}
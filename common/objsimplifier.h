@@ -0,0 +1,64 @@
+#ifndef OBJSIMPLIFIER_H
+#define OBJSIMPLIFIER_H
+
+#include "objmodel.h"
+
+#define OBJ_LOD_MAX_LEVELS 8
+#define OBJ_LOD_MIN_TRIANGLES 512
+#define OBJ_LOD_BORDER_WEIGHT 10.0
+
+// Quadric error edge collapse (Garland and Heckbert 1997) restricted to half-edges, so that
+// every level reuses the vertices of the full mesh and only needs its own index list.
+// Open borders collapse only along themselves; vertices on attribute seams and
+// non-manifold edges stay where they are, which keeps textures and hard edges intact.
+
+struct OBJQuadric {
+    OBJQuadric() : a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0), w(0) {}
+
+    void addPlane(double nx, double ny, double nz, double d, double weight);
+    void add(const OBJQuadric &other);
+    double error(const OBJVec3 &v) const;
+
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2, c;
+    double w;
+};
+
+class OBJSimplifier {
+public:
+    OBJSimplifier(const OBJMesh &mesh, const VertexVector &verts);
+
+    // collapses edges until targetCount triangles are left or no collapse keeps the surface intact,
+    // returns the number of triangles left
+    size_t simplify(size_t targetCount);
+
+    const std::vector<GLuint> &indices() const { return tris; }
+    GLfloat error() const { return (GLfloat)maxError; }
+
+    // halves the mesh level by level into OBJMesh::lods, each level simplified from the previous one
+    static void buildLods(OBJMesh &mesh, const VertexVector &verts);
+
+private:
+    struct Edge;
+    struct Collapse;
+
+    GLuint position(GLuint vertex) const { return mesh.vertices[vertex].v - 1; }
+    void collectEdges(std::vector<Edge> &edges) const;
+    bool collapse(const Collapse &c, size_t &removed);
+    bool pass(size_t targetCount);
+
+    const OBJMesh &mesh;
+    const VertexVector &verts;
+    std::vector<GLuint> tris;
+    std::vector<GLuint> remap;                  // vertex collapsed into, per vertex of the mesh
+    std::vector<GLuint> wedge;                  // the only vertex at a position, NO_WEDGE for seams
+    std::vector<OBJQuadric> quadrics;           // per position
+    std::vector<unsigned char> kind, locked;
+    std::vector<GLuint> adjacency, offsets;     // triangles around every position
+    std::vector<GLuint> marks;
+    GLuint stamp;
+    size_t triCount;
+    double maxError;
+};
+
+#endif // OBJSIMPLIFIER_H
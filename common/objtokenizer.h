@@ -0,0 +1,90 @@
+#ifndef OBJTOKENIZER_H
+#define OBJTOKENIZER_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// Locale-independent tokenizer working directly on the raw file bytes.
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline const char *skipBlanks(const char *p, const char *end) {
+    while(p != end && isBlank(*p)) ++p;
+    return p;
+}
+
+static inline const char *skipLine(const char *p, const char *end) {
+    while(p != end && *p != '\n') ++p;
+    return p == end ? p : p + 1;
+}
+
+static inline bool skipChar(const char *&p, const char *end, char c) {
+    if(p == end || *p != c) return false;
+    ++p;
+    return true;
+}
+
+static inline bool parseIndex(const char *&p, const char *end, size_t &out) {
+    if(p == end || !isDigit(*p)) return false;
+    size_t val = 0;
+    for(; p != end && isDigit(*p); ++p) val = val * 10 + (*p - '0');
+    out = val;
+    return true;
+}
+
+static inline bool parseFloat(const char *&p, const char *end, GLfloat &out) {
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *s = skipBlanks(p, end);
+    bool negative = false;
+    if(s != end && (*s == '-' || *s == '+')) negative = (*s++ == '-');
+
+    //accumulate up to 19 significant digits, the rest only moves the decimal point
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for(; s != end && isDigit(*s); ++s, any = true) {
+        if(digits < 19) { mantissa = mantissa * 10 + (*s - '0'); if(mantissa) ++digits; }
+        else ++exponent;
+    }
+    if(s != end && *s == '.') {
+        for(++s; s != end && isDigit(*s); ++s, any = true) {
+            if(digits < 19) { mantissa = mantissa * 10 + (*s - '0'); if(mantissa) ++digits; --exponent; }
+        }
+    }
+    if(!any) return false;
+
+    if(s != end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        bool negExp = false;
+        if(e != end && (*e == '-' || *e == '+')) negExp = (*e++ == '-');
+        if(e != end && isDigit(*e)) {
+            int val = 0;
+            for(; e != end && isDigit(*e); ++e) if(val < 10000) val = val * 10 + (*e - '0');
+            exponent += negExp ? -val : val;
+            s = e;
+        }
+    }
+
+    double result = (double)mantissa;
+    for(; exponent > 22; exponent -= 22) result *= powers[22];
+    for(; exponent < -22; exponent += 22) result /= powers[22];
+    if(exponent > 0) result *= powers[exponent];
+    else if(exponent < 0) result /= powers[-exponent];
+
+    out = (GLfloat)(negative ? -result : result);
+    p = s;
+    return true;
+}
+
+#endif // OBJTOKENIZER_H
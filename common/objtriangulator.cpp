@@ -0,0 +1,169 @@
+#include "objtriangulator.h"
+
+#include <QThreadPool>
+#include <QSemaphore>
+
+#include <cmath>
+
+#define MIN_RANGE_SIZE (1 << 14)
+
+class OBJTriangulatorTask : public QRunnable {
+public:
+    OBJTriangulatorTask(const OBJFaceArray &faces, const VertexVector &verts, std::vector<GLuint> &triangles, size_t begin, size_t end, QAtomicInt *polygons, QSemaphore *finished)
+        : faces(faces), verts(verts), triangles(triangles), begin(begin), end(end), polygons(polygons), finished(finished) {}
+
+    void run() {
+        OBJTriangulator t(faces, verts, triangles);
+        polygons->fetchAndAddRelaxed((int)t.runRange(begin, end));
+        finished->release();
+    }
+
+private:
+    const OBJFaceArray &faces;
+    const VertexVector &verts;
+    std::vector<GLuint> &triangles;
+    size_t begin, end;
+    QAtomicInt *polygons;
+    QSemaphore *finished;
+};
+
+/**************************************************************************************/
+
+size_t OBJTriangulator::triangulate(const OBJFaceArray &faces, const VertexVector &verts, std::vector<GLuint> &triangles) {
+    size_t fc = faces.size();
+    triangles.resize(3 * (faces.corners.size() - 2 * fc));
+    if(fc == 0) return 0;
+
+    size_t rangeCount = qMax<size_t>(1, qMin<size_t>(QThread::idealThreadCount() * 4, fc / MIN_RANGE_SIZE));
+    QAtomicInt polygons(0);
+    QSemaphore finished(0);
+    QThreadPool *pool = QThreadPool::globalInstance();
+    for(size_t i = 0; i < rangeCount; ++i) {
+        pool->start(new OBJTriangulatorTask(faces, verts, triangles, fc * i / rangeCount, fc * (i + 1) / rangeCount, &polygons, &finished));
+    }
+    finished.acquire((int)rangeCount);
+    return (size_t)polygons.fetchAndAddRelaxed(0);
+}
+
+OBJTriangulator::OBJTriangulator(const OBJFaceArray &faces, const VertexVector &verts, std::vector<GLuint> &triangles)
+    : faces(faces), verts(verts), triangles(triangles) {
+}
+
+size_t OBJTriangulator::runRange(size_t begin, size_t end) {
+    size_t count = 0;
+    for(size_t f = begin; f < end; ++f) {
+        size_t first = faces.offset(f);
+        size_t n = faces.faceSize(f);
+        GLuint *out = &triangles[3 * (first - 2 * f)];
+        if(n == 3) {
+            out[0] = (GLuint)first;
+            out[1] = (GLuint)(first + 1);
+            out[2] = (GLuint)(first + 2);
+            continue;
+        }
+
+        ++count;
+        project(first, n);
+        if(n == 4) {
+            quad(first, out);
+            continue;
+        }
+        bool convex = true;
+        for(size_t k = 0; k < n && convex; ++k) convex = turn((k + n - 1) % n, k, (k + 1) % n) >= 0.0;
+        if(!convex) {
+            earClip(first, n, out);
+            continue;
+        }
+        for(size_t k = 1; k + 1 < n; ++k, out += 3) {
+            out[0] = (GLuint)first;
+            out[1] = (GLuint)(first + k);
+            out[2] = (GLuint)(first + k + 1);
+        }
+    }
+    return count;
+}
+
+//drops the axis the normal is closest to, swapping the other two when the normal points
+//down that axis, so that the corners turn left around the face
+void OBJTriangulator::project(size_t first, size_t n) {
+    const FaceIndex *corners = &faces.corners[first];
+    double nx = 0.0, ny = 0.0, nz = 0.0;
+    for(size_t k = 0; k < n; ++k) {
+        const OBJVec3 &a = verts[corners[k].v - 1];
+        const OBJVec3 &b = verts[corners[(k + 1) % n].v - 1];
+        nx += ((double)a.y - b.y) * ((double)a.z + b.z);
+        ny += ((double)a.z - b.z) * ((double)a.x + b.x);
+        nz += ((double)a.x - b.x) * ((double)a.y + b.y);
+    }
+    int axis = fabs(nx) > fabs(ny) ? (fabs(nx) > fabs(nz) ? 0 : 2) : (fabs(ny) > fabs(nz) ? 1 : 2);
+    bool flip = (axis == 0 ? nx : (axis == 1 ? ny : nz)) < 0.0;
+
+    points.resize(n);
+    for(size_t k = 0; k < n; ++k) {
+        const OBJVec3 &v = verts[corners[k].v - 1];
+        double a = axis == 0 ? v.y : (axis == 1 ? v.z : v.x);
+        double b = axis == 0 ? v.z : (axis == 1 ? v.x : v.y);
+        points[k].x = flip ? b : a;
+        points[k].y = flip ? a : b;
+    }
+}
+
+//a quad has at most one reflex corner, only the diagonal through it stays inside
+void OBJTriangulator::quad(size_t first, GLuint *out) {
+    bool reflex02 = turn(3, 0, 1) < 0.0 || turn(1, 2, 3) < 0.0;
+    bool reflex13 = turn(0, 1, 2) < 0.0 || turn(2, 3, 0) < 0.0;
+    size_t d = 0;
+    if(reflex13 && !reflex02) {
+        d = 1;
+    } else if(!reflex02) {
+        const FaceIndex *corners = &faces.corners[first];
+        OBJVec3 d02 = verts[corners[0].v - 1], d13 = verts[corners[1].v - 1];
+        d02 -= verts[corners[2].v - 1];
+        d13 -= verts[corners[3].v - 1];
+        if(d13.x * d13.x + d13.y * d13.y + d13.z * d13.z < d02.x * d02.x + d02.y * d02.y + d02.z * d02.z) d = 1;
+    }
+    const size_t tris[6] = { d, d + 1, d + 2, d, d + 2, (d + 3) % 4 };
+    for(int i = 0; i < 6; ++i) out[i] = (GLuint)(first + tris[i]);
+}
+
+//self-intersecting or degenerate faces may run out of ears, the next corner is clipped anyway
+//so that every face still yields its n - 2 triangles
+void OBJTriangulator::earClip(size_t first, size_t n, GLuint *out) {
+    left.resize(n);
+    for(size_t k = 0; k < n; ++k) left[k] = k;
+    size_t i = 0;
+    while(left.size() > 3) {
+        size_t m = left.size();
+        size_t tries = 0;
+        while(tries < m && !isEar(left[(i + m - 1) % m], left[i % m], left[(i + 1) % m])) {
+            i = (i + 1) % m;
+            ++tries;
+        }
+        i %= m;
+        out[0] = (GLuint)(first + left[(i + m - 1) % m]);
+        out[1] = (GLuint)(first + left[i]);
+        out[2] = (GLuint)(first + left[(i + 1) % m]);
+        out += 3;
+        left.erase(left.begin() + i);
+        //the neighbours of a clipped ear are the likeliest next ears
+        i = i == 0 ? left.size() - 1 : i - 1;
+    }
+    out[0] = (GLuint)(first + left[0]);
+    out[1] = (GLuint)(first + left[1]);
+    out[2] = (GLuint)(first + left[2]);
+}
+
+bool OBJTriangulator::isEar(size_t prev, size_t cur, size_t next) const {
+    if(turn(prev, cur, next) <= 0.0) return false;
+    for(std::vector<size_t>::const_iterator k = left.begin(); k != left.end(); ++k) {
+        if(*k == prev || *k == cur || *k == next) continue;
+        if(turn(prev, cur, *k) >= 0.0 && turn(cur, next, *k) >= 0.0 && turn(next, prev, *k) >= 0.0) return false;
+    }
+    return true;
+}
+
+//positive where a, b, c turn left
+double OBJTriangulator::turn(size_t a, size_t b, size_t c) const {
+    const Point &pa = points[a], &pb = points[b], &pc = points[c];
+    return (pb.x - pa.x) * (pc.y - pb.y) - (pb.y - pa.y) * (pc.x - pb.x);
+}
@@ -0,0 +1,45 @@
+#ifndef OBJTRIANGULATOR_H
+#define OBJTRIANGULATOR_H
+
+#include "objmodel.h"
+
+// Triangles of the faces of an OBJ file, keeping the winding of every face. Quads are cut along
+// the diagonal through their reflex corner, or the shorter one when they are convex; convex
+// polygons become fans and concave ones are cut by ear clipping in the plane of their normal.
+// A face of n corners always yields n - 2 triangles, so face f starts at triangle offset(f) - 2 * f
+// and ranges of faces run on the global thread pool without sharing anything.
+
+class OBJTriangulator {
+public:
+    // corner numbers of every triangle, as indices into faces.corners, returns the number of
+    // faces that had more than three corners
+    static size_t triangulate(const OBJFaceArray &faces, const VertexVector &verts, std::vector<GLuint> &triangles);
+
+private:
+    struct Point {
+        double x, y;
+    };
+
+    OBJTriangulator(const OBJFaceArray &faces, const VertexVector &verts, std::vector<GLuint> &triangles);
+
+    // returns the number of polygons in the range
+    size_t runRange(size_t begin, size_t end);
+    void project(size_t first, size_t n);
+    void quad(size_t first, GLuint *out);
+    void earClip(size_t first, size_t n, GLuint *out);
+    bool isEar(size_t prev, size_t cur, size_t next) const;
+    double turn(size_t a, size_t b, size_t c) const;
+
+    const OBJFaceArray &faces;
+    const VertexVector &verts;
+    std::vector<GLuint> &triangles;
+
+    //corners of the current face in its plane, counterclockwise when it's seen along its normal,
+    //and the ones that aren't clipped yet
+    std::vector<Point> points;
+    std::vector<size_t> left;
+
+    friend class OBJTriangulatorTask;
+};
+
+#endif // OBJTRIANGULATOR_H
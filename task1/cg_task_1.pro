@@ -11,15 +11,19 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = cg_task_1
 TEMPLATE = app
 
+include(../common/common.pri)
+
 SOURCES += main.cpp \
     mainwindow.cpp \
     modelviewer.cpp \
-    objmodel.cpp
+    $$COMMON/objpacker.cpp \
+    objpages.cpp
 
 HEADERS  += \
     mainwindow.h \
     modelviewer.h \
-    objmodel.h
+    $$COMMON/objpacker.h \
+    objpages.h
 
 win32 {
     LIBS += -L"D:/libs/glew-1.10.0/lib/"
@@ -30,7 +34,8 @@ LIBS += -lGLEW
 
 OTHER_FILES += \
     vertexShader.vsh \
-    fragmentShader.fsh
+    fragmentShader.fsh \
+    geometryShader.geom
 
 RESOURCES += \
     shaders.qrc
@@ -19,12 +19,17 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     glFormat.setSampleBuffers(true);
 
     viewer = new ModelViewer(glFormat, this);
+    viewer->setGpuResident(true);
 
     QPushButton *pbLoadModel = new QPushButton("Load model...", this);
     connect(pbLoadModel, SIGNAL(clicked()), this, SLOT(loadModel()));
 
     model = new OBJModel(this);
+    model->setStreamingEnabled(true);
+    model->setOptimizeEnabled(true);
+    model->setLodEnabled(true);
     connect(model, SIGNAL(loadStatus(bool)), this, SLOT(showModel(bool)));
+    connect(model, SIGNAL(streamUpdated()), viewer, SLOT(streamUpdated()));
 
     pdLoading = new QProgressDialog("Loading model...", "Cancel", 0, 100, this);
     pdLoading->setMinimumDuration(0);
@@ -32,6 +37,22 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     connect(model, SIGNAL(loadProgress(int)), pdLoading, SLOT(setValue(int)));
     connect(pdLoading, SIGNAL(canceled()), model, SLOT(stopLoading()));
 
+    //models larger than memory are converted to pages once and then paged in as the view needs them
+    pageBuilder = new OBJPageBuilder(this);
+    connect(pageBuilder, SIGNAL(buildProgress(int)), pdLoading, SLOT(setValue(int)));
+    connect(pageBuilder, SIGNAL(finished()), this, SLOT(showPages()));
+    connect(pdLoading, SIGNAL(canceled()), this, SLOT(stopBuilding()));
+    cbOutOfCore = new QCheckBox("Out-of-core", this);
+
+    //a watched model is parsed again when its file is saved, keeping its geometry on the CPU
+    //lets the parse reuse what didn't change and the buffers take only the runs that did
+    QCheckBox *cbWatch = new QCheckBox("Reload on change", this);
+    connect(cbWatch, SIGNAL(toggled(bool)), this, SLOT(setWatchEnabled(bool)));
+
+    QCheckBox *cbOutline = new QCheckBox("Outline", this);
+    cbOutline->setChecked(true);
+    connect(cbOutline, SIGNAL(toggled(bool)), viewer, SLOT(setDrawOutline(bool)));
+
     QSignalMapper *dsm = new QSignalMapper(this);
     QRadioButton *rbUseZ = new QRadioButton("z-coord", this);
     QRadioButton *rbUseFC = new QRadioButton("gl_FragCoord.z", this);
@@ -74,7 +95,9 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     optLayout->addWidget(new QLabel("Fill:", this));
     optLayout->addWidget(rbUseZ);
     optLayout->addWidget(rbUseFC);
-    optLayout->addWidget(new QLabel("| Outline color: R", this));
+    optLayout->addWidget(new QLabel("|", this));
+    optLayout->addWidget(cbOutline);
+    optLayout->addWidget(new QLabel("color: R", this));
     optLayout->addWidget(sbR);
     optLayout->addWidget(new QLabel("G", this));
     optLayout->addWidget(sbG);
@@ -84,6 +107,9 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     optLayout->addWidget(sbNear);
     optLayout->addWidget(new QLabel("far", this));
     optLayout->addWidget(sbFar);
+    optLayout->addWidget(new QLabel("|", this));
+    optLayout->addWidget(cbOutOfCore);
+    optLayout->addWidget(cbWatch);
 
     QWidget *w = new QWidget(this);
     QGridLayout *layout = new QGridLayout();
@@ -103,18 +129,47 @@ void MainWindow::loadModel() {
     QString fileName = QFileDialog::getOpenFileName(this, "Select model", "", "Model files (*.obj)");
     if(fileName.isEmpty()) return;
     pdLoading->reset();
-    model->loadModel(fileName.toStdString());
+    viewer->setPages(0);
+    pageFile.close();
+    if(cbOutOfCore->isChecked()) {
+        pageBuilder->setFileName(fileName);
+        pageBuilder->start();
+        return;
+    }
+    viewer->beginStream(model->stream());
+    model->loadModel(fileName);
 }
 
 void MainWindow::showModel(bool status) {
     pdLoading->hide();
     if(!status) {
-        QMessageBox::critical(this, "CG Task 1", QString("Unable to load model:\n%1").arg(model->modelError().c_str()));
+        viewer->endStream();
+        QMessageBox::critical(this, "CG Task 1", QString("Unable to load model:\n%1").arg(model->modelError()));
     } else {
+        std::cout << "Model loaded: " << model->loadStats().toString().toStdString() << std::endl;
         viewer->setModel(model);
     }
 }
 
+void MainWindow::showPages() {
+    pdLoading->hide();
+    if(!pageBuilder->buildStatus || !pageFile.open(pageBuilder->fileName())) {
+        QMessageBox::critical(this, "CG Task 1", QString("Unable to load model:\n%1").arg(pageBuilder->buildError));
+        return;
+    }
+    std::cout << "Model paged: " << pageFile.triangleCount() << " triangles in " << pageFile.pages().size() << " pages" << std::endl;
+    viewer->setPages(&pageFile);
+}
+
+void MainWindow::setWatchEnabled(bool val) {
+    viewer->setGpuResident(!val);
+    model->setWatchEnabled(val);
+}
+
+void MainWindow::stopBuilding() {
+    pageBuilder->stopThread = true;
+}
+
 void MainWindow::setOutlineColor() {
     viewer->setOutlineColor(sbR->value(), sbG->value(), sbB->value());
 }
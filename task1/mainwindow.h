@@ -4,9 +4,11 @@
 #include <QMainWindow>
 #include <QProgressDialog>
 #include <QDoubleSpinBox>
+#include <QCheckBox>
 
 #include "modelviewer.h"
 #include "objmodel.h"
+#include "objpages.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -17,6 +19,9 @@ public:
 private slots:
     void loadModel();
     void showModel(bool status);
+    void showPages();
+    void stopBuilding();
+    void setWatchEnabled(bool val);
     void setOutlineColor();
     void updateNearPlane(double val);
     void updateFarPlane(double val);
@@ -24,10 +29,13 @@ private slots:
 private:
     ModelViewer *viewer;
     OBJModel *model;
+    OBJPageBuilder *pageBuilder;
+    OBJPageFile pageFile;
 
     QProgressDialog *pdLoading;
     QDoubleSpinBox *sbR, *sbG, *sbB;
     QDoubleSpinBox *sbNear, *sbFar;
+    QCheckBox *cbOutOfCore;
 };
 
 #endif // MAINWINDOW_H
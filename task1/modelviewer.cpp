@@ -1,4 +1,5 @@
 #include "modelviewer.h"
+#include "glstatecache.h"
 
 #include <QFile>
 #include <QMouseEvent>
@@ -6,6 +7,11 @@
 #include <QMessageBox>
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#define LOD_PIXEL_ERROR 1.0
+#define PAGE_GPU_BUDGET (256 << 20)
 
 //----------------------------------------------------------------------------------------
 
@@ -27,7 +33,8 @@ static void qreal2glfloat(const QMatrix4x4 &in, GLfloat *out) {
         func(location, 1, GL_FALSE, mat); \
         }
 
-ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new QGLContext(fmt), parent), model(0) {
+ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new QGLContext(fmt), parent), model(0),
+    streamQueue(0), streamBuffer(0), streamBufferCapacity(0), streamVertexCount(0), pageFile(0), pageBytes(0), frameCount(0) {
     hAngle = 0;
     vAngle = 0;
     fovVal = 45.0;
@@ -36,38 +43,109 @@ ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new
     pNear = 0.1;
     pFar = 100.0;
     outlineColor = QVector3D(0, 0, 0);
+    drawOutline = true;
+    packedVertices = true;
+    gpuResident = false;
+    pager = new OBJPager(this);
+    connect(pager, SIGNAL(pageLoaded()), this, SLOT(pageLoaded()));
 }
 
 ModelViewer::~ModelViewer() {
     model = 0;
+    setPages(0);
     glDeleteBuffers(1, &vertexBuffer);
-    glDeleteProgram(shaderProgramID);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteBuffers(1, &streamBuffer);
+    GLStateCache &gl = GLStateCache::instance();
+    for(int i = 0; i < ProgramCount; ++i) gl.deleteProgram(programs[i].id);
+    gl.deleteVertexArrays(1, &vertexArrayID);
+    gl.deleteVertexArrays(1, &streamArrayID);
 }
 
 void ModelViewer::setModel(OBJModel *m) {
-    if(model) {
-        glDeleteBuffers(1, &vertexBuffer);
-    }
-
-    std::vector<OBJVec3> vs, ns, ts;
-    for(std::vector<OBJFace>::iterator fi = m->faces.begin(); fi != m->faces.end(); ++fi) {
-        for(OBJFace::iterator fii = fi->begin(); fii != fi->end(); ++fii) {
-            if(fii->n != 0) ns.push_back(m->norms[fii->n - 1]);
-            if(fii->t != 0) ts.push_back(m->texs[fii->t - 1]);
-            vs.push_back(m->verts[fii->v - 1]);
+    //a streamed model is already in view, keep the camera the user has moved meanwhile
+    bool streamed = streamQueue != 0;
+    endStream();
+    setPages(0);
+    //a reloaded model keeps its buffers, only the runs that changed are written again;
+    //a model loaded from another file, even into the same object, starts over
+    bool reloaded = m == model && m->reloaded();
+    if(!reloaded) {
+        if(model) {
+            glDeleteBuffers(1, &vertexBuffer);
+            glDeleteBuffers(1, &indexBuffer);
         }
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        vertexRuns.reset();
+        indexRuns.reset();
     }
 
-    //assume there is only triangles in the model
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vs.size() * sizeof(OBJVec3), &vs[0], GL_STATIC_DRAW);
-    vertexBufferSize = vs.size();
+    //one vertex per distinct corner of the welded mesh, the vertex array keeps the buffers and the layout
+    GLStateCache::instance().bindVertexArray(vertexArrayID);
+    const OBJVertexPacker::Attribute which = OBJVertexPacker::Positions;
+    OBJAttribute attr;
+    OBJVertexPacker::positionTransform(*m, packedVertices, posOffset, posScale);
+    OBJVertexPacker::upload(*m, &which, &attr, 1, packedVertices, vertexBuffer, vertexRuns);
+    attr.setPointer(0);
 
+    //the simplified levels follow the full triangle list
+    indexBufferSize = m->mesh.indices.size();
+    OBJVertexPacker::uploadIndices(m->mesh, indexBuffer, indexRuns);
+
+    if(gpuResident) m->releaseGeometry();
     model = m;
 
+    if(streamed) fitView();
+    else if(!reloaded) resetView();
+    update();
+}
+
+void ModelViewer::beginStream(OBJStreamQueue *queue) {
+    endStream();
+    streamQueue = queue;
+    streamQueue->clear();
+    resetView();
+    update();
+}
+
+void ModelViewer::endStream() {
+    if(!streamQueue) return;
+    streamQueue->clear();
+    streamQueue = 0;
+    glDeleteBuffers(1, &streamBuffer);
+    streamBuffer = 0;
+    streamBufferCapacity = 0;
+    streamVertexCount = 0;
+    update();
+}
+
+void ModelViewer::streamUpdated() {
+    if(streamQueue) update();
+}
+
+void ModelViewer::setPages(OBJPageFile *file) {
+    pager->setFile(0);
+    for(size_t i = 0; i < pageBuffers.size(); ++i) releasePage(i);
+    pageBuffers.clear();
+    drawnPages.clear();
+    pageFile = file;
+    if(!pageFile) return;
+
+    endStream();
+    if(model) {
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        model = 0;
+    }
+    pageBuffers.resize(pageFile->pages().size());
+    pager->setFile(pageFile);
     resetView();
+    update();
+}
+
+void ModelViewer::pageLoaded() {
+    if(pageFile) update();
 }
 
 void ModelViewer::setOutlineColor(double r, double g, double b) {
@@ -75,6 +153,11 @@ void ModelViewer::setOutlineColor(double r, double g, double b) {
     update();
 }
 
+void ModelViewer::setDrawOutline(bool val) {
+    drawOutline = val;
+    update();
+}
+
 void ModelViewer::setFillMethod(int m) {
     if(depthFillMethod != m) {
         depthFillMethod = m;
@@ -110,65 +193,67 @@ void ModelViewer::initializeGL() {
 
     std::cout << "OpenGL initialized: GL version "<< glGetString(GL_VERSION) << " | GLSL "<< glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.reset();
+    gl.enable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
-    glEnable(GL_CULL_FACE);
-    glPolygonOffset(-1.0, -1.0);
+    gl.enable(GL_CULL_FACE);
 
-    shaderProgramID = createShaders(":/vertexShader.vsh", ":/fragmentShader.fsh");
+    //the geometry shader only supplies the barycentric coordinates of the outline, a plain fill goes without it
+    programs[FillProgram].id = createShaders(":/vertexShader.vsh", ":/fragmentShader.fsh");
+    programs[OutlineProgram].id = createShaders(":/vertexShader.vsh", ":/fragmentShader.fsh", ":/geometryShader.geom");
 
+    //the streamed triangles and every page get vertex arrays of their own
     glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
-    mvpMatrixID = glGetUniformLocation(shaderProgramID, "MVP");
-    invpMatrixID = glGetUniformLocation(shaderProgramID, "invP");
-    drawOutlineID = glGetUniformLocation(shaderProgramID, "drawOutline");
-    depthFillMethodID = glGetUniformLocation(shaderProgramID, "depthFillMethod");
-    outlineColorID = glGetUniformLocation(shaderProgramID, "outlineColor");
-    nearID = glGetUniformLocation(shaderProgramID, "near");
-    farID = glGetUniformLocation(shaderProgramID, "far");
+    glGenVertexArrays(1, &streamArrayID);
+
+    for(int p = 0; p < ProgramCount; ++p) {
+        ShaderProgram &program = programs[p];
+        program.mvpMatrixID = glGetUniformLocation(program.id, "MVP");
+        program.invpMatrixID = glGetUniformLocation(program.id, "invP");
+        program.drawOutlineID = glGetUniformLocation(program.id, "drawOutline");
+        program.depthFillMethodID = glGetUniformLocation(program.id, "depthFillMethod");
+        program.outlineColorID = glGetUniformLocation(program.id, "outlineColor");
+        program.posOffsetID = glGetUniformLocation(program.id, "posOffset");
+        program.posScaleID = glGetUniformLocation(program.id, "posScale");
+        program.nearID = glGetUniformLocation(program.id, "near");
+        program.farID = glGetUniformLocation(program.id, "far");
+    }
 }
 
 void ModelViewer::paintGL() {
     glClearColor(0, 0, 0.4f, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if(model) {
+    //every draw states what it needs, the cache drops what is already set
+    GLStateCache &gl = GLStateCache::instance();
+    gl.beginFrame();
+
+    if(streamQueue) uploadStreamBatches();
+    if(pageFile || (streamQueue ? streamVertexCount > 0 : model != 0)) {
         QMatrix4x4 mMVP = mProjection * mView * mModel;
+        if(pageFile) updatePages(mMVP);
         QMatrix4x4 invP = mProjection.inverted();
 
-        glUseProgram(shaderProgramID);
+        const ShaderProgram &program = programs[drawOutline ? OutlineProgram : FillProgram];
+        gl.useProgram(program.id);
         GLfloat mGLInvP[16], mGLMVP[16];
         qreal2glfloat(invP, mGLInvP);
         qreal2glfloat(mMVP, mGLMVP);
 
-        glUniformMatrix4fv(invpMatrixID, 1, GL_FALSE, mGLInvP);
-        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, mGLMVP);
-        glUniform1f(nearID, pNear);
-        glUniform1f(farID, pFar);
+        glUniformMatrix4fv(program.invpMatrixID, 1, GL_FALSE, mGLInvP);
+        glUniformMatrix4fv(program.mvpMatrixID, 1, GL_FALSE, mGLMVP);
+        glUniform1f(program.nearID, pNear);
+        glUniform1f(program.farID, pFar);
 
 //        setUniformMatrix(glUniformMatrix4fv, invpMatrixID, invP, 4, 4);
 //        setUniformMatrix(glUniformMatrix4fv, mvpMatrixID, mMVP, 4, 4);
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glUniform1i(drawOutlineID, 0);
-        glUniform1i(depthFillMethodID, depthFillMethod);
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-        glDisableVertexAttribArray(0);
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glUniform1i(drawOutlineID, 1);
-        glUniform3f(outlineColorID, (GLfloat)outlineColor.x(), (GLfloat)outlineColor.y(), (GLfloat)outlineColor.z());
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glEnable(GL_POLYGON_OFFSET_FILL);
-        glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-        glDisable(GL_POLYGON_OFFSET_FILL);
-        glDisableVertexAttribArray(0);
+        //the outline is blended into the fill from the barycentric coordinates, one pass draws both
+        glUniform1i(program.drawOutlineID, drawOutline ? 1 : 0);
+        glUniform1i(program.depthFillMethodID, depthFillMethod);
+        glUniform3f(program.outlineColorID, (GLfloat)outlineColor.x(), (GLfloat)outlineColor.y(), (GLfloat)outlineColor.z());
+        drawModel(program);
 
     }
 }
@@ -194,6 +279,7 @@ void ModelViewer::mouseMoveEvent(QMouseEvent *event) {
     mModel.rotate(hAngle, QVector3D(0, 1, 0));
 //    mModel.rotate(vAngle, QVector3D(cos(hAngle/180.0*M_PI) < 0 ? -1 : 1, 0, 0));
     mModel.rotate(vAngle, QVector3D(1, 0, 0));
+    mModel.translate(-modelCenter);
 
     update();
 
@@ -225,13 +311,197 @@ void ModelViewer::resetView() {
     hAngle = 0;
     vAngle = 0;
     fovVal = 45.0;
+    fitView();
+}
+
+void ModelViewer::fitView() {
+    //rotate around the center of the bounding sphere and back off until all of it is in view
+    modelCenter = QVector3D(0, 0, 0);
     zPos = 15;
+    const OBJBounds *bounds = pageFile ? &pageFile->bounds() : model && !streamQueue ? &model->bounds : 0;
+    if(bounds && !bounds->empty()) {
+        OBJVec3 c = bounds->center();
+        float r = bounds->radius();
+        modelCenter = QVector3D(c.x, c.y, c.z);
+        zPos = std::max((double)pNear, r / sin(fovVal / 2 * M_PI / 180.0));
+        if(zPos + r > pFar) {
+            pFar = std::min((double)(zPos + r), 1E3);
+            emit farPlaneChanged(pFar);
+        }
+    }
 
     mProjection.setToIdentity();
     mProjection.perspective(fovVal, (float)this->width() / (float)this->height(), pNear, pFar);
     mView.setToIdentity();
     mView.lookAt(QVector3D(0, 0, zPos), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
     mModel.setToIdentity();
+    mModel.rotate(hAngle, QVector3D(0, 1, 0));
+    mModel.rotate(vAngle, QVector3D(1, 0, 0));
+    mModel.translate(-modelCenter);
+}
+
+void ModelViewer::uploadStreamBatches() {
+    //append what the loader published since the last frame, the buffer grows geometrically
+    for(OBJStreamBatch *batch = streamQueue->pop(); batch; batch = streamQueue->pop()) {
+        GLuint count = batch->verts.size();
+        if(streamVertexCount + count > streamBufferCapacity) {
+            GLuint capacity = std::max(streamBufferCapacity * 2, streamVertexCount + count);
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(OBJVec3), 0, GL_DYNAMIC_DRAW);
+            if(streamVertexCount > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, streamBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, streamVertexCount * sizeof(OBJVec3));
+            }
+            glDeleteBuffers(1, &streamBuffer);
+            streamBuffer = buffer;
+            streamBufferCapacity = capacity;
+            GLStateCache::instance().bindVertexArray(streamArrayID);
+            glBindBuffer(GL_ARRAY_BUFFER, streamBuffer);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, streamBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, streamVertexCount * sizeof(OBJVec3), count * sizeof(OBJVec3), &batch->verts[0]);
+        streamVertexCount += count;
+        delete batch;
+    }
+}
+
+void ModelViewer::drawModel(const ShaderProgram &program) {
+    //while loading, the streamed triangles stand in for the welded mesh
+    if(pageFile) {
+        drawPages(program);
+    } else if(streamQueue) {
+        glUniform3f(program.posOffsetID, 0, 0, 0);
+        glUniform3f(program.posScaleID, 1, 1, 1);
+        GLStateCache::instance().bindVertexArray(streamArrayID);
+        glDrawArrays(GL_TRIANGLES, 0, streamVertexCount);
+    } else {
+        GLStateCache::instance().bindVertexArray(vertexArrayID);
+        glUniform3f(program.posOffsetID, (GLfloat)posOffset.x(), (GLfloat)posOffset.y(), (GLfloat)posOffset.z());
+        glUniform3f(program.posScaleID, (GLfloat)posScale.x(), (GLfloat)posScale.y(), (GLfloat)posScale.z());
+        int lod = selectLod();
+        GLsizei drawCount = lod < 0 ? indexBufferSize : model->mesh.lods[lod].count;
+        const GLvoid *drawOffset = (const GLvoid*)(lod < 0 ? 0 : (indexBufferSize + model->mesh.lods[lod].first) * sizeof(GLuint));
+        glDrawElements(GL_TRIANGLES, drawCount, GL_UNSIGNED_INT, drawOffset);
+    }
+}
+
+//requests the pages in view, nearest first, as far as they fit PAGE_GPU_BUDGET, and uploads those read since the last frame
+void ModelViewer::updatePages(const QMatrix4x4 &mvp) {
+    ++frameCount;
+    const std::vector<OBJPage> &pages = pageFile->pages();
+
+    //frustum planes in model space, straight from the rows of the combined matrix
+    QVector4D planes[6];
+    for(int i = 0; i < 3; ++i) {
+        planes[i * 2] = mvp.row(3) + mvp.row(i);
+        planes[i * 2 + 1] = mvp.row(3) - mvp.row(i);
+    }
+    QVector3D eye = (mView * mModel).inverted().map(QVector3D(0, 0, 0));
+
+    std::vector<std::pair<float, int> > visible;
+    for(size_t i = 0; i < pages.size(); ++i) {
+        const OBJPage &page = pages[i];
+        QVector3D center(page.center.x, page.center.y, page.center.z);
+        bool inside = true;
+        for(int p = 0; p < 6 && inside; ++p) {
+            inside = QVector3D::dotProduct(planes[p].toVector3D(), center) + planes[p].w() >= -page.radius * planes[p].toVector3D().length();
+        }
+        if(inside) visible.push_back(std::make_pair((center - eye).length() - page.radius, (int)i));
+    }
+    std::sort(visible.begin(), visible.end());
+
+    std::vector<bool> wanted(pages.size(), false);
+    std::vector<int> missing;
+    drawnPages.clear();
+    qint64 budget = PAGE_GPU_BUDGET;
+    for(std::vector<std::pair<float, int> >::const_iterator v = visible.begin(); v != visible.end(); ++v) {
+        budget -= pages[v->second].bytes();
+        if(budget < 0) break;
+        wanted[v->second] = true;
+        if(pageBuffers[v->second].vertexBuffer) {
+            pageBuffers[v->second].frame = frameCount;
+            drawnPages.push_back(v->second);
+        } else {
+            missing.push_back(v->second);
+        }
+    }
+
+    for(OBJPageData *data = pager->take(); data; data = pager->take()) {
+        if(wanted[data->page] && !pageBuffers[data->page].vertexBuffer) {
+            uploadPage(data, wanted);
+            if(pageBuffers[data->page].vertexBuffer) {
+                pageBuffers[data->page].frame = frameCount;
+                drawnPages.push_back(data->page);
+                missing.erase(std::find(missing.begin(), missing.end(), data->page));
+            }
+        }
+        delete data;
+    }
+    pager->request(missing);
+}
+
+void ModelViewer::uploadPage(OBJPageData *data, const std::vector<bool> &wanted) {
+    //make room by dropping the pages drawn longest ago, but never one that is wanted now
+    qint64 bytes = pageFile->pages()[data->page].bytes();
+    while(pageBytes + bytes > PAGE_GPU_BUDGET) {
+        int oldest = -1;
+        for(size_t i = 0; i < pageBuffers.size(); ++i) {
+            if(pageBuffers[i].vertexBuffer && !wanted[i] && (oldest < 0 || pageBuffers[i].frame < pageBuffers[oldest].frame)) oldest = i;
+        }
+        if(oldest < 0) return;
+        releasePage(oldest);
+    }
+
+    PageBuffers &buffers = pageBuffers[data->page];
+    glGenVertexArrays(1, &buffers.arrayID);
+    GLStateCache::instance().bindVertexArray(buffers.arrayID);
+    glGenBuffers(1, &buffers.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, data->verts.size() * sizeof(OBJVec3), &data->verts[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glGenBuffers(1, &buffers.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data->indices.size() * sizeof(GLushort), &data->indices[0], GL_STATIC_DRAW);
+    buffers.indexCount = data->indices.size();
+    pageBytes += bytes;
+}
+
+void ModelViewer::releasePage(int page) {
+    PageBuffers &buffers = pageBuffers[page];
+    if(!buffers.vertexBuffer) return;
+    glDeleteBuffers(1, &buffers.vertexBuffer);
+    glDeleteBuffers(1, &buffers.indexBuffer);
+    GLStateCache::instance().deleteVertexArrays(1, &buffers.arrayID);
+    buffers = PageBuffers();
+    pageBytes -= pageFile->pages()[page].bytes();
+}
+
+void ModelViewer::drawPages(const ShaderProgram &program) {
+    glUniform3f(program.posOffsetID, 0, 0, 0);
+    glUniform3f(program.posScaleID, 1, 1, 1);
+    for(std::vector<int>::const_iterator p = drawnPages.begin(); p != drawnPages.end(); ++p) {
+        const PageBuffers &buffers = pageBuffers[*p];
+        GLStateCache::instance().bindVertexArray(buffers.arrayID);
+        glDrawElements(GL_TRIANGLES, buffers.indexCount, GL_UNSIGNED_SHORT, (void*)0);
+    }
+}
+
+//the coarsest level whose error covers at most LOD_PIXEL_ERROR pixels where the model is closest
+int ModelViewer::selectLod() const {
+    const OBJBounds &b = model->bounds;
+    if(model->mesh.lods.empty() || b.empty()) return -1;
+    OBJVec3 c = b.center();
+    QMatrix4x4 mv = mView * mModel;
+    QVector3D center = mv.map(QVector3D(c.x, c.y, c.z));
+    float scale = mv.column(0).toVector3D().length();
+    float dist = qMax(-center.z() - b.radius() * scale, (float)pNear);
+    float pixelSize = 2.0 * dist * tan(fovVal * M_PI / 360.0) / qMax(height(), 1);
+    return model->mesh.selectLod(LOD_PIXEL_ERROR * pixelSize / scale);
 }
 
 QString ModelViewer::readFile(const QString &fileName) const {
@@ -245,29 +515,49 @@ QString ModelViewer::readFile(const QString &fileName) const {
     return result;
 }
 
-GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile) const {
+GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile, const QString &gshFile) const {
     std::string vertexShaderCode = readFile(vshFile).toStdString();
     const char *pVertexShaderCode = vertexShaderCode.c_str();
     GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertexShaderID, 1, &pVertexShaderCode, NULL);
     glCompileShader(vertexShaderID);
-    if(!checkStatus(vertexShaderID, GL_COMPILE_STATUS)) return 0;
+    //every stage is compiled before giving up, so each failing one reports its log
+    bool compiled = checkStatus(vertexShaderID, GL_COMPILE_STATUS);
 
     std::string fragmentShaderCode = readFile(fshFile).toStdString();
     const char *pFragmentShaderCode = fragmentShaderCode.c_str();
     GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragmentShaderID, 1, &pFragmentShaderCode, NULL);
     glCompileShader(fragmentShaderID);
-    if(!checkStatus(fragmentShaderID, GL_COMPILE_STATUS)) return 0;
+    compiled = checkStatus(fragmentShaderID, GL_COMPILE_STATUS) && compiled;
+
+    GLuint geometryShaderID = 0;
+    if(!gshFile.isEmpty()) {
+        std::string geometryShaderCode = readFile(gshFile).toStdString();
+        const char *pGeometryShaderCode = geometryShaderCode.c_str();
+        geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(geometryShaderID, 1, &pGeometryShaderCode, NULL);
+        glCompileShader(geometryShaderID);
+        compiled = checkStatus(geometryShaderID, GL_COMPILE_STATUS) && compiled;
+    }
 
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShaderID);
-    glAttachShader(shaderProgram, fragmentShaderID);
-    glLinkProgram(shaderProgram);
-    if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) return 0;
+    GLuint shaderProgram = 0;
+    if(compiled) {
+        shaderProgram = glCreateProgram();
+        glAttachShader(shaderProgram, vertexShaderID);
+        glAttachShader(shaderProgram, fragmentShaderID);
+        if(!gshFile.isEmpty()) glAttachShader(shaderProgram, geometryShaderID);
+        glLinkProgram(shaderProgram);
+        if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) {
+            glDeleteProgram(shaderProgram);
+            shaderProgram = 0;
+        }
+    }
 
+    //the shaders go whether the program was built or not
     glDeleteShader(vertexShaderID);
     glDeleteShader(fragmentShaderID);
+    if(!gshFile.isEmpty()) glDeleteShader(geometryShaderID);
     return shaderProgram;
 }
 
@@ -7,6 +7,17 @@
 #include <QMatrix4x4>
 
 #include "objmodel.h"
+#include "objpacker.h"
+#include "objpages.h"
+
+// Buffers of a page on the GPU, frame is the last one that drew it.
+struct PageBuffers {
+    PageBuffers() : vertexBuffer(0), indexBuffer(0), arrayID(0), indexCount(0), frame(0) {}
+
+    GLuint vertexBuffer, indexBuffer, arrayID;
+    GLsizei indexCount;
+    quint64 frame;
+};
 
 class ModelViewer : public QGLWidget {
     Q_OBJECT
@@ -16,16 +27,28 @@ public:
     ~ModelViewer();
 
     void setModel(OBJModel *m);
+    void beginStream(OBJStreamQueue *queue);
+    void endStream();
+    // draws the pages of file instead of a model, 0 switches back
+    void setPages(OBJPageFile *file);
     void setOutlineColor(double r, double g, double b);
 
+    // applies to the next setModel, streamed triangles stay in floats
+    void setPackedVertices(bool val) { packedVertices = val; }
+    // applies to the next setModel, which then frees the CPU copies of the model
+    void setGpuResident(bool val) { gpuResident = val; }
+
 signals:
     void nearPlaneChanged(double val);
     void farPlaneChanged(double val);
 
 public slots:
+    void setDrawOutline(bool val);
     void setFillMethod(int m);
     void setNearPlane(double val);
     void setFarPlane(double val);
+    void streamUpdated();
+    void pageLoaded();
 
 protected:
     void initializeGL();
@@ -37,23 +60,45 @@ protected:
     void wheelEvent(QWheelEvent *event);
 
 private:
+    enum ProgramType { FillProgram, OutlineProgram, ProgramCount };
+
+    struct ShaderProgram {
+        GLuint id, mvpMatrixID, invpMatrixID, drawOutlineID, depthFillMethodID, outlineColorID, posOffsetID, posScaleID, nearID, farID;
+    };
+
     QString readFile(const QString &fileName) const;
-    GLuint createShaders(const QString &vshFile, const QString &fshFile) const;
+    GLuint createShaders(const QString &vshFile, const QString &fshFile, const QString &gshFile = "") const;
     bool checkStatus(GLuint id, GLenum type, bool isShader = true) const;
     void resetView();
+    void fitView();
+    void uploadStreamBatches();
+    void drawModel(const ShaderProgram &program);
+    void updatePages(const QMatrix4x4 &mvp);
+    void uploadPage(OBJPageData *data, const std::vector<bool> &wanted);
+    void releasePage(int page);
+    void drawPages(const ShaderProgram &program);
+    int selectLod() const;
 
     OBJModel *model;
-    GLuint shaderProgramID, mvpMatrixID, invpMatrixID;
-    GLuint drawOutlineID, depthFillMethodID, outlineColorID;
-    GLuint vertexBuffer, vertexBufferSize, vertexArrayID;
-    GLuint nearID, farID;
+    ShaderProgram programs[ProgramCount];
+    GLuint vertexBuffer, indexBuffer, indexBufferSize, vertexArrayID;
+    OBJBufferRuns vertexRuns, indexRuns;
+    OBJStreamQueue *streamQueue;
+    GLuint streamBuffer, streamBufferCapacity, streamVertexCount, streamArrayID;
+    OBJPageFile *pageFile;
+    OBJPager *pager;
+    std::vector<PageBuffers> pageBuffers;
+    std::vector<int> drawnPages;
+    qint64 pageBytes;
+    quint64 frameCount;
     GLfloat pNear, pFar;
     QMatrix4x4 mProjection, mModel, mView;
-    QVector3D outlineColor;
+    QVector3D outlineColor, modelCenter, posOffset, posScale;
     QPoint lastMousePos;
     float hAngle, vAngle;
     float fovVal, zPos;
     int depthFillMethod;
+    bool drawOutline, packedVertices, gpuResident;
 };
 
 #endif // MODELVIEWER_H
@@ -0,0 +1,542 @@
+#include "objpages.h"
+#include "objcache.h"
+#include "objtokenizer.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define MAX_INDEX 0xffffffffu
+#define EMPTY_SLOT 0xffffffffu
+#define WRITE_BATCH_SIZE (1 << 16)
+#define PAGE_HASH_BITS 17
+#define GRID_MAX_BITS 6
+#define GRID_CELLS_PER_PAGE 8
+
+struct OBJPagesHeader {
+    char magic[4];
+    quint32 version;
+    qint64 sourceSize;
+    qint64 sourceTime;
+    quint64 triangleCount;
+    quint64 tableOffset;
+    quint64 pageCount;
+    OBJVec3 min, max;
+};
+
+struct OBJTriangleRecord {
+    quint32 cell;
+    GLuint v[3];
+};
+
+static const char pagesMagic[4] = {'O', 'B', 'J', 'P'};
+
+static qint64 sourceTime(const QString &sourcePath) {
+    return QFileInfo(sourcePath).lastModified().toMSecsSinceEpoch();
+}
+
+//spreads the low 10 bits of x to every third bit
+static inline quint32 part1By2(quint32 x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+static inline quint32 gridCoord(GLfloat v, GLfloat min, GLfloat max, int bits) {
+    GLfloat extent = max - min;
+    if(extent <= 0.0f) return 0;
+    int cells = 1 << bits;
+    int c = (int)((v - min) / extent * cells);
+    return (quint32)std::max(0, std::min(c, cells - 1));
+}
+
+template<class T> static bool writeVector(QFile &out, const std::vector<T> &data) {
+    if(data.empty()) return true;
+    qint64 size = data.size() * sizeof(T);
+    return out.write(reinterpret_cast<const char*>(&data[0]), size) == size;
+}
+
+/**************************************************************************************/
+
+OBJPageFile::OBJPageFile() : triangles(0) {
+}
+
+QString OBJPageFile::pagesPath(const QString &sourcePath) {
+    return OBJCache::sidecarPath(sourcePath, "pages");
+}
+
+bool OBJPageFile::open(const QString &sourcePath) {
+    QMutexLocker locker(&mutex);
+    file.close();
+    table.clear();
+    box.clear();
+    triangles = 0;
+
+    file.setFileName(pagesPath(sourcePath));
+    if(!file.open(QFile::ReadOnly)) return false;
+    qint64 fileSize = file.size();
+    OBJPagesHeader hdr;
+    bool valid = fileSize >= (qint64)sizeof(hdr) && file.read((char*)&hdr, sizeof(hdr)) == (qint64)sizeof(hdr)
+            && memcmp(hdr.magic, pagesMagic, sizeof(pagesMagic)) == 0 && hdr.version == OBJ_PAGES_VERSION
+            && hdr.sourceSize == QFileInfo(sourcePath).size() && hdr.sourceTime == sourceTime(sourcePath)
+            && hdr.tableOffset >= sizeof(hdr) && hdr.pageCount <= (quint64)(fileSize - hdr.tableOffset) / sizeof(OBJPage)
+            && hdr.tableOffset + hdr.pageCount * sizeof(OBJPage) == (quint64)fileSize;
+    if(valid) {
+        table.resize(hdr.pageCount);
+        qint64 tableSize = hdr.pageCount * sizeof(OBJPage);
+        valid = file.seek(hdr.tableOffset) && (table.empty() || file.read((char*)&table[0], tableSize) == tableSize);
+    }
+    //every page must lie within the data and refer only to its own vertices
+    for(std::vector<OBJPage>::const_iterator p = table.begin(); valid && p != table.end(); ++p) {
+        valid = p->vertexCount <= OBJ_PAGE_MAX_VERTICES && p->indexCount % 3 == 0 && p->offset >= sizeof(hdr)
+                && p->offset + p->bytes() <= hdr.tableOffset;
+    }
+    if(!valid) {
+        file.close();
+        table.clear();
+        return false;
+    }
+    box.add(hdr.min);
+    box.add(hdr.max);
+    triangles = hdr.triangleCount;
+    return true;
+}
+
+void OBJPageFile::close() {
+    QMutexLocker locker(&mutex);
+    file.close();
+    table.clear();
+    box.clear();
+    triangles = 0;
+}
+
+bool OBJPageFile::readPage(int index, OBJPageData &out) {
+    QMutexLocker locker(&mutex);
+    if(index < 0 || index >= (int)table.size()) return false;
+    const OBJPage &page = table[index];
+    out.page = index;
+    out.verts.resize(page.vertexCount);
+    out.indices.resize(page.indexCount);
+    qint64 vertSize = page.vertexCount * sizeof(OBJVec3);
+    qint64 indexSize = page.indexCount * sizeof(GLushort);
+    if(!file.seek(page.offset)) return false;
+    if(vertSize > 0 && file.read((char*)&out.verts[0], vertSize) != vertSize) return false;
+    if(indexSize > 0 && file.read((char*)&out.indices[0], indexSize) != indexSize) return false;
+    for(std::vector<GLushort>::const_iterator i = out.indices.begin(); i != out.indices.end(); ++i) {
+        if(*i >= page.vertexCount) return false;
+    }
+    return true;
+}
+
+/**************************************************************************************/
+
+OBJPageBuilder::OBJPageBuilder(QObject *parent) : QThread(parent), buildStatus(false), stopThread(false), buildError(""), filePath(""), vertexCount(0), gridBits(0), lastProgress(-1) {
+}
+
+void OBJPageBuilder::run() {
+    stopThread = false;
+    buildError = "";
+    lastProgress = -1;
+    buildStatus = build();
+}
+
+bool OBJPageBuilder::build() {
+    //pages built earlier for the same source are reused as they are
+    OBJPageFile existing;
+    if(existing.open(filePath)) return true;
+
+    QFile fileIn(filePath);
+    if(!fileIn.open(QFile::ReadOnly)) {
+        buildError = "unable to open model file";
+        return false;
+    }
+    qint64 fileSize = fileIn.size();
+    const char *data = fileSize > 0 ? (const char*)fileIn.map(0, fileSize) : 0;
+    if(!data) {
+        buildError = "unable to map model file";
+        return false;
+    }
+
+    //intermediate files go next to the result, the temp directory may be too small for them
+    QString pagesPath = OBJPageFile::pagesPath(filePath);
+    QFile positionFile(pagesPath + ".positions"), triangleFile(pagesPath + ".triangles");
+    QFile sortedFile(pagesPath + ".sorted"), out(pagesPath + ".part");
+    bounds.clear();
+    vertexCount = 0;
+
+    emit buildProgress(0);
+    quint64 triangleCount = 0;
+    std::vector<quint64> cells;
+    const OBJVec3 *positions = 0;
+    const GLuint *sorted = 0;
+    bool ok = positionFile.open(QFile::WriteOnly | QFile::Truncate) && writePositions(data, fileSize, positionFile, triangleCount);
+    positionFile.close();
+    if(ok && (vertexCount == 0 || triangleCount == 0)) {
+        buildError = "model has no triangles";
+        ok = false;
+    }
+    if(ok) {
+        //positions are read back through a mapping, so any of them can be looked up without holding them all
+        ok = positionFile.open(QFile::ReadOnly) && (positions = (const OBJVec3*)positionFile.map(0, vertexCount * sizeof(OBJVec3))) != 0;
+        if(!ok && buildError.isEmpty()) buildError = "unable to map vertex positions";
+    }
+    if(ok) {
+        //about GRID_CELLS_PER_PAGE cells per page keep the pages compact without a huge histogram
+        quint64 pageCount = (triangleCount + OBJ_PAGE_TRIANGLES - 1) / OBJ_PAGE_TRIANGLES;
+        for(gridBits = 0; gridBits < GRID_MAX_BITS && (1ull << (3 * gridBits)) < pageCount * GRID_CELLS_PER_PAGE; ++gridBits);
+        cells.assign((size_t)1 << (3 * gridBits), 0);
+        ok = triangleFile.open(QFile::WriteOnly | QFile::Truncate) && writeTriangles(data, fileSize, positions, triangleFile, cells);
+        triangleFile.close();
+    }
+    fileIn.close();
+    if(ok) {
+        ok = triangleFile.open(QFile::ReadOnly) && sortTriangles(triangleFile, cells, triangleCount, sortedFile);
+        triangleFile.close();
+    }
+    if(ok) {
+        ok = (sorted = (const GLuint*)sortedFile.map(0, triangleCount * 3 * sizeof(GLuint))) != 0;
+        if(!ok && buildError.isEmpty()) buildError = "unable to map sorted triangles";
+    }
+    if(ok) {
+        ok = out.open(QFile::WriteOnly | QFile::Truncate) && writePages(sorted, triangleCount, positions, out);
+        out.close();
+    }
+
+    positionFile.close();
+    sortedFile.close();
+    QFile::remove(positionFile.fileName());
+    QFile::remove(triangleFile.fileName());
+    QFile::remove(sortedFile.fileName());
+    if(ok) {
+        QFile::remove(pagesPath);
+        ok = QFile::rename(out.fileName(), pagesPath);
+    }
+    if(!ok) {
+        QFile::remove(out.fileName());
+        if(buildError.isEmpty() && !stopThread) buildError = "unable to write pages";
+        return false;
+    }
+    emit buildProgress(100);
+    return true;
+}
+
+//first pass: positions to a flat file, triangles are only counted
+bool OBJPageBuilder::writePositions(const char *data, qint64 size, QFile &out, quint64 &triangleCount) {
+    const char *p = data;
+    const char *end = data + size;
+    VertexVector batch;
+    batch.reserve(WRITE_BATCH_SIZE);
+    OBJVec3 v;
+    for(size_t line = 1; p != end; ++line) {
+        if(stopThread) return false;
+
+        p = skipBlanks(p, end);
+        const char *cmd = p;
+        while(p != end && !isBlank(*p) && *p != '\n') ++p;
+        size_t cmdLength = p - cmd;
+
+        if(cmdLength == 1 && cmd[0] == 'v') {
+            if(!parseFloat(p, end, v.x) || !parseFloat(p, end, v.y) || !parseFloat(p, end, v.z)) {
+                buildError = QString("unable to parse vertex at line %1\n").arg(line);
+                return false;
+            }
+            batch.push_back(v);
+            bounds.add(v);
+            if(batch.size() == WRITE_BATCH_SIZE) {
+                if(!writeVector(out, batch)) return false;
+                batch.clear();
+                progress(0, 30, p - data, size);
+            }
+        } else if(cmdLength == 1 && cmd[0] == 'f') {
+            size_t corners = 0;
+            for(p = skipBlanks(p, end); p != end && *p != '\n'; p = skipBlanks(p, end)) {
+                while(p != end && !isBlank(*p) && *p != '\n') ++p;
+                ++corners;
+            }
+            if(corners < 3) {
+                buildError = QString("unable to parse face at line %1\n").arg(line);
+                return false;
+            }
+            triangleCount += corners - 2;
+        }
+        p = skipLine(p, end);
+    }
+    vertexCount = bounds.count;
+    return writeVector(out, batch);
+}
+
+//second pass: every triangle with the grid cell of its centroid, which is counted for the sort
+bool OBJPageBuilder::writeTriangles(const char *data, qint64 size, const OBJVec3 *positions, QFile &out, std::vector<quint64> &cells) {
+    const char *p = data;
+    const char *end = data + size;
+    std::vector<OBJTriangleRecord> batch;
+    batch.reserve(WRITE_BATCH_SIZE);
+    quint64 seen = 0;
+    for(size_t line = 1; p != end; ++line) {
+        if(stopThread) return false;
+
+        p = skipBlanks(p, end);
+        const char *cmd = p;
+        while(p != end && !isBlank(*p) && *p != '\n') ++p;
+        size_t cmdLength = p - cmd;
+
+        if(cmdLength == 1 && cmd[0] == 'v') {
+            ++seen;
+        } else if(cmdLength == 1 && cmd[0] == 'f') {
+            //only the position of every corner matters, relative indices count back from the last vertex read
+            OBJTriangleRecord t;
+            size_t corners = 0;
+            for(p = skipBlanks(p, end); p != end && *p != '\n'; p = skipBlanks(p, end), ++corners) {
+                bool relative = skipChar(p, end, '-');
+                size_t val = 0;
+                if(!parseIndex(p, end, val) || val == 0 || val > MAX_INDEX || (relative && val > seen) || (!relative && val > vertexCount)) {
+                    buildError = QString("index out of bound at line %1\n").arg(line);
+                    return false;
+                }
+                GLuint index = (GLuint)(relative ? seen - val : val - 1);
+                while(p != end && !isBlank(*p) && *p != '\n') ++p;
+
+                if(corners < 2) {
+                    t.v[corners] = index;
+                    continue;
+                }
+                t.v[2] = index;
+                const OBJVec3 &a = positions[t.v[0]], &b = positions[t.v[1]], &c = positions[t.v[2]];
+                t.cell = part1By2(gridCoord((a.x + b.x + c.x) / 3.0f, bounds.min.x, bounds.max.x, gridBits))
+                        | (part1By2(gridCoord((a.y + b.y + c.y) / 3.0f, bounds.min.y, bounds.max.y, gridBits)) << 1)
+                        | (part1By2(gridCoord((a.z + b.z + c.z) / 3.0f, bounds.min.z, bounds.max.z, gridBits)) << 2);
+                ++cells[t.cell];
+                batch.push_back(t);
+                t.v[1] = t.v[2];
+                if(batch.size() == WRITE_BATCH_SIZE) {
+                    if(!writeVector(out, batch)) return false;
+                    batch.clear();
+                    progress(30, 60, p - data, size);
+                }
+            }
+        }
+        p = skipLine(p, end);
+    }
+    return writeVector(out, batch);
+}
+
+//third pass: a counting sort by cell, scattering the triangles straight into a mapped file
+bool OBJPageBuilder::sortTriangles(QFile &in, std::vector<quint64> &cells, quint64 triangleCount, QFile &out) {
+    quint64 start = 0;
+    for(std::vector<quint64>::iterator c = cells.begin(); c != cells.end(); ++c) {
+        quint64 count = *c;
+        *c = start;
+        start += count;
+    }
+
+    qint64 sortedSize = triangleCount * 3 * sizeof(GLuint);
+    GLuint *sorted = 0;
+    if(!out.open(QFile::ReadWrite | QFile::Truncate) || !out.resize(sortedSize) || !(sorted = (GLuint*)out.map(0, sortedSize))) {
+        buildError = "unable to map sorted triangles";
+        return false;
+    }
+    std::vector<OBJTriangleRecord> batch(WRITE_BATCH_SIZE);
+    quint64 done = 0;
+    while(done < triangleCount) {
+        if(stopThread) return false;
+        qint64 count = std::min<quint64>(WRITE_BATCH_SIZE, triangleCount - done);
+        qint64 bytes = count * sizeof(OBJTriangleRecord);
+        if(in.read((char*)&batch[0], bytes) != bytes) return false;
+        for(qint64 i = 0; i < count; ++i) {
+            const OBJTriangleRecord &t = batch[i];
+            quint64 slot = cells[t.cell]++;
+            if(slot >= triangleCount) return false;
+            memcpy(sorted + slot * 3, t.v, sizeof(t.v));
+        }
+        done += count;
+        progress(60, 80, done, triangleCount);
+    }
+    out.unmap((uchar*)sorted);
+    return true;
+}
+
+//last pass: runs of sorted triangles become pages, each with its own copy of the vertices it uses
+bool OBJPageBuilder::writePages(const GLuint *sorted, quint64 triangleCount, const OBJVec3 *positions, QFile &out) {
+    OBJPagesHeader hdr = OBJPagesHeader();
+    if(out.write((const char*)&hdr, sizeof(hdr)) != (qint64)sizeof(hdr)) return false;
+
+    std::vector<OBJPage> table;
+    std::vector<GLuint> slotKeys((size_t)1 << PAGE_HASH_BITS, EMPTY_SLOT);
+    std::vector<GLushort> slotValues(slotKeys.size());
+    std::vector<GLuint> used;
+    VertexVector verts;
+    std::vector<GLushort> indices;
+    quint64 offset = sizeof(hdr);
+    for(quint64 t = 0; t <= triangleCount; ++t) {
+        if(stopThread) return false;
+
+        //a page ends when it is full or the next triangle may not fit its 16-bit indices
+        bool last = t == triangleCount;
+        if(last || indices.size() == OBJ_PAGE_TRIANGLES * 3 || verts.size() + 3 > OBJ_PAGE_MAX_VERTICES) {
+            if(!indices.empty()) {
+                OBJBounds pageBounds;
+                for(VertexVector::const_iterator v = verts.begin(); v != verts.end(); ++v) pageBounds.add(*v);
+                OBJPage page;
+                page.center = pageBounds.center();
+                page.radius = pageBounds.radius();
+                page.offset = offset;
+                page.vertexCount = verts.size();
+                page.indexCount = indices.size();
+                if(indices.size() % 2) indices.push_back(0);    //keeps the next page 4-byte aligned
+                if(!writeVector(out, verts) || !writeVector(out, indices)) return false;
+                offset += verts.size() * sizeof(OBJVec3) + indices.size() * sizeof(GLushort);
+                table.push_back(page);
+
+                for(std::vector<GLuint>::const_iterator u = used.begin(); u != used.end(); ++u) slotKeys[*u] = EMPTY_SLOT;
+                used.clear();
+                verts.clear();
+                indices.clear();
+                progress(80, 100, t, triangleCount);
+            }
+            if(last) break;
+        }
+
+        for(int c = 0; c < 3; ++c) {
+            GLuint v = sorted[t * 3 + c];
+            GLuint slot = (v * 2654435761u) >> (32 - PAGE_HASH_BITS);
+            while(slotKeys[slot] != EMPTY_SLOT && slotKeys[slot] != v) slot = (slot + 1) & (slotKeys.size() - 1);
+            if(slotKeys[slot] == EMPTY_SLOT) {
+                slotKeys[slot] = v;
+                slotValues[slot] = (GLushort)verts.size();
+                used.push_back(slot);
+                verts.push_back(positions[v]);
+            }
+            indices.push_back(slotValues[slot]);
+        }
+    }
+
+    //the header goes in last, so that an interrupted build never looks valid
+    hdr.tableOffset = offset;
+    if(!writeVector(out, table)) return false;
+    memcpy(hdr.magic, pagesMagic, sizeof(pagesMagic));
+    hdr.version = OBJ_PAGES_VERSION;
+    hdr.sourceSize = QFileInfo(filePath).size();
+    hdr.sourceTime = sourceTime(filePath);
+    hdr.triangleCount = triangleCount;
+    hdr.pageCount = table.size();
+    hdr.min = bounds.min;
+    hdr.max = bounds.max;
+    return out.seek(0) && out.write((const char*)&hdr, sizeof(hdr)) == (qint64)sizeof(hdr);
+}
+
+void OBJPageBuilder::progress(int from, int to, quint64 done, quint64 total) {
+    int val = total > 0 ? from + (int)((to - from) * (double)done / total) : from;
+    if(val != lastProgress) {
+        lastProgress = val;
+        emit buildProgress(val);
+    }
+}
+
+/**************************************************************************************/
+
+OBJPager::OBJPager(QObject *parent) : QThread(parent), file(0), readyBytes(0), stopThread(false) {
+}
+
+OBJPager::~OBJPager() {
+    stop();
+    clear();
+}
+
+void OBJPager::setFile(OBJPageFile *f) {
+    stop();
+    clear();
+    file = f;
+    if(file) {
+        stopThread = false;
+        start();
+    }
+}
+
+void OBJPager::request(const std::vector<int> &pages) {
+    QMutexLocker locker(&mutex);
+    std::vector<int> sortedPages(pages);
+    std::sort(sortedPages.begin(), sortedPages.end());
+
+    //keep what is read already and still wanted, and don't read it twice
+    std::deque<OBJPageData*> kept;
+    std::vector<int> have;
+    for(std::deque<OBJPageData*>::iterator r = ready.begin(); r != ready.end(); ++r) {
+        if(std::binary_search(sortedPages.begin(), sortedPages.end(), (*r)->page)) {
+            kept.push_back(*r);
+            have.push_back((*r)->page);
+        } else {
+            readyBytes -= file->pages()[(*r)->page].bytes();
+            delete *r;
+        }
+    }
+    ready.swap(kept);
+    std::sort(have.begin(), have.end());
+
+    wanted.clear();
+    for(std::vector<int>::const_iterator p = pages.begin(); p != pages.end(); ++p) {
+        if(!std::binary_search(have.begin(), have.end(), *p)) wanted.push_back(*p);
+    }
+    wake.wakeAll();
+}
+
+OBJPageData *OBJPager::take() {
+    QMutexLocker locker(&mutex);
+    if(ready.empty()) return 0;
+    OBJPageData *data = ready.front();
+    ready.pop_front();
+    readyBytes -= file->pages()[data->page].bytes();
+    wake.wakeAll();
+    return data;
+}
+
+void OBJPager::run() {
+    mutex.lock();
+    for(;;) {
+        while(!stopThread && (wanted.empty() || readyBytes >= OBJ_PAGER_CPU_BUDGET)) wake.wait(&mutex);
+        if(stopThread) break;
+        int page = wanted.front();
+        wanted.erase(wanted.begin());
+        mutex.unlock();
+
+        OBJPageData *data = new OBJPageData();
+        bool loaded = file->readPage(page, *data);
+
+        mutex.lock();
+        if(!loaded || stopThread) {
+            delete data;
+            continue;
+        }
+        //a newer request may have asked for the page again while it was read
+        std::vector<int>::iterator again = std::find(wanted.begin(), wanted.end(), page);
+        if(again != wanted.end()) wanted.erase(again);
+        ready.push_back(data);
+        readyBytes += file->pages()[page].bytes();
+        mutex.unlock();
+        emit pageLoaded();
+        mutex.lock();
+    }
+    mutex.unlock();
+}
+
+void OBJPager::stop() {
+    mutex.lock();
+    stopThread = true;
+    wake.wakeAll();
+    mutex.unlock();
+    wait();
+}
+
+void OBJPager::clear() {
+    QMutexLocker locker(&mutex);
+    for(std::deque<OBJPageData*>::iterator r = ready.begin(); r != ready.end(); ++r) delete *r;
+    ready.clear();
+    wanted.clear();
+    readyBytes = 0;
+}
@@ -0,0 +1,140 @@
+#ifndef OBJPAGES_H
+#define OBJPAGES_H
+
+#include "objmodel.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+
+#define OBJ_PAGES_VERSION 1
+#define OBJ_PAGE_TRIANGLES 32768
+#define OBJ_PAGE_MAX_VERTICES 65535
+#define OBJ_PAGER_CPU_BUDGET (64 << 20)
+
+// Out-of-core form of an OBJ file, stored next to the source as "<file>.pages".
+// Triangles are sorted along a Morton curve over a grid of their centroids and cut into
+// pages of up to OBJ_PAGE_TRIANGLES, so that every page covers a compact piece of the
+// surface. A page holds its own positions and 16-bit indices and is read with one seek;
+// only the page table stays in memory. Texture coordinates and normals are dropped.
+
+struct OBJPage {
+    OBJVec3 center;
+    GLfloat radius;
+    quint64 offset;
+    quint32 vertexCount, indexCount;
+
+    qint64 bytes() const { return (qint64)vertexCount * sizeof(OBJVec3) + (qint64)indexCount * sizeof(GLushort); }
+};
+
+struct OBJPageData {
+    int page;
+    VertexVector verts;
+    std::vector<GLushort> indices;
+};
+
+class OBJPageFile {
+public:
+    OBJPageFile();
+
+    // opens the pages built for sourcePath, fails if there are none or the source changed since
+    bool open(const QString &sourcePath);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+
+    // safe to call from any thread
+    bool readPage(int index, OBJPageData &out);
+
+    const std::vector<OBJPage> &pages() const { return table; }
+    const OBJBounds &bounds() const { return box; }
+    quint64 triangleCount() const { return triangles; }
+
+    static QString pagesPath(const QString &sourcePath);
+
+private:
+    QFile file;
+    QMutex mutex;
+    std::vector<OBJPage> table;
+    OBJBounds box;
+    quint64 triangles;
+
+    OBJPageFile(const OBJPageFile&);
+    OBJPageFile& operator=(const OBJPageFile&);
+};
+
+//----------------------------------------------------------------------------------------
+
+// Converts an OBJ file into pages in four streaming passes, none of which holds more than
+// one page and the grid histogram in memory: positions are copied out to a flat file,
+// triangles are keyed by their grid cell, sorted by a counting sort on disk and cut into pages.
+// Faces with more than three corners are split into fans.
+
+class OBJPageBuilder : public QThread {
+    Q_OBJECT
+
+public:
+    OBJPageBuilder(QObject *parent = 0);
+    void setFileName(const QString &fp) { filePath = fp; }
+    QString fileName() const { return filePath; }
+
+    bool buildStatus;
+    volatile bool stopThread;
+    QString buildError;
+
+signals:
+    void buildProgress(int val);
+
+private:
+    void run();
+    bool build();
+    bool writePositions(const char *data, qint64 size, QFile &out, quint64 &triangleCount);
+    bool writeTriangles(const char *data, qint64 size, const OBJVec3 *positions, QFile &out, std::vector<quint64> &cells);
+    bool sortTriangles(QFile &in, std::vector<quint64> &cells, quint64 triangleCount, QFile &out);
+    bool writePages(const GLuint *sorted, quint64 triangleCount, const OBJVec3 *positions, QFile &out);
+    void progress(int from, int to, quint64 done, quint64 total);
+
+    QString filePath;
+    OBJBounds bounds;
+    quint64 vertexCount;
+    int gridBits, lastProgress;
+};
+
+//----------------------------------------------------------------------------------------
+
+// Reads requested pages on its own thread, most wanted first. Pages read but not taken yet
+// are held up to OBJ_PAGER_CPU_BUDGET bytes, the thread waits for take() beyond that.
+
+class OBJPager : public QThread {
+    Q_OBJECT
+
+public:
+    OBJPager(QObject *parent = 0);
+    ~OBJPager();
+
+    // stops reading, drops everything pending and switches to file (or to nothing)
+    void setFile(OBJPageFile *f);
+
+    // replaces the previous request; pages read meanwhile that are no longer wanted are dropped
+    void request(const std::vector<int> &pages);
+
+    // the next page read, 0 if none is ready; the caller owns it
+    OBJPageData *take();
+
+signals:
+    void pageLoaded();
+
+private:
+    void run();
+    void stop();
+    void clear();
+
+    OBJPageFile *file;
+    QMutex mutex;
+    QWaitCondition wake;
+    std::vector<int> wanted;
+    std::deque<OBJPageData*> ready;
+    qint64 readyBytes;
+    bool stopThread;
+};
+
+#endif // OBJPAGES_H
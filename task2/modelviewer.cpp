@@ -1,4 +1,5 @@
 #include "modelviewer.h"
+#include "glstatecache.h"
 
 #include <QFile>
 #include <QMouseEvent>
@@ -42,48 +43,53 @@ ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new
     drawOutline = true;
     drawMipLevels = false;
     drawRealMipmap = false;
+    packedVertices = true;
+    gpuResident = false;
 }
 
 ModelViewer::~ModelViewer() {
     model = 0;
     glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteTextures(1, &textureID);
-    glDeleteTextures(1, &mipmapTextureID);
-    glDeleteProgram(shaderProgramID);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    glDeleteBuffers(1, &indexBuffer);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.deleteTextures(1, &textureID);
+    gl.deleteTextures(1, &mipmapTextureID);
+    for(int i = 0; i < ProgramCount; ++i) gl.deleteProgram(programs[i].id);
+    gl.deleteVertexArrays(1, &vertexArrayID);
 }
 
 void ModelViewer::setModel(OBJModel *m) {
-    if(model) {
-        glDeleteBuffers(1, &vertexBuffer);
-        glDeleteBuffers(1, &uvBuffer);
-        glDeleteTextures(1, &textureID);
-    }
-
-    std::vector<OBJVec3> vs, ns;
-    std::vector<OBJVec2> ts;
-    for(std::vector<OBJFace>::iterator fi = m->faces.begin(); fi != m->faces.end(); ++fi) {
-        for(OBJFace::iterator fii = fi->begin(); fii != fi->end(); ++fii) {
-            if(fii->n != 0) ns.push_back(m->norms[fii->n - 1]);
-            if(fii->t != 0) ts.push_back(OBJVec2(m->texs[fii->t - 1].x, m->texs[fii->t - 1].y));
-            vs.push_back(m->verts[fii->v - 1]);
+    //a reloaded model keeps its buffers, only the runs that changed are written again;
+    //a model loaded from another file, even into the same object, starts over
+    bool reloaded = m == model && m->reloaded();
+    GLStateCache &gl = GLStateCache::instance();
+    if(model) gl.deleteTextures(1, &textureID);
+    if(!reloaded) {
+        if(model) {
+            glDeleteBuffers(1, &vertexBuffer);
+            glDeleteBuffers(1, &indexBuffer);
         }
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        vertexRuns.reset();
+        indexRuns.reset();
     }
 
-    //assume there is only triangles in the model
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vs.size() * sizeof(OBJVec3), &vs[0], GL_STATIC_DRAW);
-    vertexBufferSize = vs.size();
+    //one vertex per distinct corner of the welded mesh, the vertex array keeps the buffers and the layout
+    gl.bindVertexArray(vertexArrayID);
+    const OBJVertexPacker::Attribute which[2] = { OBJVertexPacker::Positions, OBJVertexPacker::TexCoords };
+    OBJAttribute attrs[2];
+    OBJVertexPacker::positionTransform(*m, packedVertices, posOffset, posScale);
+    OBJVertexPacker::upload(*m, which, attrs, 2, packedVertices, vertexBuffer, vertexRuns);
+    attrs[0].setPointer(0);
+    attrs[1].setPointer(1);
 
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, ts.size() * sizeof(OBJVec2), &ts[0], GL_STATIC_DRAW);
+    indexBufferSize = m->mesh.indices.size();
+    OBJVertexPacker::uploadIndices(m->mesh, indexBuffer, indexRuns);
 
     //assume that the model always has a texture
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    gl.bindTexture(0, GL_TEXTURE_2D, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, m->texture.width(), m->texture.height(), 0, GL_RGB, GL_UNSIGNED_BYTE, m->texture.bits());
     glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -95,17 +101,20 @@ void ModelViewer::setModel(OBJModel *m) {
 
     generateRealMipmap(m->texture.width(), m->texture.height());
 
+    if(gpuResident) m->releaseGeometry();
+
     model = m;
-    resetView();
+    if(!reloaded) resetView();
     update();
 }
 
 void ModelViewer::generateRealMipmap(int w, int h) {
+    GLStateCache &gl = GLStateCache::instance();
     if(model) {
-        glDeleteTextures(1, &mipmapTextureID);
+        gl.deleteTextures(1, &mipmapTextureID);
     }
     glGenTextures(1, &mipmapTextureID);
-    glBindTexture(GL_TEXTURE_2D, mipmapTextureID);
+    gl.bindTexture(0, GL_TEXTURE_2D, mipmapTextureID);
     int i = 0;
     float maxLevels = log2(qMax(w, h));
     int step = 255 / maxLevels;
@@ -158,8 +167,7 @@ void ModelViewer::setDrawMipLevels(bool val) {
 
 void ModelViewer::setDrawRealMipmap(bool val) {
     drawRealMipmap = val;
-    if(val) glBindTexture(GL_TEXTURE_2D, mipmapTextureID);
-    else glBindTexture(GL_TEXTURE_2D, textureID);
+    GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, val ? mipmapTextureID : textureID);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFiltering);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFiltering);
     update();
@@ -183,22 +191,29 @@ void ModelViewer::initializeGL() {
 
     std::cout << "OpenGL initialized: GL version "<< glGetString(GL_VERSION) << " | GLSL "<< glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.reset();
+    gl.enable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
 //    glEnable(GL_CULL_FACE);
-    glPolygonOffset(-1.0, -1.0);
 
-    shaderProgramID = createShaders(":/shaders/vertexShader.vsh", ":/shaders/fragmentShader.fsh");
+    //the geometry shader only supplies the barycentric coordinates of the outline, a plain fill goes without it
+    programs[FillProgram].id = createShaders(":/shaders/vertexShader.vsh", ":/shaders/fragmentShader.fsh");
+    programs[OutlineProgram].id = createShaders(":/shaders/vertexShader.vsh", ":/shaders/fragmentShader.fsh", ":/shaders/geometryShader.geom");
 
     glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
 
-    mvpMatrixID = glGetUniformLocation(shaderProgramID, "MVP");
-    drawOutlineID = glGetUniformLocation(shaderProgramID, "drawOutline");
-    outlineColorID = glGetUniformLocation(shaderProgramID, "outlineColor");
-    samplerID = glGetUniformLocation(shaderProgramID, "texSampler");
-    uvMulID = glGetUniformLocation(shaderProgramID, "uvMul");
-    drawMipLevelsID = glGetUniformLocation(shaderProgramID, "drawMipLevels");
+    for(int p = 0; p < ProgramCount; ++p) {
+        ShaderProgram &program = programs[p];
+        program.mvpMatrixID = glGetUniformLocation(program.id, "MVP");
+        program.drawOutlineID = glGetUniformLocation(program.id, "drawOutline");
+        program.outlineColorID = glGetUniformLocation(program.id, "outlineColor");
+        program.samplerID = glGetUniformLocation(program.id, "texSampler");
+        program.uvMulID = glGetUniformLocation(program.id, "uvMul");
+        program.posOffsetID = glGetUniformLocation(program.id, "posOffset");
+        program.posScaleID = glGetUniformLocation(program.id, "posScale");
+        program.drawMipLevelsID = glGetUniformLocation(program.id, "drawMipLevels");
+    }
 
 //    generateRealMipmap(225, 225);
 }
@@ -207,46 +222,32 @@ void ModelViewer::paintGL() {
     glClearColor(0, 0, 0.4f, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    //every draw states what it needs, the cache drops what is already set
+    GLStateCache &gl = GLStateCache::instance();
+    gl.beginFrame();
+
     if(model) {
         QMatrix4x4 mMVP = mProjection * mView * mModel;
         GLfloat mGLMVP[16];
         qreal2glfloat(mMVP, mGLMVP);
 
-        glUseProgram(shaderProgramID);
-        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, mGLMVP);
-
-        glActiveTexture(GL_TEXTURE0);
-        if(drawRealMipmap) glBindTexture(GL_TEXTURE_2D, mipmapTextureID);
-        else glBindTexture(GL_TEXTURE_2D, textureID);
-        glUniform1i(samplerID, 0);
-
-        glUniform1f(uvMulID, uvMul);
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glUniform1i(drawOutlineID, 0);
-        glUniform1i(drawMipLevelsID, isDrawMipLevelsEnabled());
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-
-        if(drawOutline) {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            glUniform1i(drawOutlineID, 1);
-            glUniform3f(outlineColorID, (GLfloat)outlineColor.x(), (GLfloat)outlineColor.y(), (GLfloat)outlineColor.z());
-            glEnableVertexAttribArray(0);
-            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-            glEnable(GL_POLYGON_OFFSET_FILL);
-            glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-            glDisable(GL_POLYGON_OFFSET_FILL);
-            glDisableVertexAttribArray(0);
-        }
+        const ShaderProgram &program = programs[drawOutline ? OutlineProgram : FillProgram];
+        gl.useProgram(program.id);
+        glUniformMatrix4fv(program.mvpMatrixID, 1, GL_FALSE, mGLMVP);
+
+        gl.bindTexture(0, GL_TEXTURE_2D, drawRealMipmap ? mipmapTextureID : textureID);
+        glUniform1i(program.samplerID, 0);
+
+        glUniform1f(program.uvMulID, uvMul);
+        glUniform3f(program.posOffsetID, (GLfloat)posOffset.x(), (GLfloat)posOffset.y(), (GLfloat)posOffset.z());
+        glUniform3f(program.posScaleID, (GLfloat)posScale.x(), (GLfloat)posScale.y(), (GLfloat)posScale.z());
+
+        //the outline is blended into the fill from the barycentric coordinates, one pass draws both
+        glUniform1i(program.drawOutlineID, drawOutline ? 1 : 0);
+        glUniform3f(program.outlineColorID, (GLfloat)outlineColor.x(), (GLfloat)outlineColor.y(), (GLfloat)outlineColor.z());
+        glUniform1i(program.drawMipLevelsID, isDrawMipLevelsEnabled());
+        gl.bindVertexArray(vertexArrayID);
+        glDrawElements(GL_TRIANGLES, indexBufferSize, GL_UNSIGNED_INT, 0);
     }
 }
 
@@ -321,29 +322,49 @@ QString ModelViewer::readFile(const QString &fileName) const {
     return result;
 }
 
-GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile) const {
+GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile, const QString &gshFile) const {
     std::string vertexShaderCode = readFile(vshFile).toStdString();
     const char *pVertexShaderCode = vertexShaderCode.c_str();
     GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertexShaderID, 1, &pVertexShaderCode, NULL);
     glCompileShader(vertexShaderID);
-    if(!checkStatus(vertexShaderID, GL_COMPILE_STATUS)) return 0;
+    //every stage is compiled before giving up, so each failing one reports its log
+    bool compiled = checkStatus(vertexShaderID, GL_COMPILE_STATUS);
 
     std::string fragmentShaderCode = readFile(fshFile).toStdString();
     const char *pFragmentShaderCode = fragmentShaderCode.c_str();
     GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragmentShaderID, 1, &pFragmentShaderCode, NULL);
     glCompileShader(fragmentShaderID);
-    if(!checkStatus(fragmentShaderID, GL_COMPILE_STATUS)) return 0;
+    compiled = checkStatus(fragmentShaderID, GL_COMPILE_STATUS) && compiled;
+
+    GLuint geometryShaderID = 0;
+    if(!gshFile.isEmpty()) {
+        std::string geometryShaderCode = readFile(gshFile).toStdString();
+        const char *pGeometryShaderCode = geometryShaderCode.c_str();
+        geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(geometryShaderID, 1, &pGeometryShaderCode, NULL);
+        glCompileShader(geometryShaderID);
+        compiled = checkStatus(geometryShaderID, GL_COMPILE_STATUS) && compiled;
+    }
 
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShaderID);
-    glAttachShader(shaderProgram, fragmentShaderID);
-    glLinkProgram(shaderProgram);
-    if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) return 0;
+    GLuint shaderProgram = 0;
+    if(compiled) {
+        shaderProgram = glCreateProgram();
+        glAttachShader(shaderProgram, vertexShaderID);
+        glAttachShader(shaderProgram, fragmentShaderID);
+        if(!gshFile.isEmpty()) glAttachShader(shaderProgram, geometryShaderID);
+        glLinkProgram(shaderProgram);
+        if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) {
+            glDeleteProgram(shaderProgram);
+            shaderProgram = 0;
+        }
+    }
 
+    //the shaders go whether the program was built or not
     glDeleteShader(vertexShaderID);
     glDeleteShader(fragmentShaderID);
+    if(!gshFile.isEmpty()) glDeleteShader(geometryShaderID);
     return shaderProgram;
 }
 
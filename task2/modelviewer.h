@@ -7,6 +7,7 @@
 #include <QMatrix4x4>
 
 #include "objmodel.h"
+#include "objpacker.h"
 
 class ModelViewer : public QGLWidget {
     Q_OBJECT
@@ -17,6 +18,11 @@ public:
 
     void setModel(OBJModel *m);
 
+    // applies to the next setModel
+    void setPackedVertices(bool val) { packedVertices = val; }
+    // applies to the next setModel, which then frees the CPU copies of the model and its texture
+    void setGpuResident(bool val) { gpuResident = val; }
+
 signals:
     void uvMultiplierChanged(double val);
 
@@ -38,27 +44,32 @@ protected:
     void wheelEvent(QWheelEvent *event);
 
 private:
+    enum ProgramType { FillProgram, OutlineProgram, ProgramCount };
+
+    struct ShaderProgram {
+        GLuint id, mvpMatrixID, samplerID, drawOutlineID, outlineColorID, uvMulID, posOffsetID, posScaleID, drawMipLevelsID;
+    };
+
     QString readFile(const QString &fileName) const;
-    GLuint createShaders(const QString &vshFile, const QString &fshFile) const;
+    GLuint createShaders(const QString &vshFile, const QString &fshFile, const QString &gshFile = "") const;
     bool checkStatus(GLuint id, GLenum type, bool isShader = true) const;
     void resetView();
     int isDrawMipLevelsEnabled() const;
     void generateRealMipmap(int w, int h);
 
     OBJModel *model;
-    GLuint shaderProgramID, mvpMatrixID, samplerID, textureID, mipmapTextureID;
-    GLuint drawOutlineID, outlineColorID, uvMulID;
-    GLuint vertexBuffer, vertexBufferSize, vertexArrayID;
-    GLuint uvBuffer;
-    GLuint drawMipLevelsID;
+    ShaderProgram programs[ProgramCount];
+    GLuint textureID, mipmapTextureID;
+    GLuint vertexBuffer, indexBuffer, indexBufferSize, vertexArrayID;
+    OBJBufferRuns vertexRuns, indexRuns;
     GLint minFiltering, magFiltering;
     GLfloat pNear, pFar, uvMul;
     QMatrix4x4 mProjection, mModel, mView;
-    QVector3D outlineColor;
+    QVector3D outlineColor, posOffset, posScale;
     QPoint lastMousePos;
     float hAngle, vAngle;
     float fovVal, zPos;
-    bool drawOutline, drawMipLevels, drawRealMipmap;
+    bool drawOutline, drawMipLevels, drawRealMipmap, packedVertices, gpuResident;
 
 };
 
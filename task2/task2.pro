@@ -11,15 +11,16 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = task2
 TEMPLATE = app
 
+include(../common/common.pri)
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    objmodel.cpp \
+    $$COMMON/objpacker.cpp \
     modelviewer.cpp \
     colorpicker.cpp
 
 HEADERS  += mainwindow.h \
-    objmodel.h \
+    $$COMMON/objpacker.h \
     modelviewer.h \
     colorpicker.h
 
@@ -35,4 +36,5 @@ RESOURCES += \
 
 OTHER_FILES += \
     vertexShader.vsh \
-    fragmentShader.fsh
+    fragmentShader.fsh \
+    geometryShader.geom
@@ -6,6 +6,8 @@
 #include <QHBoxLayout>
 #include <QMessageBox>
 #include <QLabel>
+#include <QStatusBar>
+#include <QPushButton>
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     QGLFormat glFormat;
@@ -17,18 +19,23 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     viewer->setDrawOutline(false);
 
     model = new OBJModel(this);
-    model->loadModel(":/models/bunny_n.obj");
-    connect(model, SIGNAL(loadStatus(bool)), this, SLOT(showModel(bool)));
-
+    model->setLodEnabled(true);
+    model->setNormalsEnabled(true);
+    model->setClustersEnabled(true);
+    model->setBvhEnabled(true);
     lightModel = new OBJModel(this);
-    lightModel->loadModel(":/models/cone.obj");
-    connect(lightModel, SIGNAL(loadStatus(bool)), this, SLOT(showModel(bool)));
+    lightModel->setNormalsEnabled(true);
+    assets = new AssetLoader(this);
+    connect(assets, SIGNAL(allLoaded(bool)), this, SLOT(showModel(bool)));
+    assets->loadModel(model, ":/models/bunny_n.obj");
+    assets->loadModel(lightModel, ":/models/cone.obj");
 
     cbShading = new QComboBox(this);
     cbShading->addItem("Phong");
     cbShading->addItem("Blinn-Phong");
     cbShading->setCurrentIndex(0);
     connect(cbShading, SIGNAL(currentIndexChanged(int)), viewer, SLOT(setShadingMethod(int)));
+    connect(viewer, SIGNAL(pointPicked(QVector3D,int)), this, SLOT(showPickedPoint(QVector3D,int)));
 
     cbFill = new QComboBox(this);
     cbFill->addItem("flat");
@@ -105,6 +112,15 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     cbDLC->setChecked(true);
     connect(cbDLC, SIGNAL(toggled(bool)), viewer, SLOT(setDrawLightCone(bool)));
 
+    QCheckBox *cbGS = new QCheckBox("Geometry shader", this);
+    cbGS->setToolTip("Light flat faces in a geometry shader, or from screen-space derivatives without one");
+    cbGS->setChecked(true);
+    connect(cbGS, SIGNAL(toggled(bool)), viewer, SLOT(setGeometryShader(bool)));
+
+    QPushButton *pbBenchmark = new QPushButton("Benchmark", this);
+    pbBenchmark->setToolTip("Time the frames of both shading paths");
+    connect(pbBenchmark, SIGNAL(clicked()), this, SLOT(benchmarkShadingPaths()));
+
     QGroupBox *gbOptions = new QGroupBox("Options", this);
     QGridLayout *optLayout = new QGridLayout();
     optLayout->setSpacing(5);
@@ -139,7 +155,9 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     optLayout->addWidget(new QLabel("Spot exponent:", this), 15, 0);
     optLayout->addWidget(sbLE, 15, 1, Qt::AlignRight);
     optLayout->addWidget(cbDLC, 16, 0, 1, 2);
-    optLayout->setRowStretch(17, 1);
+    optLayout->addWidget(cbGS, 17, 0);
+    optLayout->addWidget(pbBenchmark, 17, 1, Qt::AlignRight);
+    optLayout->setRowStretch(18, 1);
     gbOptions->setLayout(optLayout);
 
     QWidget *w = new QWidget(this);
@@ -167,6 +185,17 @@ void MainWindow::showModel(bool status) {
     }
 }
 
+void MainWindow::showPickedPoint(QVector3D point, int triangle) {
+    statusBar()->showMessage(QString("Triangle %1 at (%2, %3, %4)").arg(triangle)
+                             .arg(point.x(), 0, 'f', 4).arg(point.y(), 0, 'f', 4).arg(point.z(), 0, 'f', 4));
+}
+
+void MainWindow::benchmarkShadingPaths() {
+    const int frames = 100;
+    QString result = viewer->benchmarkShadingPaths(frames);
+    if(!result.isEmpty()) statusBar()->showMessage(QString("%1 frames, GPU time per frame: %2").arg(frames).arg(result));
+}
+
 void MainWindow::setLightPosition(QVector3D lpos) {
     viewer->setLightPosition(lpos);
     viewer->setLightDirection(pwLightDir->getValue(), pwLightDir->getValue() - lpos);
@@ -9,6 +9,7 @@
 #include "modelviewer.h"
 #include "objmodel.h"
 #include "colorpicker.h"
+#include "assetloader.h"
 
 class PositionWidget : public QWidget {
     Q_OBJECT
@@ -41,10 +42,13 @@ private slots:
     void showModel(bool status);
     void setLightDirection(QVector3D point);
     void setLightPosition(QVector3D lpos);
+    void showPickedPoint(QVector3D point, int triangle);
+    void benchmarkShadingPaths();
 
 private:
     ModelViewer *viewer;
     OBJModel *model, *lightModel;
+    AssetLoader *assets;
 
     QComboBox *cbShading, *cbFill;
     PositionWidget *pwLightPos, *pwLightDir;
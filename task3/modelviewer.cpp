@@ -1,14 +1,20 @@
 #include "modelviewer.h"
+#include "objclusters.h"
+#include "objbvh.h"
+#include "glstatecache.h"
 
 #include <QFile>
 #include <QMouseEvent>
 #include <QApplication>
 #include <QMessageBox>
+#include <QStringList>
 
 #include <math.h>
 
 #include <iostream>
 
+#define LOD_PIXEL_ERROR 1.0
+
 //----------------------------------------------------------------------------------------
 
 // We have to repack matrices from qreal to GLfloat.
@@ -33,6 +39,39 @@
 #define setUniformVector3f(location, value) \
     glUniform3f(location, (GLfloat)value.x(), (GLfloat)value.y(), (GLfloat)value.z());
 
+//std140 images of the uniform blocks of the shaders, a vec3 takes 16 bytes unless a scalar follows it
+struct CameraUniforms {
+    GLfloat vp[16], v[16];
+};
+
+struct LightUniforms {
+    GLfloat position[3], power;
+    GLfloat spotDirection[3], spotAngleCos;
+    GLfloat color[3], spotExponent;
+    GLint spotMethod, padding[3];
+};
+
+struct MaterialUniforms {
+    GLfloat ambient[3], specularPower;
+    GLfloat diffuse[3];
+    GLint shadingMethod;
+    GLfloat specular[3];
+    GLint fillMethod;
+};
+
+static const char *uniformBlockNames[] = { "Camera", "Light", "Material" };
+static const GLsizeiptr uniformBlockSizes[] = { sizeof(CameraUniforms), sizeof(LightUniforms), sizeof(MaterialUniforms) };
+
+static inline void copyVector(GLfloat *dst, const QVector3D &v) {
+    dst[0] = v.x();
+    dst[1] = v.y();
+    dst[2] = v.z();
+}
+
+static inline void copyMatrix(GLfloat *dst, const QMatrix4x4 &m) {
+    for(int i = 0; i < 16; ++i) dst[i] = m.constData()[i];
+}
+
 ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new QGLContext(fmt), parent), model(0) {
     hAngle = 0;
     vAngle = 0;
@@ -44,6 +83,11 @@ ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new
     outlineColor = QVector3D(0, 0, 0);
     drawOutline = true;
     drawLightCone = true;
+    packedVertices = true;
+    gpuResident = false;
+    clusterCulling = true;
+    backfaceCulling = false;
+    shadingPath = GeometryShaderPath;
     lightPosition = QVector3D(4, 4, 4);
     lightDirection = -lightPosition.normalized();
     specularPower = 20.0;
@@ -53,66 +97,84 @@ ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new
     spotMethod = 1;
     lightAngle = cos(M_PI * 45.0 / 180.0);
     lightExponent = 1.0;
+    for(int i = 0; i < UniformBlockCount; ++i) uniformDirty[i] = true;
 }
 
 ModelViewer::~ModelViewer() {
     model = 0;
     glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &normalsBuffer);
-    glDeleteProgram(shaderProgramID);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteBuffers(1, &lightVertexBuffer);
+    glDeleteBuffers(1, &lightIndexBuffer);
+    GLStateCache &gl = GLStateCache::instance();
+    for(int i = 0; i < ShadingPathCount; ++i) gl.deleteProgram(programs[i].id);
+    gl.deleteVertexArrays(1, &vertexArrayID);
+    gl.deleteVertexArrays(1, &lightVertexArrayID);
+    glDeleteBuffers(UniformBlockCount, uniformBuffers);
 }
 
 void ModelViewer::setModel(OBJModel *m) {
-    if(model) {
-        glDeleteBuffers(1, &vertexBuffer);
-        glDeleteBuffers(1, &normalsBuffer);
+    //a reloaded model keeps its buffers, only the runs that changed are written again;
+    //a model loaded from another file, even into the same object, starts over
+    bool reloaded = m == model && m->reloaded();
+    if(!reloaded) {
+        if(model) {
+            glDeleteBuffers(1, &vertexBuffer);
+            glDeleteBuffers(1, &indexBuffer);
+        }
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        vertexRuns.reset();
+        indexRuns.reset();
     }
 
+    //centered by the model matrix, the vertices stay as loaded
     model = m;
-    model->moveToMassCenter();
-
-    std::vector<OBJVec3> vs, ns;
-    std::vector<OBJVec2> ts;
-    for(std::vector<OBJFace>::iterator fi = m->faces.begin(); fi != m->faces.end(); ++fi) {
-        for(OBJFace::iterator fii = fi->begin(); fii != fi->end(); ++fii) {
-            if(fii->n != 0) ns.push_back(m->norms[fii->n - 1]);
-            if(fii->t != 0) ts.push_back(OBJVec2(m->texs[fii->t - 1].x, m->texs[fii->t - 1].y));
-            vs.push_back(m->verts[fii->v - 1]);
-        }
-    }
+    modelCenter = QVector3D(m->massCenter.x, m->massCenter.y, m->massCenter.z);
 
-    //assume there is only triangles in the model
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vs.size() * sizeof(OBJVec3), &vs[0], GL_STATIC_DRAW);
-    vertexBufferSize = vs.size();
+    //one vertex per distinct corner of the welded mesh, the vertex array keeps the buffers and the layout
+    GLStateCache::instance().bindVertexArray(vertexArrayID);
+    const OBJVertexPacker::Attribute which[2] = { OBJVertexPacker::Positions, OBJVertexPacker::Normals };
+    OBJAttribute attrs[2];
+    OBJVertexPacker::positionTransform(*m, packedVertices, posOffset, posScale);
+    OBJVertexPacker::upload(*m, which, attrs, 2, packedVertices, vertexBuffer, vertexRuns);
+    attrs[0].setPointer(0);
+    attrs[1].setPointer(1);
 
-    glGenBuffers(1, &normalsBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalsBuffer);
-    glBufferData(GL_ARRAY_BUFFER, ns.size() * sizeof(OBJVec3), &ns[0], GL_STATIC_DRAW);
+    //the simplified levels follow the full triangle list
+    indexBufferSize = m->mesh.indices.size();
+    OBJVertexPacker::uploadIndices(m->mesh, indexBuffer, indexRuns);
 
-    resetView();
+    if(gpuResident) m->releaseGeometry();
+
+    if(!reloaded) resetView();
     update();
 }
 
 void ModelViewer::setLighModel(OBJModel *lm) {
     if(lightModel) {
         glDeleteBuffers(1, &lightVertexBuffer);
+        glDeleteBuffers(1, &lightIndexBuffer);
     }
 
     lightModel = lm;
+    GLStateCache::instance().bindVertexArray(lightVertexArrayID);
 
     std::vector<OBJVec3> vs;
-    for(std::vector<OBJFace>::iterator fi = lm->faces.begin(); fi != lm->faces.end(); ++fi) {
-        for(OBJFace::iterator fii = fi->begin(); fii != fi->end(); ++fii) {
-            vs.push_back(lm->verts[fii->v - 1]);
-        }
+    vs.reserve(lm->mesh.vertices.size());
+    for(std::vector<FaceIndex>::const_iterator vi = lm->mesh.vertices.begin(); vi != lm->mesh.vertices.end(); ++vi) {
+        vs.push_back(lm->verts[vi->v - 1]);
     }
     glGenBuffers(1, &lightVertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, lightVertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, vs.size() * sizeof(OBJVec3), &vs[0], GL_STATIC_DRAW);
-    lightVertexBufferSize = vs.size();
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+    glGenBuffers(1, &lightIndexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lightIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, lm->mesh.indices.size() * sizeof(GLuint), &lm->mesh.indices[0], GL_STATIC_DRAW);
+    lightIndexBufferSize = lm->mesh.indices.size();
 
     updateLight();
     update();
@@ -123,6 +185,16 @@ void ModelViewer::setMeshColor(QVector3D mc) {
     update();
 }
 
+void ModelViewer::setClusterCulling(bool val) {
+    clusterCulling = val;
+    update();
+}
+
+void ModelViewer::setBackfaceCulling(bool val) {
+    backfaceCulling = val;
+    update();
+}
+
 void ModelViewer::setDrawOutline(bool val) {
     drawOutline = val;
     update();
@@ -134,28 +206,38 @@ void ModelViewer::setDrawLightCone(bool val) {
     update();
 }
 
+void ModelViewer::setGeometryShader(bool val) {
+    shadingPath = val ? GeometryShaderPath : DerivativePath;
+    update();
+}
+
 void ModelViewer::setAmbientColor(QVector3D c) {
     ambientColor = c;
+    uniformDirty[MaterialBlock] = true;
     update();
 }
 
 void ModelViewer::setDiffuseColor(QVector3D c) {
     diffuseColor = c;
+    uniformDirty[MaterialBlock] = true;
     update();
 }
 
 void ModelViewer::setSpecularColor(QVector3D c) {
     specularColor = c;
+    uniformDirty[MaterialBlock] = true;
     update();
 }
 
 void ModelViewer::setSpecularPower(double p) {
     specularPower = p;
+    uniformDirty[MaterialBlock] = true;
     update();
 }
 
 void ModelViewer::setLightColor(QVector3D c) {
     lightColor = c;
+    uniformDirty[LightBlock] = true;
     update();
 }
 
@@ -167,11 +249,13 @@ void ModelViewer::setLightPosition(QVector3D p) {
 
 void ModelViewer::setFillMethod(int m) {
     fillMethod = m;
+    uniformDirty[MaterialBlock] = true;
     update();
 }
 
 void ModelViewer::setShadingMethod(int m) {
     shadingMethod = m;
+    uniformDirty[MaterialBlock] = true;
     update();
 }
 
@@ -202,6 +286,7 @@ void ModelViewer::setLightExponent(double e) {
 
 void ModelViewer::setSpotMethod(bool m) {
     spotMethod = m ? 1 : 0;
+    uniformDirty[LightBlock] = true;
     update();
 }
 
@@ -223,119 +308,180 @@ void ModelViewer::initializeGL() {
 
     std::cout << "OpenGL initialized: GL version "<< glGetString(GL_VERSION) << " | GLSL "<< glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.reset();
+    gl.enable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
 //    glEnable(GL_CULL_FACE);
-    glPolygonOffset(-1.0, -1.0);
+    //flat varyings come from the first vertex of a triangle, where the geometry shader lights a flat face
+    glProvokingVertex(GL_FIRST_VERTEX_CONVENTION);
 
-    shaderProgramID = createShaders(":/shaders/vertexShader.vsh", ":/shaders/fragmentShader.fsh", ":/shaders/geometryShader.geom");
-//    shaderProgramID = createShaders(":/shaders/vertexShader.vsh", ":/shaders/fragmentShader.fsh");
+    programs[GeometryShaderPath].id = createShaders(":/shaders/vertexShader.vsh", ":/shaders/fragmentShader.fsh", ":/shaders/geometryShader.geom");
+    programs[DerivativePath].id = createShaders(":/shaders/vertexShader.vsh", ":/shaders/derivativeFragmentShader.fsh");
 
+    //one vertex array for the model and one for the light cone, set up whenever they are uploaded
     glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
-    mvpMatrixID = glGetUniformLocation(shaderProgramID, "MVP");
-    mMatrixID = glGetUniformLocation(shaderProgramID, "M");
-    vMatrixID = glGetUniformLocation(shaderProgramID, "V");
-
-    lightPosID = glGetUniformLocation(shaderProgramID, "lightPosition_worldspace");
-    lightColorID = glGetUniformLocation(shaderProgramID, "lightColor");
-    lightPowerID = glGetUniformLocation(shaderProgramID, "lightPower");
-    lightDirID = glGetUniformLocation(shaderProgramID, "spotDirection_worldspace");
-    lightAngleID = glGetUniformLocation(shaderProgramID, "spotAngleCos");
-    lightExponentID = glGetUniformLocation(shaderProgramID, "spotExponent");
-    spotMethodID = glGetUniformLocation(shaderProgramID, "spotMethod");
-
-    fillMethodID = glGetUniformLocation(shaderProgramID, "fillMethod");
-    shadingMethodID = glGetUniformLocation(shaderProgramID, "shadingMethod");
-    drawOutlineID = glGetUniformLocation(shaderProgramID, "drawOutline");
-    outlineColorID = glGetUniformLocation(shaderProgramID, "outlineColor");
-    ambientColorID = glGetUniformLocation(shaderProgramID, "ambientColor");
-    diffuseColorID = glGetUniformLocation(shaderProgramID, "diffuseColor");
-    specularColorID = glGetUniformLocation(shaderProgramID, "specularColor");
-    specularPowerID = glGetUniformLocation(shaderProgramID, "specularPower");
+    glGenVertexArrays(1, &lightVertexArrayID);
+
+    //camera, light and material live in uniform buffers bound to the binding points of their blocks,
+    //both programs read the same buffers
+    for(int p = 0; p < ShadingPathCount; ++p) {
+        ShaderProgram &program = programs[p];
+        program.mMatrixID = glGetUniformLocation(program.id, "M");
+        program.drawOutlineID = glGetUniformLocation(program.id, "drawOutline");
+        program.outlineColorID = glGetUniformLocation(program.id, "outlineColor");
+        program.posOffsetID = glGetUniformLocation(program.id, "posOffset");
+        program.posScaleID = glGetUniformLocation(program.id, "posScale");
+        for(int i = 0; i < UniformBlockCount; ++i) {
+            GLuint index = glGetUniformBlockIndex(program.id, uniformBlockNames[i]);
+            if(index != GL_INVALID_INDEX) glUniformBlockBinding(program.id, index, i);
+        }
+    }
+
+    glGenBuffers(UniformBlockCount, uniformBuffers);
+    for(int i = 0; i < UniformBlockCount; ++i) {
+        glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffers[i]);
+        glBufferData(GL_UNIFORM_BUFFER, uniformBlockSizes[i], 0, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, i, uniformBuffers[i]);
+        uniformDirty[i] = true;
+    }
+}
+
+//each block that changed since the last frame is written with one call
+void ModelViewer::updateUniformBlocks() {
+    if(uniformDirty[CameraBlock]) {
+        CameraUniforms camera;
+        copyMatrix(camera.vp, mProjection * mView);
+        copyMatrix(camera.v, mView);
+        uploadUniformBlock(CameraBlock, &camera);
+    }
+    if(uniformDirty[LightBlock]) {
+        LightUniforms light = LightUniforms();
+        copyVector(light.position, lightPosition);
+        copyVector(light.spotDirection, lightDirection);
+        copyVector(light.color, lightColor);
+        light.power = lightPower;
+        light.spotAngleCos = lightAngle;
+        light.spotExponent = lightExponent;
+        light.spotMethod = spotMethod;
+        uploadUniformBlock(LightBlock, &light);
+    }
+    if(uniformDirty[MaterialBlock]) {
+        MaterialUniforms material;
+        copyVector(material.ambient, ambientColor);
+        copyVector(material.diffuse, diffuseColor);
+        copyVector(material.specular, specularColor);
+        material.specularPower = specularPower;
+        material.shadingMethod = shadingMethod;
+        material.fillMethod = fillMethod;
+        uploadUniformBlock(MaterialBlock, &material);
+    }
+}
+
+void ModelViewer::uploadUniformBlock(UniformBlock block, const void *data) {
+    glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffers[block]);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, uniformBlockSizes[block], data);
+    uniformDirty[block] = false;
 }
 
 void ModelViewer::paintGL() {
     glClearColor(0, 0, 0.4f, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    //every draw states what it needs, the cache drops what is already set
+    GLStateCache &gl = GLStateCache::instance();
+    gl.beginFrame();
+
     if(model) {
         QMatrix4x4 mMVP = mProjection * mView * mModel;
+        //outlines are blended in from the barycentric coordinates of the geometry shader, as in
+        //task1 and task2 the path without it is taken for a plain fill only
+        const ShaderProgram &program = programs[drawOutline ? GeometryShaderPath : shadingPath];
 
-        glUseProgram(shaderProgramID);
-
-        setUniformMatrix(glUniformMatrix4fv, mvpMatrixID, mMVP, 4, 4);
-        setUniformMatrix(glUniformMatrix4fv, mMatrixID, mModel, 4, 4);
-        setUniformMatrix(glUniformMatrix4fv, vMatrixID, mView, 4, 4);
-
-        setUniformVector3f(lightPosID, lightPosition);
-        setUniformVector3f(lightColorID, lightColor);
-        setUniformVector3f(ambientColorID, ambientColor);
-        setUniformVector3f(diffuseColorID, diffuseColor);
-        setUniformVector3f(specularColorID, specularColor);
-        setUniformVector3f(lightDirID, lightDirection);
-        glUniform1f(specularPowerID, specularPower);
-        glUniform1f(lightPowerID, lightPower);
-        glUniform1f(lightAngleID, lightAngle);
-        glUniform1f(lightExponentID, lightExponent);
-        glUniform1i(fillMethodID, fillMethod);
-        glUniform1i(shadingMethodID, shadingMethod);
-        glUniform1i(spotMethodID, spotMethod);
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glUniform1i(drawOutlineID, 0);
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsBuffer);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-
-        if(drawOutline) {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            glUniform1i(drawOutlineID, 1);
-            setUniformVector3f(outlineColorID, outlineColor);
-            glEnableVertexAttribArray(0);
-            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-            glEnable(GL_POLYGON_OFFSET_FILL);
-            glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-            glDisable(GL_POLYGON_OFFSET_FILL);
-            glDisableVertexAttribArray(0);
-        }
+        gl.useProgram(program.id);
+        updateUniformBlocks();
 
+        setUniformMatrix(glUniformMatrix4fv, program.mMatrixID, mModel, 4, 4);
+        setUniformVector3f(program.posOffsetID, posOffset);
+        setUniformVector3f(program.posScaleID, posScale);
+
+        cullClusters(mMVP, selectLod());
+
+        //one pass draws the fill and the outline
+        glUniform1i(program.drawOutlineID, drawOutline ? 1 : 0);
+        setUniformVector3f(program.outlineColorID, outlineColor);
+        gl.bindVertexArray(vertexArrayID);
+        drawMesh();
+
+        //the wireframe of the light cone is its edges only, which takes the geometry shader in both paths
         if(drawLightCone) {
-            QMatrix4x4 mlMVP = mProjection * mView * mLightModel;
-            setUniformMatrix(glUniformMatrix4fv, mvpMatrixID, mlMVP, 4, 4);
-
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            glUniform1i(drawOutlineID, 1);
-            setUniformVector3f(outlineColorID, lightColor);
-            glEnableVertexAttribArray(0);
-            glBindBuffer(GL_ARRAY_BUFFER, lightVertexBuffer);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-            glEnable(GL_POLYGON_OFFSET_FILL);
-            glDrawArrays(GL_TRIANGLES, 0, lightVertexBufferSize);
-            glDisable(GL_POLYGON_OFFSET_FILL);
-            glDisableVertexAttribArray(0);
+            const ShaderProgram &lineProgram = programs[GeometryShaderPath];
+            gl.useProgram(lineProgram.id);
+            setUniformMatrix(glUniformMatrix4fv, lineProgram.mMatrixID, mLightModel, 4, 4);
+            glUniform3f(lineProgram.posOffsetID, 0, 0, 0);
+            glUniform3f(lineProgram.posScaleID, 1, 1, 1);
+
+            glUniform1i(lineProgram.drawOutlineID, 2);
+            setUniformVector3f(lineProgram.outlineColorID, lightColor);
+            gl.bindVertexArray(lightVertexArrayID);
+            glDrawElements(GL_TRIANGLES, lightIndexBufferSize, GL_UNSIGNED_INT, 0);
+        }
+    }
+}
+
+//every frame is waited for, so that the timer queries measure the frames one by one;
+//outlines and the light cone go through the geometry shader in both paths, so they are
+//left out of the timed frames where they would only add the same work to both
+QString ModelViewer::benchmarkShadingPaths(int frames) {
+    if(!model || frames <= 0) return QString();
+    makeCurrent();
+    ShadingPath current = shadingPath;
+    bool outline = drawOutline, lightCone = drawLightCone;
+    drawOutline = drawLightCone = false;
+    GLuint query;
+    glGenQueries(1, &query);
+
+    QStringList results;
+    for(int p = 0; p < ShadingPathCount; ++p) {
+        shadingPath = (ShadingPath)p;
+        paintGL();
+        glFinish();
+
+        GLuint64 total = 0;
+        for(int i = 0; i < frames; ++i) {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            paintGL();
+            glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            total += elapsed;
         }
+        //the frames are alike, the counters of the one before the last stand for all of them
+        const GLStateCache &gl = GLStateCache::instance();
+        results << QString("%1: %2 ms, %3 of %4 state calls skipped").arg(p == GeometryShaderPath ? "geometry shader" : "derivatives")
+                   .arg(total / 1e6 / frames, 0, 'f', 3).arg(gl.frameSkipped()).arg(gl.frameCalls());
     }
+
+    glDeleteQueries(1, &query);
+    shadingPath = current;
+    drawOutline = outline;
+    drawLightCone = lightCone;
+    update();
+    return results.join(", ") + " (fill only, no outlines or light cone)";
 }
 
 void ModelViewer::resizeGL(int width, int height) {
     glViewport(0, 0, width, height);
     mProjection.setToIdentity();
     mProjection.perspective(fovVal, (float)width / (float)height, pNear, pFar);
+    uniformDirty[CameraBlock] = true;
 }
 
 //----------------------------------------------------------------------------------------
 
 void ModelViewer::mousePressEvent(QMouseEvent *event) {
     lastMousePos = event->pos();
+    if(event->button() == Qt::RightButton) pickPoint(event->pos());
 }
 
 void ModelViewer::mouseMoveEvent(QMouseEvent *event) {
@@ -348,6 +494,7 @@ void ModelViewer::mouseMoveEvent(QMouseEvent *event) {
 //    mModel.rotate(vAngle, QVector3D(cos(hAngle/180.0*M_PI) < 0 ? -1 : 1, 0, 0));
     mModel.rotate(vAngle, QVector3D(1, 0, 0));
     mModel.scale(mScale);
+    mModel.translate(-modelCenter);
 
     update();
 
@@ -359,20 +506,46 @@ void ModelViewer::wheelEvent(QWheelEvent *event) {
         fovVal = std::min(std::max(fovVal - 0.05 * event->delta(), 10.0), 90.0);
         mProjection.setToIdentity();
         mProjection.perspective(fovVal, (float)this->width() / (float)this->height(), pNear, pFar);
+        uniformDirty[CameraBlock] = true;
     } else if(event->buttons() & Qt::LeftButton) {
         mScale = qMax(1.0, qMin(100.0, mScale + 0.05 * event->delta()));
         mModel.setToIdentity();
         mModel.rotate(hAngle, QVector3D(0, 1, 0));
         mModel.rotate(vAngle, QVector3D(1, 0, 0));
         mModel.scale(mScale);
+        mModel.translate(-modelCenter);
     } else {
         zPos = std::min(std::max((double)pNear, zPos - 0.0025 * event->delta()), (double)pFar);
         mView.setToIdentity();
         mView.lookAt(QVector3D(0, 0, zPos), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+        uniformDirty[CameraBlock] = true;
     }
     update();
 }
 
+//the click as a ray between the near and the far plane, taken back to the loaded vertices
+void ModelViewer::pickPoint(const QPoint &pos) {
+    if(!model || model->mesh.bvh.empty()) return;
+    bool invertible;
+    QMatrix4x4 inv = (mProjection * mView * mModel).inverted(&invertible);
+    if(!invertible) return;
+    float x = 2.0f * pos.x() / this->width() - 1.0f;
+    float y = 1.0f - 2.0f * pos.y() / this->height();
+    QVector3D nearPoint = inv.map(QVector3D(x, y, -1.0f));
+    QVector3D farPoint = inv.map(QVector3D(x, y, 1.0f));
+
+    OBJVec3 origin, dir;
+    origin.x = nearPoint.x();
+    origin.y = nearPoint.y();
+    origin.z = nearPoint.z();
+    dir.x = farPoint.x() - nearPoint.x();
+    dir.y = farPoint.y() - nearPoint.y();
+    dir.z = farPoint.z() - nearPoint.z();
+    OBJRayHit hit;
+    if(!OBJBvh::intersect(model->mesh, model->verts, origin, dir, hit, 1.0f)) return;
+    emit pointPicked(nearPoint + hit.t * (farPoint - nearPoint), (int)hit.triangle);
+}
+
 //----------------------------------------------------------------------------------------
 
 void ModelViewer::resetView() {
@@ -386,8 +559,72 @@ void ModelViewer::resetView() {
     mProjection.perspective(fovVal, (float)this->width() / (float)this->height(), pNear, pFar);
     mView.setToIdentity();
     mView.lookAt(QVector3D(0, 0, zPos), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+    uniformDirty[CameraBlock] = true;
     mModel.setToIdentity();
     mModel.scale(mScale);
+    mModel.translate(-modelCenter);
+}
+
+//the coarsest level whose error covers at most LOD_PIXEL_ERROR pixels where the model is closest
+int ModelViewer::selectLod() const {
+    const OBJBounds &b = model->bounds;
+    if(model->mesh.lods.empty() || b.empty()) return -1;
+    OBJVec3 c = b.center();
+    QMatrix4x4 mv = mView * mModel;
+    QVector3D center = mv.map(QVector3D(c.x, c.y, c.z));
+    float scale = mv.column(0).toVector3D().length();
+    float dist = qMax(-center.z() - b.radius() * scale, (float)pNear);
+    float pixelSize = 2.0 * dist * tan(fovVal * M_PI / 360.0) / qMax(height(), 1);
+    return model->mesh.selectLod(LOD_PIXEL_ERROR * pixelSize / scale);
+}
+
+//the ranges of the index buffer to draw: the clusters of the full mesh that may be seen, merged
+//where they follow each other, or all of a simplified level
+void ModelViewer::cullClusters(const QMatrix4x4 &mvp, int lod) {
+    drawCounts.clear();
+    drawOffsets.clear();
+    const std::vector<OBJCluster> &clusters = model->mesh.clusters;
+    if(lod >= 0 || !clusterCulling || clusters.empty()) {
+        drawCounts.push_back(lod < 0 ? indexBufferSize : model->mesh.lods[lod].count);
+        drawOffsets.push_back((const GLvoid*)(lod < 0 ? 0 : (indexBufferSize + model->mesh.lods[lod].first) * sizeof(GLuint)));
+        return;
+    }
+
+    //frustum planes and the eye in model space, where the cluster bounds are
+    QVector4D planes[6];
+    for(int i = 0; i < 3; ++i) {
+        planes[i * 2] = mvp.row(3) + mvp.row(i);
+        planes[i * 2 + 1] = mvp.row(3) - mvp.row(i);
+    }
+    QVector3D eyePos = (mView * mModel).inverted().map(QVector3D(0, 0, 0));
+    OBJVec3 eye;
+    eye.x = eyePos.x();
+    eye.y = eyePos.y();
+    eye.z = eyePos.z();
+
+    GLuint end = 0;
+    for(std::vector<OBJCluster>::const_iterator c = clusters.begin(); c != clusters.end(); ++c) {
+        if(backfaceCulling && OBJClusterBuilder::backfacing(*c, eye)) continue;
+        QVector3D center(c->center.x, c->center.y, c->center.z);
+        bool inside = true;
+        for(int p = 0; p < 6 && inside; ++p) {
+            inside = QVector3D::dotProduct(planes[p].toVector3D(), center) + planes[p].w() >= -c->radius * planes[p].toVector3D().length();
+        }
+        if(!inside) continue;
+
+        if(!drawCounts.empty() && end == c->first) {
+            drawCounts.back() += c->count;
+        } else {
+            drawCounts.push_back(c->count);
+            drawOffsets.push_back((const GLvoid*)(c->first * sizeof(GLuint)));
+        }
+        end = c->first + c->count;
+    }
+}
+
+void ModelViewer::drawMesh() const {
+    if(drawCounts.empty()) return;
+    glMultiDrawElements(GL_TRIANGLES, &drawCounts[0], GL_UNSIGNED_INT, &drawOffsets[0], (GLsizei)drawCounts.size());
 }
 
 QQuaternion ModelViewer::rotationBetweenVectors(const QVector3D &start, const QVector3D &dest) const {
@@ -421,6 +658,7 @@ void ModelViewer::updateLight() {
     double maxDist = sqrt(lightPower / 0.004);
     double r = tan(acos(lightAngle)) * maxDist;
     mLightModel.scale(r, r, maxDist);
+    uniformDirty[LightBlock] = true;
 }
 
 //----------------------------------------------------------------------------------------
@@ -442,14 +680,15 @@ GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile
     GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertexShaderID, 1, &pVertexShaderCode, NULL);
     glCompileShader(vertexShaderID);
-    if(!checkStatus(vertexShaderID, GL_COMPILE_STATUS)) return 0;
+    //every stage is compiled before giving up, so each failing one reports its log
+    bool compiled = checkStatus(vertexShaderID, GL_COMPILE_STATUS);
 
     std::string fragmentShaderCode = readFile(fshFile).toStdString();
     const char *pFragmentShaderCode = fragmentShaderCode.c_str();
     GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragmentShaderID, 1, &pFragmentShaderCode, NULL);
     glCompileShader(fragmentShaderID);
-    if(!checkStatus(fragmentShaderID, GL_COMPILE_STATUS)) return 0;
+    compiled = checkStatus(fragmentShaderID, GL_COMPILE_STATUS) && compiled;
 
     GLuint geometryShaderID = 0;
     if(!gshFile.isEmpty()) {
@@ -458,16 +697,23 @@ GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile
         geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
         glShaderSource(geometryShaderID, 1, &pGeometryShaderCode, NULL);
         glCompileShader(geometryShaderID);
-        if(!checkStatus(geometryShaderID, GL_COMPILE_STATUS)) return 0;
+        compiled = checkStatus(geometryShaderID, GL_COMPILE_STATUS) && compiled;
     }
 
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShaderID);
-    glAttachShader(shaderProgram, fragmentShaderID);
-    if(!gshFile.isEmpty()) glAttachShader(shaderProgram, geometryShaderID);
-    glLinkProgram(shaderProgram);
-    if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) return 0;
+    GLuint shaderProgram = 0;
+    if(compiled) {
+        shaderProgram = glCreateProgram();
+        glAttachShader(shaderProgram, vertexShaderID);
+        glAttachShader(shaderProgram, fragmentShaderID);
+        if(!gshFile.isEmpty()) glAttachShader(shaderProgram, geometryShaderID);
+        glLinkProgram(shaderProgram);
+        if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) {
+            glDeleteProgram(shaderProgram);
+            shaderProgram = 0;
+        }
+    }
 
+    //the shaders go whether the program was built or not
     glDeleteShader(vertexShaderID);
     glDeleteShader(fragmentShaderID);
     if(!gshFile.isEmpty()) glDeleteShader(geometryShaderID);
@@ -7,6 +7,7 @@
 #include <QMatrix4x4>
 
 #include "objmodel.h"
+#include "objpacker.h"
 
 class ModelViewer : public QGLWidget {
     Q_OBJECT
@@ -18,8 +19,24 @@ public:
     void setModel(OBJModel *m);
     void setLighModel(OBJModel *lm);
 
+    // applies to the next setModel
+    void setPackedVertices(bool val) { packedVertices = val; }
+    // applies to the next setModel, which then frees the CPU copies of the model (and with them picking)
+    void setGpuResident(bool val) { gpuResident = val; }
+    // skips clusters outside the view
+    void setClusterCulling(bool val);
+    // also skips clusters facing away, off by default: it needs closed, consistently wound
+    // models, through the holes of an open one the inner faces would go missing
+    void setBackfaceCulling(bool val);
+    // draws frames with each shading path and reports the mean GPU time of a frame and the
+    // state calls GLStateCache skipped in it,
+    // outlines and the light cone are left out of the timed frames
+    QString benchmarkShadingPaths(int frames);
+
 signals:
     void uvMultiplierChanged(double val);
+    // right click on the model, point in model coordinates, triangle of OBJMesh::indices
+    void pointPicked(QVector3D point, int triangle);
 
 public slots:
     void setMeshColor(QVector3D mc);
@@ -38,6 +55,9 @@ public slots:
     void setSpotMethod(bool m);
     void setDrawOutline(bool val);
     void setDrawLightCone(bool val);
+    // the geometry shader path, or the one lighting flat faces with screen-space derivatives,
+    // which is taken while no outline is drawn
+    void setGeometryShader(bool val);
 
 protected:
     void initializeGL();
@@ -49,33 +69,50 @@ protected:
     void wheelEvent(QWheelEvent *event);
 
 private:
+    enum UniformBlock { CameraBlock, LightBlock, MaterialBlock, UniformBlockCount };
+    enum ShadingPath { GeometryShaderPath, DerivativePath, ShadingPathCount };
+
+    struct ShaderProgram {
+        GLuint id, mMatrixID, drawOutlineID, outlineColorID, posOffsetID, posScaleID;
+    };
+
     QString readFile(const QString &fileName) const;
     GLuint createShaders(const QString &vshFile, const QString &fshFile, const QString &gshFile = "") const;
     bool checkStatus(GLuint id, GLenum type, bool isShader = true) const;
     void resetView();
     void updateLight();
+    void updateUniformBlocks();
+    void uploadUniformBlock(UniformBlock block, const void *data);
+    int selectLod() const;
+    void cullClusters(const QMatrix4x4 &mvp, int lod);
+    void drawMesh() const;
+    void pickPoint(const QPoint &pos);
 
     QQuaternion rotationBetweenVectors(const QVector3D &start, const QVector3D &dest) const;
 
     OBJModel *model, *lightModel;
-    GLuint shaderProgramID, mvpMatrixID, mMatrixID, vMatrixID;
-    GLuint fillMethodID, shadingMethodID;
-    GLuint lightPosID, lightColorID, lightPowerID, lightDirID, lightAngleID, lightExponentID, spotMethodID;
-    GLuint drawOutlineID, outlineColorID;
-    GLuint ambientColorID, diffuseColorID, specularColorID, specularPowerID;
-    GLuint vertexBuffer, vertexBufferSize, vertexArrayID;
-    GLuint normalsBuffer;
+    ShaderProgram programs[ShadingPathCount];
+    ShadingPath shadingPath;
+    //buffers of the uniform blocks, rewritten before a draw when their values changed
+    GLuint uniformBuffers[UniformBlockCount];
+    bool uniformDirty[UniformBlockCount];
+    GLuint vertexBuffer, indexBuffer, indexBufferSize, vertexArrayID;
+    OBJBufferRuns vertexRuns, indexRuns;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const GLvoid*> drawOffsets;
+    QVector3D posOffset, posScale;
     GLfloat pNear, pFar, specularPower, lightPower, lightAngle, lightExponent;
     QMatrix4x4 mProjection, mModel, mView;
     QVector3D outlineColor, ambientColor, diffuseColor, specularColor;
     QVector3D lightPosition, lightColor, lightDirection, lightPointsAt;
+    QVector3D modelCenter;
     QPoint lastMousePos;
     float hAngle, vAngle, mScale;
     float fovVal, zPos;
-    bool drawOutline, drawLightCone;
+    bool drawOutline, drawLightCone, packedVertices, gpuResident, clusterCulling, backfaceCulling;
     int fillMethod, shadingMethod, spotMethod;
 
-    GLuint lightVertexBuffer, lightVertexBufferSize, lightVertexArrayID;
+    GLuint lightVertexBuffer, lightIndexBuffer, lightIndexBufferSize, lightVertexArrayID;
     QMatrix4x4 mLightModel;
 
 };
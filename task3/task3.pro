@@ -11,15 +11,18 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = task3
 TEMPLATE = app
 
+include(../common/common.pri)
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    objmodel.cpp \
+    $$COMMON/objpacker.cpp \
+    $$COMMON/assetloader.cpp \
     modelviewer.cpp \
     colorpicker.cpp
 
 HEADERS  += mainwindow.h \
-    objmodel.h \
+    $$COMMON/objpacker.h \
+    $$COMMON/assetloader.h \
     modelviewer.h \
     colorpicker.h
 
@@ -36,4 +39,5 @@ RESOURCES += \
 OTHER_FILES += \
     vertexShader.vsh \
     fragmentShader.fsh \
-    geometryShader.geom
+    geometryShader.geom \
+    derivativeFragmentShader.fsh
@@ -11,7 +11,11 @@
 
 #include "terrain.h"
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+#define SKYBOX_TEXTURE ":/textures/skybox1.png"
+#define PARTICLE_TEXTURE ":/textures/snowflakes.jpg"
+#define FRUSTUM_MODEL ":/models/frustum.obj"
+
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), glReady(false) {
     QGLFormat glFormat;
     glFormat.setVersion(3, 3);
     glFormat.setProfile(QGLFormat::CoreProfile);
@@ -20,6 +24,14 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     viewer = new ModelViewer(glFormat, this);    
     connect(viewer, SIGNAL(openGLInitialized()), this, SLOT(setTerrain()));
 
+    //decoding starts right away, assets that arrive before OpenGL is up are applied in setTerrain()
+    assets = new AssetLoader(this);
+    frustumModel = new OBJModel(this);
+    connect(assets, SIGNAL(assetLoaded(QString,bool)), this, SLOT(assetLoaded(QString,bool)));
+    assets->loadCubemap(SKYBOX_TEXTURE);
+    assets->loadImage(PARTICLE_TEXTURE);
+    assets->loadModel(frustumModel, FRUSTUM_MODEL);
+
     //--------------------------------------------------------------------------------
 
     QGroupBox *gbStaticOptions = new QGroupBox("Static", this);
@@ -211,7 +223,8 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
 
 void MainWindow::generateParticles() {
     sbTDist->setRange(0.0, sbPSSize->value() / 2);
-    viewer->initParticles(sbPCount->value(), ":/textures/snowflakes.jpg");
+    if(assets->isLoaded(PARTICLE_TEXTURE)) viewer->initParticles(sbPCount->value(), assets->image(PARTICLE_TEXTURE));
+    else viewer->initParticles(sbPCount->value(), PARTICLE_TEXTURE);
     viewer->initTerrain(sbPSSize->value(), sbTCSize->value());
     generateTerrain();
     viewer->generateParticles(sbPSSize->value());
@@ -220,17 +233,28 @@ void MainWindow::generateParticles() {
 
 void MainWindow::setTerrainTexture(int idx) {
     switch(idx) {
-    case 0: viewer->setTerrainBox(":/textures/skybox1.png"); break;
+    case 0: if(assets->isLoaded(SKYBOX_TEXTURE)) viewer->setTerrainBox(assets->cubemap(SKYBOX_TEXTURE)); break;
     default: break;
     }
 }
 
 void MainWindow::setTerrain() {
+    glReady = true;
     setTerrainTexture(cbTerrainTexture->currentIndex());
-    viewer->setFrustumModel(":/models/frustum.obj");
+    if(assets->isLoaded(FRUSTUM_MODEL)) viewer->setFrustumModel(frustumModel);
     viewer->resetView();
 }
 
+void MainWindow::assetLoaded(const QString &filePath, bool status) {
+    if(!status) {
+        QMessageBox::critical(this, "CG Task 4", QString("Unable to load %1").arg(filePath));
+        return;
+    }
+    if(!glReady) return;
+    if(filePath == SKYBOX_TEXTURE) setTerrainTexture(cbTerrainTexture->currentIndex());
+    else if(filePath == FRUSTUM_MODEL) viewer->setFrustumModel(frustumModel);
+}
+
 void MainWindow::generateTerrain() {
     viewer->generateTerrain(sbTPers->value() / 100.0, sbTFreq->value() / 100.0, sbTAmp->value(), sbTOct->value());
 }
@@ -9,6 +9,7 @@
 
 #include "modelviewer.h"
 #include "colorpicker.h"
+#include "assetloader.h"
 
 //-----------------------------------------------------
 
@@ -24,9 +25,13 @@ private slots:
     void generateTerrain();
     void setTerrain();
     void setCameraMode(bool m);
+    void assetLoaded(const QString &filePath, bool status);
 
 private:
     ModelViewer *viewer;
+    AssetLoader *assets;
+    OBJModel *frustumModel;
+    bool glReady;
     QSpinBox *sbPCount, *sbPSSize, *sbTCSize;
     QDoubleSpinBox *sbTDist;
 
@@ -12,6 +12,7 @@
 #include <QDateTime>
 
 #include "FrustumUtils.h"
+#include "glstatecache.h"
 
 //----------------------------------------------------------------------------------------
 
@@ -61,15 +62,14 @@ ModelViewer::ModelViewer(const QGLFormat &fmt, QWidget *parent) : QGLWidget(new
 }
 
 ModelViewer::~ModelViewer() {
-    glDeleteProgram(shaderProgramID);
-    glDeleteProgram(boxShaderProgramID);
-    glDeleteProgram(terrainShaderProgramID);
-    glDeleteProgram(frustumShaderProgramID);
-    glDeleteVertexArrays(1, &vertexArrayID);
-    glDeleteBuffers(1, &particlesPosBuffer);
-    glDeleteBuffers(1, &particlesSpeedBuffer);
-    glDeleteBuffers(2, particlesDelayBuffer);
-    glDeleteTextures(1, &particleTexID);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.deleteProgram(shaderProgramID);
+    gl.deleteProgram(boxShaderProgramID);
+    gl.deleteProgram(terrainShaderProgramID);
+    gl.deleteProgram(frustumShaderProgramID);
+    gl.deleteVertexArrays(2, particlesArrayID);
+    glDeleteBuffers(1, &particlesBuffer);
+    gl.deleteTextures(1, &particleTexID);
 }
 
 //----------------------------------------------------------------------------------------
@@ -132,6 +132,10 @@ void ModelViewer::setFrustumModel(const QString &model) {
     vFrustum.setModel(model);
 }
 
+void ModelViewer::setFrustumModel(const OBJModel *model) {
+    vFrustum.setModel(model);
+}
+
 //----------------------------------------------------------------------------------------
 
 void ModelViewer::setTerrainBox(const QList<QImage> &imgs) {
@@ -155,20 +159,23 @@ void ModelViewer::setTerrainBox(const QString &cubemap) {
 //----------------------------------------------------------------------------------------
 
 void ModelViewer::initParticles(size_t count, const QString &texPath) {
+    initParticles(count, QImage(texPath).convertToFormat(QImage::Format_RGB888));
+}
+
+void ModelViewer::initParticles(size_t count, const QImage &particleTex) {
     maxParticles = count;
 
+    GLStateCache &gl = GLStateCache::instance();
     if(psEnabled) {
-        glDeleteBuffers(1, &particlesPosBuffer);
-        glDeleteBuffers(1, &particlesSpeedBuffer);
-        glDeleteBuffers(2, particlesDelayBuffer);
-        glDeleteTextures(1, &particleTexID);
+        gl.deleteVertexArrays(2, particlesArrayID);
+        glDeleteBuffers(1, &particlesBuffer);
+        gl.deleteTextures(1, &particleTexID);
     }
 
     psEnabled = false;
 
-    QImage particleTex = QImage(texPath).convertToFormat(QImage::Format_RGB888);
     glGenTextures(1, &particleTexID);
-    glBindTexture(GL_TEXTURE_2D, particleTexID);
+    gl.bindTexture(0, GL_TEXTURE_2D, particleTexID);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, particleTex.width(), particleTex.height(), 0, GL_RGB, GL_UNSIGNED_BYTE, particleTex.bits());
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -181,10 +188,6 @@ void ModelViewer::generateParticles(int cubeSize) {
 
     qsrand(QDateTime::currentMSecsSinceEpoch());
 
-    glGenBuffers(1, &particlesPosBuffer);
-    glGenBuffers(1, &particlesSpeedBuffer);
-    glGenBuffers(2, particlesDelayBuffer);
-
     /*
     for(int j = 0; j < 4; ++j) {
         //generate particles for top octant
@@ -218,32 +221,36 @@ void ModelViewer::generateParticles(int cubeSize) {
     }
     */
 
-    std::vector<GLfloat> vs, sp, dl, bdl;
+    //one particle after another, the top and the bottom octants only differ in the delay they read
+    std::vector<GLfloat> ps;
     for(size_t i = 0; i < maxParticles / 4; ++i) {
-        vs.push_back(qrand() % halfSize - quarterSize);     //pos x
-        vs.push_back(quarterSize);                          //pos y
-        vs.push_back(qrand() % halfSize - quarterSize);     //pos z
-        vs.push_back(qrand() % 30 + 10);                    //size
-        sp.push_back((qrand() % 300 + 200.0) / 10000.0);    //speed range 0.02 .. 0.05
-        sp.push_back(qrand() % 20);                         //radius
-        sp.push_back(float(qrand() % 200) / 100000.0);      //freq
-        dl.push_back(0);                                    //delay
+        GLfloat speed = (qrand() % 300 + 200.0) / 10000.0;
+        ps.push_back(qrand() % halfSize - quarterSize);     //pos x
+        ps.push_back(quarterSize);                          //pos y
+        ps.push_back(qrand() % halfSize - quarterSize);     //pos z
+        ps.push_back(qrand() % 30 + 10);                    //size
+        ps.push_back(speed);                                //speed range 0.02 .. 0.05
+        ps.push_back(qrand() % 20);                         //radius
+        ps.push_back(float(qrand() % 200) / 100000.0);      //freq
+        ps.push_back(0);                                    //delay in top octant
+        ps.push_back(halfSize / speed);                     //delay in bottom octant
     }
 
-    //compute delay for bottom octant
-    for(size_t i = 0; i < dl.size(); ++i) {
-        bdl.push_back(halfSize / sp[3 * i]);
+    glGenBuffers(1, &particlesBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, particlesBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ps.size() * sizeof(GLfloat), ps.empty() ? 0 : &ps[0], GL_STATIC_DRAW);
+
+    glGenVertexArrays(2, particlesArrayID);
+    for(int i = 0; i < 2; ++i) {
+        GLStateCache::instance().bindVertexArray(particlesArrayID[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), (void*)((7 + i) * sizeof(GLfloat)));
     }
 
-    glBindBuffer(GL_ARRAY_BUFFER, particlesPosBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vs.size() * sizeof(GLfloat), &vs[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, particlesSpeedBuffer);
-    glBufferData(GL_ARRAY_BUFFER, sp.size() * sizeof(GLfloat), &sp[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, particlesDelayBuffer[0]);
-    glBufferData(GL_ARRAY_BUFFER, dl.size() * sizeof(GLfloat), &dl[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, particlesDelayBuffer[1]);
-    glBufferData(GL_ARRAY_BUFFER, bdl.size() * sizeof(GLfloat), &bdl[0], GL_STATIC_DRAW);
-
     psEnabled = true;
     startTime = QDateTime::currentMSecsSinceEpoch();
 
@@ -343,18 +350,17 @@ void ModelViewer::initializeGL() {
 
     std::cout << "OpenGL initialized: GL version "<< glGetString(GL_VERSION) << " | GLSL "<< glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.reset();
+    gl.enable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
+    gl.enable(GL_BLEND);
     glPolygonOffset(-1.0, -1.0);
 //    glEnable(GL_CULL_FACE);
 
     shaderProgramID = createShaders(":/shaders/particleVS.vsh", ":/shaders/particleFS.fsh", ":/shaders/particleGS.gsh");
 
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
     vpMatrixID = glGetUniformLocation(shaderProgramID, "VP");
     cameraPosID = glGetUniformLocation(shaderProgramID, "cameraPos");
     cameraRightID = glGetUniformLocation(shaderProgramID, "cameraRight");
@@ -380,7 +386,8 @@ void ModelViewer::initializeGL() {
     GLuint terrainSamplerID = glGetUniformLocation(terrainShaderProgramID, "texSampler");
     GLuint terrainTexModeID = glGetUniformLocation(terrainShaderProgramID, "textureMode");
     GLuint terrainContrastID = glGetUniformLocation(terrainShaderProgramID, "userContrast");
-    terrain.init(terrainShaderProgramID, terrainSamplerID, terrainMVPID, terrainWireframeID, terrainTexModeID, terrainContrastID);
+    GLuint terrainGridCellsID = glGetUniformLocation(terrainShaderProgramID, "gridCells");
+    terrain.init(terrainShaderProgramID, terrainSamplerID, terrainMVPID, terrainWireframeID, terrainTexModeID, terrainContrastID, terrainGridCellsID);
 
     frustumShaderProgramID = createShaders(":/shaders/modelVS.vsh", ":/shaders/modelFS.fsh");
     GLuint frustumMVPID = glGetUniformLocation(frustumShaderProgramID, "MVP");
@@ -395,20 +402,22 @@ void ModelViewer::paintGL() {
     glClearColor(0, 0, 0.0f, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    //every draw states what it needs, the cache drops what is already set
+    GLStateCache &gl = GLStateCache::instance();
+    gl.beginFrame();
+
     if(trEnabled && showTerrain) {
         mModel.setToIdentity();
         mModel.translate(currentCamera().pos);
         QMatrix4x4 mMVP = mProjection * mView * mModel;
 
-        skybox.render(mMVP);
-        if(showWireframe) skybox.render(mMVP, true);
+        skybox.render(mMVP, showWireframe);
 
         QMatrix4x4 tm;
         tm.setToIdentity();
         tm.translate(0, -5, 0);
         QMatrix4x4 mVP = mProjection * mView * tm;
-        terrain.render(mVP, false, terrainTexMode, terrainContrast);
-        if(showWireframe) terrain.render(mVP, true);
+        terrain.render(mVP, showWireframe, terrainTexMode, terrainContrast);
     }
 
     if(psEnabled) {
@@ -425,7 +434,7 @@ void ModelViewer::paintGL() {
         int octs = FrustumUtils::getIntersections(clipVP, vCamera.pos, psCubeSize / 2.0);
 //        findIntersectedOctants();
 
-        glUseProgram(shaderProgramID);
+        gl.useProgram(shaderProgramID);
 
         setUniformMatrix(glUniformMatrix4fv, vpMatrixID, mVP, 4, 4);
         setUniformVector3f(cameraRightID, vCamera.right);
@@ -437,15 +446,13 @@ void ModelViewer::paintGL() {
         glUniform1f(maxDistID, distThreshold);
         glUniform1f(cubeSizeID, psCubeSize);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, particleTexID);
+        gl.bindTexture(0, GL_TEXTURE_2D, particleTexID);
         glUniform1i(texSamplerID, 0);
 
         for(int i = 0; i < 8; ++i) {
             if(!CHECK_BIT(octs, i)) continue;
             setUniformVector3f(shiftID, getShiftForOctant(i));
-            renderParticleSystemPrecomp(false, i < 4);
-            if(showWireframe) renderParticleSystemPrecomp(true, i < 4);
+            renderParticleSystemPrecomp(showWireframe, i < 4);
         }
 
         if(currentCameraID > 0) {
@@ -457,31 +464,15 @@ void ModelViewer::paintGL() {
 }
 
 void ModelViewer::renderParticleSystemPrecomp(bool wireframe, bool top) {
-    if(wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    else glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    //the quad outlines are blended in by the fragment shader, the particles are drawn once
+    GLStateCache &gl = GLStateCache::instance();
+    gl.polygonMode(GL_FILL);
+    gl.disable(GL_POLYGON_OFFSET_FILL);
 
     glUniform1i(psWireframeID, wireframe ? 1 : 0);
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, particlesPosBuffer);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, particlesSpeedBuffer);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    glEnableVertexAttribArray(2);
-    if(top) glBindBuffer(GL_ARRAY_BUFFER, particlesDelayBuffer[0]);
-    else glBindBuffer(GL_ARRAY_BUFFER, particlesDelayBuffer[1]);
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    if(wireframe) glEnable(GL_POLYGON_OFFSET_FILL);
+    gl.bindVertexArray(particlesArrayID[top ? 0 : 1]);
     glDrawArrays(GL_POINTS, 0, maxParticles / 4);
-    if(wireframe) glDisable(GL_POLYGON_OFFSET_FILL);
-
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
 }
 
 void ModelViewer::resizeGL(int width, int height) {
@@ -567,14 +558,15 @@ GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile
     GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertexShaderID, 1, &pVertexShaderCode, NULL);
     glCompileShader(vertexShaderID);
-    if(!checkStatus(vertexShaderID, GL_COMPILE_STATUS)) return 0;
+    //every stage is compiled before giving up, so each failing one reports its log
+    bool compiled = checkStatus(vertexShaderID, GL_COMPILE_STATUS);
 
     std::string fragmentShaderCode = readFile(fshFile).toStdString();
     const char *pFragmentShaderCode = fragmentShaderCode.c_str();
     GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragmentShaderID, 1, &pFragmentShaderCode, NULL);
     glCompileShader(fragmentShaderID);
-    if(!checkStatus(fragmentShaderID, GL_COMPILE_STATUS)) return 0;
+    compiled = checkStatus(fragmentShaderID, GL_COMPILE_STATUS) && compiled;
 
     GLuint geometryShaderID = 0;
     if(!gshFile.isEmpty()) {
@@ -583,16 +575,23 @@ GLuint ModelViewer::createShaders(const QString &vshFile, const QString &fshFile
         geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
         glShaderSource(geometryShaderID, 1, &pGeometryShaderCode, NULL);
         glCompileShader(geometryShaderID);
-        if(!checkStatus(geometryShaderID, GL_COMPILE_STATUS)) return 0;
+        compiled = checkStatus(geometryShaderID, GL_COMPILE_STATUS) && compiled;
     }
 
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShaderID);
-    glAttachShader(shaderProgram, fragmentShaderID);
-    if(!gshFile.isEmpty()) glAttachShader(shaderProgram, geometryShaderID);
-    glLinkProgram(shaderProgram);
-    if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) return 0;
+    GLuint shaderProgram = 0;
+    if(compiled) {
+        shaderProgram = glCreateProgram();
+        glAttachShader(shaderProgram, vertexShaderID);
+        glAttachShader(shaderProgram, fragmentShaderID);
+        if(!gshFile.isEmpty()) glAttachShader(shaderProgram, geometryShaderID);
+        glLinkProgram(shaderProgram);
+        if(!checkStatus(shaderProgram, GL_LINK_STATUS, false)) {
+            glDeleteProgram(shaderProgram);
+            shaderProgram = 0;
+        }
+    }
 
+    //the shaders go whether the program was built or not
     glDeleteShader(vertexShaderID);
     glDeleteShader(fragmentShaderID);
     if(!gshFile.isEmpty()) glDeleteShader(geometryShaderID);
@@ -21,7 +21,9 @@ public:
     void setTerrainBox(const QList<QImage> &imgs);
     void setTerrainBox(const QString &cubemap);
     void setFrustumModel(const QString &model);
+    void setFrustumModel(const OBJModel *model);
     void initParticles(size_t count, const QString &texPath);
+    void initParticles(size_t count, const QImage &particleTex);
     void initTerrain(int cubeSize, int gridSize);
     void generateParticles(int cubeSize);
     void generateTerrain(float persistence, float frequency, float amplitude, int octaves);
@@ -74,8 +76,8 @@ private:
 
     QVector3D getShiftForOctant(int i) const;
 
-    GLuint particlesPosBuffer, particlesSpeedBuffer, particlesDelayBuffer[2];
-    GLuint particleTexID, vertexArrayID;
+    GLuint particlesBuffer, particlesArrayID[2];
+    GLuint particleTexID;
 
     GLuint shaderProgramID, vpMatrixID, texSamplerID;
     GLuint cameraPosID, cameraRightID, cameraUpID;
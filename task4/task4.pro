@@ -11,6 +11,8 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = task4
 TEMPLATE = app
 
+include(../common/common.pri)
+
 win32 {
     LIBS += -L"D:/libs/glew-1.10.0/lib/"
     INCLUDEPATH += D:/libs/glew-1.10.0/include
@@ -23,14 +25,14 @@ SOURCES += \
     mainwindow.cpp \
     main.cpp \
     terrain.cpp \
-    objmodel.cpp \
+    $$COMMON/assetloader.cpp \
     FrustumUtils.cpp
 
 HEADERS  += \
     modelviewer.h \
     mainwindow.h \
     terrain.h \
-    objmodel.h \
+    $$COMMON/assetloader.h \
     FrustumUtils.h
 
 RESOURCES += \
@@ -1,6 +1,7 @@
 #include "terrain.h"
+#include "assetloader.h"
+#include "glstatecache.h"
 
-#include <QVector2D>
 
 #if QT_VERSION >= 0x050000
 #define setUniformMatrix(func,location,value,cols,rows) \
@@ -23,16 +24,17 @@
 //===========================================================================================
 
 CubemapTexture::~CubemapTexture() {
-    glDeleteTextures(1, &texID);
+    GLStateCache::instance().deleteTextures(1, &texID);
 }
 
 QImage CubemapTexture::load(const QString &posX, const QString &negX,
           const QString &posY, const QString &negY,
           const QString &posZ, const QString &negZ) {
-    if(texID != 0) glDeleteTextures(1, &texID);
+    GLStateCache &gl = GLStateCache::instance();
+    if(texID != 0) gl.deleteTextures(1, &texID);
 
     glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texID);
+    gl.bindTexture(0, GL_TEXTURE_CUBE_MAP, texID);
 
     QMap<GLenum, QString> files;
     files.insert(GL_TEXTURE_CUBE_MAP_POSITIVE_X, posX);
@@ -58,10 +60,11 @@ QImage CubemapTexture::load(const QString &posX, const QString &negX,
 }
 
 QImage CubemapTexture::load(const QList<QImage> &imgs) {
-    if(texID != 0) glDeleteTextures(1, &texID);
+    GLStateCache &gl = GLStateCache::instance();
+    if(texID != 0) gl.deleteTextures(1, &texID);
 
     glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texID);
+    gl.bindTexture(0, GL_TEXTURE_CUBE_MAP, texID);
 
     for(int i = 0; i < 6; ++i) {
         const QImage &tex = imgs.at(i);
@@ -87,32 +90,12 @@ QImage CubemapTexture::getSubImage(const QImage &img, const QRect &rect) {
 }
 
 QList<QImage> CubemapTexture::splitCubemap(const QString &file, bool save) {
-    QImage img(file);
-    int rw = 0;
-    int rh = 0;
-    for(int i = 0; i < img.width(); ++i) {
-        if(rw == 0 && img.pixel(i, 0) != qRgb(255,255,255)) rw = i;
-        if(rh == 0 && img.pixel(0, i) != qRgb(255,255,255)) rh = i;
-        if(rw != 0 && rh != 0) break;
-    }
-
-    QImage posY = getSubImage(img, QRect(rw, 0, rw, rh)).convertToFormat(QImage::Format_RGB888);
-    QImage negY = getSubImage(img, QRect(rw, 2*rh, rw, rh)).convertToFormat(QImage::Format_RGB888);
-    QImage negX = getSubImage(img, QRect(0, rh, rw, rh)).convertToFormat(QImage::Format_RGB888);
-    QImage posZ = getSubImage(img, QRect(rw, rh, rw, rh)).convertToFormat(QImage::Format_RGB888);
-    QImage posX = getSubImage(img, QRect(2*rw, rh, rw, rh)).convertToFormat(QImage::Format_RGB888);
-    QImage negZ = getSubImage(img, QRect(3*rw, rh, rw, rh)).convertToFormat(QImage::Format_RGB888);
-
+    QList<QImage> res = AssetLoader::splitCubemap(QImage(file));
     if(save) {
-        posX.save("posX.png"); negX.save("negX.png");
-        posY.save("posY.png"); negY.save("negY.png");
-        posZ.save("posZ.png"); negZ.save("negZ.png");
+        res.at(0).save("posX.png"); res.at(1).save("negX.png");
+        res.at(2).save("posY.png"); res.at(3).save("negY.png");
+        res.at(4).save("posZ.png"); res.at(5).save("negZ.png");
     }
-
-    QList<QImage> res;
-    res.append(posX); res.append(negX);
-    res.append(posY); res.append(negY);
-    res.append(posZ); res.append(negZ);
     return res;
 }
 
@@ -129,6 +112,7 @@ void CubemapTexture::splitStrip(const QString &file, int size) {
 Skybox::~Skybox() {
     glDeleteBuffers(1, &vertexBuffer);
     glDeleteBuffers(1, &indexBuffer);
+    GLStateCache::instance().deleteVertexArrays(1, &arrayID);
 }
 
 QImage Skybox::setTexture(const QList<QImage> &cubemap) {
@@ -156,9 +140,13 @@ void Skybox::init(GLuint shaderProgram, GLuint texSampler, GLuint mvp, GLuint wm
         1.0,	1.0,	1.0
     };
 
+    glGenVertexArrays(1, &arrayID);
+    GLStateCache::instance().bindVertexArray(arrayID);
     glGenBuffers(1, &vertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     unsigned char indices[24] = {
         1,			5,			7,			3,	// positive x
@@ -175,59 +163,55 @@ void Skybox::init(GLuint shaderProgram, GLuint texSampler, GLuint mvp, GLuint wm
 }
 
 void Skybox::render(const QMatrix4x4 &mvp, bool wireframe) {
-    GLboolean oldDepthMaskMode;
-    glGetBooleanv(GL_DEPTH_WRITEMASK, &oldDepthMaskMode);
-    glDepthMask(GL_FALSE);
+    //the depth mask comes from the cache, asking GL for it would stall the pipeline
+    GLStateCache &gl = GLStateCache::instance();
+    GLboolean oldDepthMaskMode = gl.depthMask();
+    gl.depthMask(GL_FALSE);
 
-    if(wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    else glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    //the wireframe is blended into the faces by the shader, the box is drawn once
+    gl.polygonMode(GL_FILL);
+    gl.disable(GL_POLYGON_OFFSET_FILL);
 
-    glUseProgram(shaderProgramID);
+    gl.useProgram(shaderProgramID);
     setUniformMatrix(glUniformMatrix4fv, mvpID, mvp, 4, 4);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, tex.getTexID());
+    gl.bindTexture(0, GL_TEXTURE_CUBE_MAP, tex.getTexID());
     glUniform1i(texSamplerID, 0);
     glUniform1i(wmID, wireframe ? 1 : 0);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    if(wireframe) glEnable(GL_POLYGON_OFFSET_FILL);
+    gl.bindVertexArray(arrayID);
     glDrawElements(GL_QUADS, 6 * 4, GL_UNSIGNED_BYTE, 0);
-    if(wireframe) glDisable(GL_POLYGON_OFFSET_FILL);
-    glDisableVertexAttribArray(0);
 
-    glDepthMask(oldDepthMaskMode);
+    gl.depthMask(oldDepthMaskMode);
 }
 
 //===========================================================================================
 
 Terrain::~Terrain() {
     glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &normalBuffer);
     glDeleteBuffers(1, &indexBuffer);
-    glDeleteBuffers(1, &texCoordBuffer);
-    glDeleteTextures(1, &texID);
-    glDeleteTextures(1, &normalTexID);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.deleteVertexArrays(1, &arrayID);
+    gl.deleteTextures(1, &texID);
+    gl.deleteTextures(1, &normalTexID);
 }
 
-void Terrain::init(GLuint shaderProgram, GLuint texSampler, GLuint mvp, GLuint wm, GLuint tm, GLuint uc) {
+void Terrain::init(GLuint shaderProgram, GLuint texSampler, GLuint mvp, GLuint wm, GLuint tm, GLuint uc, GLuint gc) {
     shaderProgramID = shaderProgram;
     texSamplerID = texSampler;
     mvpID = mvp;
     wmID = wm;
     texModeID = tm;
     contrastID = uc;
+    gridCellsID = gc;
 }
 
 void Terrain::generatePlane(float planeZSize, float planeXSize, float cellSize) {
     gridSize = cellSize;
 
-    if(vertexBuffer != 0) {
+    if(arrayID != 0) {
         glDeleteBuffers(1, &vertexBuffer);
         glDeleteBuffers(1, &indexBuffer);
-        glDeleteBuffers(1, &texCoordBuffer);
+        GLStateCache::instance().deleteVertexArrays(1, &arrayID);
         vertexBuffer = 0;
     }
 
@@ -235,28 +219,21 @@ void Terrain::generatePlane(float planeZSize, float planeXSize, float cellSize)
     vW = planeXSize / cellSize + 1;
 
     QVector<QVector3D> vcoords(vL * vW);
-    QVector<QVector2D> tcoords(vL * vW);
 
     float halfW = ((float)vW - 1.0f) / 2.0f;
     float halfL = ((float)vL - 1.0f) / 2.0f;
     for(int z = 0; z < vL; ++z) {
         for(int x = 0; x < vW; ++x) {
             vcoords[z * vW + x] = QVector3D(((float)x - halfW) * cellSize, 0.0, ((float)z - halfL) * cellSize);
-            tcoords[z * vW + x] = QVector2D((float)x / (vW - 1.0),  (float)z / (vL - 1.0));
         }
     }
 
     vertexCoords.clear();
-    QVector<float> texCoords;
     for(QVector<QVector3D>::Iterator it = vcoords.begin(); it != vcoords.end(); ++it) {
         vertexCoords.push_back(it->x());
         vertexCoords.push_back(it->y());
         vertexCoords.push_back(it->z());
     }
-    for(QVector<QVector2D>::Iterator it = tcoords.begin(); it != tcoords.end(); ++it) {
-        texCoords.push_back(it->x());
-        texCoords.push_back(it->y());
-    }
 
     indexBufferSize = (vW * 2) * (vL - 1) + (vL - 2);
     QVector<unsigned int> indices(indexBufferSize);
@@ -281,10 +258,9 @@ void Terrain::generatePlane(float planeZSize, float planeXSize, float cellSize)
         }
     }
 
-    glGenBuffers(1, &texCoordBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, texCoordBuffer);
-    glBufferData(GL_ARRAY_BUFFER, texCoords.size() * sizeof(float), &texCoords[0], GL_STATIC_DRAW);
-
+    //the index buffer belongs to the vertex array, bindBuffer adds the vertices once the heights are known
+    glGenVertexArrays(1, &arrayID);
+    GLStateCache::instance().bindVertexArray(arrayID);
     glGenBuffers(1, &indexBuffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
@@ -396,24 +372,42 @@ void Terrain::computeNormals() {
 //    img.save("norm.png");
 }
 
+//position, normal and texture coordinates of every grid vertex side by side
 void Terrain::bindBuffer() {
     if(vertexBuffer != 0) glDeleteBuffers(1, &vertexBuffer);
-    if(normalBuffer != 0) glDeleteBuffers(1, &normalBuffer);
 
+    QVector<float> vertices(vW * vL * 8);
+    float *out = vertices.data();
+    for(int z = 0; z < vL; ++z) {
+        for(int x = 0; x < vW; ++x, out += 8) {
+            int i = (z * vW + x) * 3;
+            for(int k = 0; k < 3; ++k) {
+                out[k] = vertexCoords[i + k];
+                out[3 + k] = vertexNormals[i + k];
+            }
+            out[6] = (float)x / (vW - 1.0);
+            out[7] = (float)z / (vL - 1.0);
+        }
+    }
+
+    GLStateCache::instance().bindVertexArray(arrayID);
     glGenBuffers(1, &vertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertexCoords.size() * sizeof(float), &vertexCoords[0], GL_STATIC_DRAW);
-
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertexNormals.size() * sizeof(float), &vertexNormals[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 }
 
 void Terrain::setTexture(const QImage &img, bool terrain) {
+    GLStateCache &gl = GLStateCache::instance();
     GLuint tex = terrain ? texID : normalTexID;
-    if(tex != 0) glDeleteTextures(1, &tex);
+    if(tex != 0) gl.deleteTextures(1, &tex);
     glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+    gl.bindTexture(0, GL_TEXTURE_2D, tex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img.width(), img.height(), 0, GL_RGB, GL_UNSIGNED_BYTE, img.bits());
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -426,66 +420,72 @@ void Terrain::setTexture(const QImage &img, bool terrain) {
 void Terrain::render(const QMatrix4x4 &mvp, bool wireframe, int texMode, float contrast) {
     if(vertexBuffer == 0) return;
 
-    if(wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    else glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    //the wireframe is blended into the fill by the shader, which finds the edges from the grid coordinates
+    GLStateCache &gl = GLStateCache::instance();
+    gl.polygonMode(GL_FILL);
+    gl.disable(GL_POLYGON_OFFSET_FILL);
 
-    glUseProgram(shaderProgramID);
-    glActiveTexture(GL_TEXTURE0);
-    if(texMode == 0) glBindTexture(GL_TEXTURE_2D, texID);
-    else glBindTexture(GL_TEXTURE_2D, normalTexID);
+    gl.useProgram(shaderProgramID);
+    gl.bindTexture(0, GL_TEXTURE_2D, texMode == 0 ? texID : normalTexID);
     glUniform1i(texSamplerID, 0);
     setUniformMatrix(glUniformMatrix4fv, mvpID, mvp, 4, 4);
     glUniform1i(wmID, wireframe ? 1 : 0);
+    glUniform2f(gridCellsID, (GLfloat)(vW - 1), (GLfloat)(vL - 1));
     glUniform1i(texModeID, texMode);
     glUniform1f(contrastID, contrast);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, texCoordBuffer);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    if(wireframe) glEnable(GL_POLYGON_OFFSET_FILL);
+    gl.bindVertexArray(arrayID);
     glDrawElements(GL_TRIANGLE_STRIP, indexBufferSize, GL_UNSIGNED_INT, 0);
-    if(wireframe) glDisable(GL_POLYGON_OFFSET_FILL);
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
 }
 
 //===========================================================================================
 
-CameraFrustum::CameraFrustum() : QObject(), vertexBuffer(0), vertexBufferSize(0), mFrustum(new OBJModel(this)) {
+CameraFrustum::CameraFrustum() : QObject(), vertexBuffer(0), indexBuffer(0), indexBufferSize(0), arrayID(0), cubeArrayID(0), mFrustum(new OBJModel(this)) {
     connect(mFrustum, SIGNAL(loadStatus(bool)), this, SLOT(setModelBuffer()));
 }
 
 CameraFrustum::~CameraFrustum() {
     mFrustum->deleteLater();
     glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteBuffers(1, &cubeVertexBuffer);
+    glDeleteBuffers(1, &cubeIndexBuffer);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.deleteVertexArrays(1, &arrayID);
+    gl.deleteVertexArrays(1, &cubeArrayID);
 }
 
 void CameraFrustum::setModel(const QString &model) {
     mFrustum->loadModel(model);
 }
 
-void CameraFrustum::setModelBuffer() {
+void CameraFrustum::setModel(const OBJModel *model) {
     if(vertexBuffer != 0) glDeleteBuffers(1, &vertexBuffer);
+    if(indexBuffer != 0) glDeleteBuffers(1, &indexBuffer);
 
+    const OBJMesh &mesh = model->mesh;
     std::vector<OBJVec3> vs;
-    for(std::vector<OBJFace>::iterator fi = mFrustum->faces.begin(); fi != mFrustum->faces.end(); ++fi) {
-        for(OBJFace::iterator fii = fi->begin(); fii != fi->end(); ++fii) {
-            vs.push_back(mFrustum->verts[fii->v - 1]);
-        }
+    vs.reserve(mesh.vertices.size());
+    for(std::vector<FaceIndex>::const_iterator vi = mesh.vertices.begin(); vi != mesh.vertices.end(); ++vi) {
+        vs.push_back(model->verts[vi->v - 1]);
     }
 
+    if(arrayID == 0) glGenVertexArrays(1, &arrayID);
+    GLStateCache::instance().bindVertexArray(arrayID);
     glGenBuffers(1, &vertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, vs.size() * sizeof(OBJVec3), &vs[0], GL_STATIC_DRAW);
-    vertexBufferSize = vs.size();
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint), &mesh.indices[0], GL_STATIC_DRAW);
+    indexBufferSize = mesh.indices.size();
+}
+
+void CameraFrustum::setModelBuffer() {
+    setModel(mFrustum);
 }
 
 QQuaternion CameraFrustum::rotationBetweenVectors(const QVector3D &start, const QVector3D &dest) const {
@@ -550,9 +550,13 @@ void CameraFrustum::init(GLuint shaderProgram, GLuint mvp, GLuint wm, GLuint mc)
         0.5,	0.5,	0.5
     };
 
+    glGenVertexArrays(1, &cubeArrayID);
+    GLStateCache::instance().bindVertexArray(cubeArrayID);
     glGenBuffers(1, &cubeVertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, cubeVertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     unsigned char indices[24] = {
         1,			5,			7,			3,	// positive x
@@ -573,27 +577,21 @@ void CameraFrustum::render(const QMatrix4x4 &vp, const QVector3D &cameraPos, int
 
     QMatrix4x4 mvp = vp * mModel;
 
-    glUseProgram(shaderProgramID);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.useProgram(shaderProgramID);
     setUniformMatrix(glUniformMatrix4fv, mvpID, mvp, 4, 4);
     glUniform3f(colorID, 1.0, 1.0, 1.0);
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    gl.polygonMode(GL_FILL);
+    gl.disable(GL_POLYGON_OFFSET_FILL);
     glUniform1i(wmID, 0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-    glDisableVertexAttribArray(0);
+    gl.bindVertexArray(arrayID);
+    glDrawElements(GL_TRIANGLES, indexBufferSize, GL_UNSIGNED_INT, 0);
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    gl.polygonMode(GL_LINE);
+    gl.enable(GL_POLYGON_OFFSET_FILL);
     glUniform1i(wmID, 1);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    glDrawArrays(GL_TRIANGLES, 0, vertexBufferSize);
-    glDisable(GL_POLYGON_OFFSET_FILL);
-    glDisableVertexAttribArray(0);
+    glDrawElements(GL_TRIANGLES, indexBufferSize, GL_UNSIGNED_INT, 0);
 
     float osz = cubeSize / 2.0;
     float cs = osz / 2.0 + 0.1;
@@ -614,7 +612,7 @@ void CameraFrustum::renderCube(const QMatrix4x4 &vp, const QVector3D &pos, float
     mm.scale(cubeSize);
     QMatrix4x4 mvp = vp * mm;
 
-    glUseProgram(shaderProgramID);
+    GLStateCache::instance().useProgram(shaderProgramID);
     setUniformMatrix(glUniformMatrix4fv, mvpID, mvp, 4, 4);
     if(ints) glUniform3f(colorID, 0.0, 1.0, 0.0);
     else glUniform3f(colorID, 1.0, 0.5, 0.0);
@@ -623,17 +621,12 @@ void CameraFrustum::renderCube(const QMatrix4x4 &vp, const QVector3D &pos, float
 }
 
 void CameraFrustum::renderCubePrecomp(bool wireframe) {
-    if(wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    else glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    GLStateCache &gl = GLStateCache::instance();
+    gl.polygonMode(wireframe ? GL_LINE : GL_FILL);
+    gl.setEnabled(GL_POLYGON_OFFSET_FILL, wireframe);
     glUniform1i(wmID, wireframe ? 1 : 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeIndexBuffer);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    if(wireframe) glEnable(GL_POLYGON_OFFSET_FILL);
+    gl.bindVertexArray(cubeArrayID);
     glDrawElements(GL_QUADS, 6 * 4, GL_UNSIGNED_BYTE, 0);
-    if(wireframe) glDisable(GL_POLYGON_OFFSET_FILL);
-    glDisableVertexAttribArray(0);
 }
 
 //===========================================================================================
@@ -37,7 +37,7 @@ private:
 
 class Skybox {
 public:
-    Skybox() : vertexBuffer(0), indexBuffer(0) {}
+    Skybox() : vertexBuffer(0), indexBuffer(0), arrayID(0) {}
     ~Skybox();
 
     QImage setTexture(const QList<QImage> &cubemap);
@@ -48,7 +48,7 @@ public:
 
 private:
     GLuint shaderProgramID, texSamplerID, mvpID, wmID;
-    GLuint vertexBuffer, indexBuffer;
+    GLuint vertexBuffer, indexBuffer, arrayID;
 
     CubemapTexture tex;
 };
@@ -57,14 +57,14 @@ private:
 
 class Terrain {
 public:
-    Terrain() : vertexBuffer(0), normalBuffer(0), texID(0), normalTexID(0) {}
+    Terrain() : vertexBuffer(0), indexBuffer(0), arrayID(0), texID(0), normalTexID(0) {}
     ~Terrain();
 
     bool ready() const {
         return !vertexCoords.empty();
     }
 
-    void init(GLuint shaderProgram, GLuint texSampler, GLuint mvp, GLuint wm, GLuint tm, GLuint uc);
+    void init(GLuint shaderProgram, GLuint texSampler, GLuint mvp, GLuint wm, GLuint tm, GLuint uc, GLuint gc);
     void generatePlane(float planeZSize, float planeXSize, float cellSize);
     void generateHeightMap(float persistence, float frequency, float amplitude, int octaves);
     void bindBuffer();
@@ -80,8 +80,8 @@ private:
     inline QPolygon getXZTriangle(const QVector3D &v1, const QVector3D &v2, const QVector3D &v3);
     inline QColor colorFromNorm(const QVector3D &norm);
 
-    GLuint shaderProgramID, mvpID, wmID, texSamplerID, texModeID, contrastID;
-    GLuint vertexBuffer, texCoordBuffer, indexBuffer, indexBufferSize, normalBuffer;
+    GLuint shaderProgramID, mvpID, wmID, texSamplerID, texModeID, contrastID, gridCellsID;
+    GLuint vertexBuffer, indexBuffer, indexBufferSize, arrayID;
     GLuint texID, normalTexID;
 
     float gridSize;
@@ -119,6 +119,7 @@ public:
     ~CameraFrustum();
 
     void setModel(const QString &model);
+    void setModel(const OBJModel *model);
     void init(GLuint shaderProgram, GLuint mvp, GLuint wm, GLuint mc);
     void update(const QVector3D &cameraPos, const QVector3D &cameraDir, const QVector3D &cameraRight, float far, float fov, float ratio);
     void render(const QMatrix4x4 &vp, const QVector3D &cameraPos, int octs, float cubeSize = 0.0);
@@ -132,8 +133,8 @@ private:
     QQuaternion rotationBetweenVectors(const QVector3D &start, const QVector3D &dest) const;
 
     GLuint shaderProgramID, mvpID, wmID, colorID;
-    GLuint vertexBuffer, vertexBufferSize;
-    GLuint cubeVertexBuffer, cubeIndexBuffer;
+    GLuint vertexBuffer, indexBuffer, indexBufferSize, arrayID;
+    GLuint cubeVertexBuffer, cubeIndexBuffer, cubeArrayID;
 
     OBJModel *mFrustum;
     QMatrix4x4 mModel;
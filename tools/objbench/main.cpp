@@ -0,0 +1,118 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QEventLoop>
+#include <QThreadPool>
+
+#include "objmodel.h"
+#include "objcorpus.h"
+
+#include <iostream>
+#include <algorithm>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Loads OBJ files without a window or a GL context and prints where the loader spends its time.
+// Every file is loaded --repeat times into the same model and the best and the median run are
+// reported. The peak memory is a high-water mark of the whole process, so it is printed once
+// after the last file; run objbench per file to get the peak of a single model.
+
+static const char *usage =
+        "usage: objbench generate <file.obj> <triangles> [v|v/t|v//n|v/t/n]\n"
+        "       objbench [--repeat n] [--threads n] [--cache] [--optimize] [--lod] [--normals] [--clusters] [--bvh] <file.obj>...\n";
+
+static double peakMemoryMB() {
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0.0;
+    return counters.PeakWorkingSetSize / 1048576.0;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss / 1048576.0;
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+static int generate(const QStringList &args) {
+    bool ok = args.size() >= 4;
+    qint64 triangles = ok ? args[3].toLongLong(&ok) : 0;
+    OBJCorpus::Format format = OBJCorpus::PositionsTexCoordsNormals;
+    if(ok && args.size() > 4) ok = OBJCorpus::parseFormat(args[4], format);
+    if(!ok) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    QString error;
+    if(!OBJCorpus::generate(args[2], triangles, format, error)) {
+        std::cerr << "objbench: " << error.toStdString() << std::endl;
+        return 1;
+    }
+    std::cout << args[2].toStdString() << ": " << triangles << " triangles, " << OBJCorpus::formatName(format).toStdString() << " faces" << std::endl;
+    return 0;
+}
+
+static int benchmark(const QStringList &args) {
+    OBJModel model;
+    model.setCacheEnabled(false);
+    int repeat = 5;
+    QStringList files;
+    bool ok = true;
+    for(int i = 1; i < args.size() && ok; ++i) {
+        const QString &a = args[i];
+        if(a == "--repeat" && i + 1 < args.size()) repeat = qMax(1, args[++i].toInt(&ok));
+        else if(a == "--threads" && i + 1 < args.size()) QThreadPool::globalInstance()->setMaxThreadCount(qMax(1, args[++i].toInt(&ok)));
+        else if(a == "--cache") model.setCacheEnabled(true);
+        else if(a == "--optimize") model.setOptimizeEnabled(true);
+        else if(a == "--lod") model.setLodEnabled(true);
+        else if(a == "--normals") model.setNormalsEnabled(true);
+        else if(a == "--clusters") model.setClustersEnabled(true);
+        else if(a == "--bvh") model.setBvhEnabled(true);
+        else if(a.startsWith("--")) ok = false;
+        else files << a;
+    }
+    if(!ok || files.isEmpty()) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    std::cout << QThreadPool::globalInstance()->maxThreadCount() << " threads, " << repeat << " runs per file" << std::endl;
+    QEventLoop loop;
+    QObject::connect(&model, SIGNAL(loadStatus(bool)), &loop, SLOT(quit()));
+    for(QStringList::const_iterator f = files.begin(); f != files.end(); ++f) {
+        std::vector<double> times;
+        OBJLoadStats best;
+        for(int r = 0; r < repeat; ++r) {
+            model.loadModel(*f);
+            loop.exec();
+            if(!model.status()) {
+                std::cerr << "objbench: " << f->toStdString() << ": " << model.modelError().toStdString() << std::endl;
+                return 1;
+            }
+            const OBJLoadStats &stats = model.loadStats();
+            std::cout << "  run " << r + 1 << ": " << stats.toString().toStdString() << std::endl;
+            if(times.empty() || stats.totalTime < best.totalTime) best = stats;
+            times.push_back(stats.totalTime);
+        }
+        std::sort(times.begin(), times.end());
+        std::cout << f->toStdString() << ": best " << best.totalTime << " ms, median " << times[times.size() / 2] << " ms, "
+                  << best.bytesPerSecond() / 1048576.0 << " MB/s, " << best.linesPerSecond() / 1e6 << " Mlines/s" << std::endl;
+    }
+    std::cout << "peak memory " << peakMemoryMB() << " MB" << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+    if(args.size() > 1 && args[1] == "generate") return generate(args);
+    return benchmark(args);
+}
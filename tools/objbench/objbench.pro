@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Headless benchmark of the OBJ loader shared by the tasks
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = objbench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../common/objloader.pri)
+
+SOURCES += main.cpp \
+    objcorpus.cpp
+
+HEADERS  += objcorpus.h
+
+win32 {
+    INCLUDEPATH += D:/libs/glew-1.10.0/include
+    LIBS += -lpsapi
+}
@@ -0,0 +1,124 @@
+#include "objcorpus.h"
+
+#include <QFile>
+#include <QByteArray>
+
+#include <cmath>
+#include <cstdarg>
+
+#define WRITE_BUFFER_SIZE (4 << 20)
+
+static const char *formatNames[] = { "v", "v/t", "v//n", "v/t/n" };
+
+//lines are gathered in a buffer of a few megabytes, so that large files don't hold the whole text
+class OBJCorpusWriter {
+public:
+    OBJCorpusWriter(QFile &file) : file(file), failed(false) {
+        buffer.reserve(WRITE_BUFFER_SIZE + 256);
+    }
+
+    void line(const char *format, ...) {
+        char text[256];
+        va_list args;
+        va_start(args, format);
+        int n = qvsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        buffer.append(text, qMin<int>(n, sizeof(text) - 1));
+        if(buffer.size() >= WRITE_BUFFER_SIZE) flush();
+    }
+
+    bool flush() {
+        if(!buffer.isEmpty() && file.write(buffer) != buffer.size()) failed = true;
+        buffer.clear();
+        return !failed;
+    }
+
+private:
+    QFile &file;
+    QByteArray buffer;
+    bool failed;
+};
+
+/**************************************************************************************/
+
+bool OBJCorpus::parseFormat(const QString &name, Format &format) {
+    for(int f = 0; f < 4; ++f) {
+        if(name == formatNames[f]) {
+            format = (Format)f;
+            return true;
+        }
+    }
+    return false;
+}
+
+QString OBJCorpus::formatName(Format format) {
+    return formatNames[format];
+}
+
+bool OBJCorpus::generate(const QString &filePath, qint64 triangles, Format format, QString &error) {
+    if(triangles < 1) {
+        error = "at least one triangle is needed";
+        return false;
+    }
+    QFile file(filePath);
+    if(!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        error = "unable to create " + filePath;
+        return false;
+    }
+
+    //as square as the triangle count allows, the last row may be partly filled
+    qint64 quads = (triangles + 1) / 2;
+    qint64 cols = qMax<qint64>(1, (qint64)sqrt((double)quads));
+    qint64 rows = (quads + cols - 1) / cols;
+    bool texCoords = format == PositionsTexCoords || format == PositionsTexCoordsNormals;
+    bool normals = format == PositionsNormals || format == PositionsTexCoordsNormals;
+
+    OBJCorpusWriter out(file);
+    out.line("# objbench corpus: %lld triangles, %s faces\n", triangles, formatNames[format]);
+    for(qint64 r = 0; r <= rows; ++r) {
+        for(qint64 c = 0; c <= cols; ++c) {
+            double x = (double)c / cols, y = (double)r / rows;
+            double z = 0.05 * sin(x * 12.0) * cos(y * 9.0);
+            out.line("v %.6f %.6f %.6f\n", x, y, z);
+        }
+    }
+    if(texCoords) {
+        for(qint64 r = 0; r <= rows; ++r) {
+            for(qint64 c = 0; c <= cols; ++c) out.line("vt %.6f %.6f\n", (double)c / cols, (double)r / rows);
+        }
+    }
+    if(normals) {
+        for(qint64 r = 0; r <= rows; ++r) {
+            for(qint64 c = 0; c <= cols; ++c) {
+                double x = (double)c / cols, y = (double)r / rows;
+                double dx = 0.6 * cos(x * 12.0) * cos(y * 9.0);
+                double dy = -0.45 * sin(x * 12.0) * sin(y * 9.0);
+                double len = sqrt(dx * dx + dy * dy + 1.0);
+                out.line("vn %.6f %.6f %.6f\n", -dx / len, -dy / len, 1.0 / len);
+            }
+        }
+    }
+
+    qint64 written = 0;
+    for(qint64 r = 0; r < rows && written < triangles; ++r) {
+        for(qint64 c = 0; c < cols && written < triangles; ++c) {
+            qint64 a = r * (cols + 1) + c + 1, b = a + 1, d = a + cols + 1, e = d + 1;
+            qint64 tris[2][3] = { { a, b, e }, { a, e, d } };
+            for(int t = 0; t < 2 && written < triangles; ++t, ++written) {
+                const qint64 *i = tris[t];
+                switch(format) {
+                case Positions: out.line("f %lld %lld %lld\n", i[0], i[1], i[2]); break;
+                case PositionsTexCoords: out.line("f %lld/%lld %lld/%lld %lld/%lld\n", i[0], i[0], i[1], i[1], i[2], i[2]); break;
+                case PositionsNormals: out.line("f %lld//%lld %lld//%lld %lld//%lld\n", i[0], i[0], i[1], i[1], i[2], i[2]); break;
+                case PositionsTexCoordsNormals: out.line("f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n", i[0], i[0], i[0], i[1], i[1], i[1], i[2], i[2], i[2]); break;
+                }
+            }
+        }
+    }
+
+    if(!out.flush()) {
+        error = "unable to write " + filePath;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef OBJCORPUS_H
+#define OBJCORPUS_H
+
+#include <QString>
+
+// Synthetic OBJ files for the loader benchmark: a rippled grid of the requested number of
+// triangles, with texture coordinates and normals written only when the face format uses them.
+// Every triangle is a face line of its own, indices are absolute.
+
+class OBJCorpus {
+public:
+    enum Format { Positions, PositionsTexCoords, PositionsNormals, PositionsTexCoordsNormals };
+
+    // "v", "v/t", "v//n" or "v/t/n"
+    static bool parseFormat(const QString &name, Format &format);
+    static QString formatName(Format format);
+
+    static bool generate(const QString &filePath, qint64 triangles, Format format, QString &error);
+};
+
+#endif // OBJCORPUS_H